@@ -15,8 +15,10 @@
 /* Context pointer is stored in TPIDRRO_EL0 */
 /* SR is stored in TPIDR_EL0 */
 /* last_PC is stored in TPIDR_EL1 */
+/* m68k instruction counter is kept in x12 if EMU68_INSN_COUNTER_REG is set */
 
 #define REG_PC    18
+#define REG_INSN_COUNT 12
 
 #define REG_D0    19
 #define REG_D1    20
@@ -441,6 +443,10 @@ static inline uint32_t csinc(uint8_t rd, uint8_t rn, uint8_t rm, uint8_t cond) {
 static inline uint32_t csinc64(uint8_t rd, uint8_t rn, uint8_t rm, uint8_t cond) { return I32(0x9a800400 | (rd & 31) | ((rn & 31) << 5) | ((rm & 31) << 16) | ((cond & 15) << 12)); }
 static inline uint32_t csinv(uint8_t rd, uint8_t rn, uint8_t rm, uint8_t cond) { return I32(0x5a800000 | (rd & 31) | ((rn & 31) << 5) | ((rm & 31) << 16) | ((cond & 15) << 12)); }
 static inline uint32_t csinv64(uint8_t rd, uint8_t rn, uint8_t rm, uint8_t cond) { return I32(0xda800000 | (rd & 31) | ((rn & 31) << 5) | ((rm & 31) << 16) | ((cond & 15) << 12)); }
+static inline uint32_t csneg(uint8_t rd, uint8_t rn, uint8_t rm, uint8_t cond) { return I32(0x5a800400 | (rd & 31) | ((rn & 31) << 5) | ((rm & 31) << 16) | ((cond & 15) << 12)); }
+static inline uint32_t csneg64(uint8_t rd, uint8_t rn, uint8_t rm, uint8_t cond) { return I32(0xda800400 | (rd & 31) | ((rn & 31) << 5) | ((rm & 31) << 16) | ((cond & 15) << 12)); }
+static inline uint32_t cneg(uint8_t rd, uint8_t rn, uint8_t cond) { return csneg(rd, rn, rn, cond ^ 1); }
+static inline uint32_t cneg64(uint8_t rd, uint8_t rn, uint8_t cond) { return csneg64(rd, rn, rn, cond ^ 1); }
 static inline uint32_t csetm(uint8_t rd, uint8_t cond) { return csinv(rd, 31, 31, cond ^ 1); }
 static inline uint32_t csetm64(uint8_t rd, uint8_t cond) { return csinv64(rd, 31, 31, cond ^ 1); }
 static inline uint32_t cset(uint8_t rd, uint8_t cond) { return csinc(rd, 31, 31, cond ^ 1); }
@@ -499,6 +505,8 @@ static inline uint32_t umaddl(uint8_t rd, uint8_t ra, uint8_t rn, uint8_t rm) {
 static inline uint32_t umsubl(uint8_t rd, uint8_t ra, uint8_t rn, uint8_t rm) { return I32(0x9ba08000 | (rd & 31) | ((rn & 31) << 5) | ((ra & 31) << 10) | ((rm & 31) << 16)); }
 static inline uint32_t umnegl(uint8_t rd, uint8_t rn, uint8_t rm) { return umsubl(rd, 31, rn, rm); }
 static inline uint32_t umull(uint8_t rd, uint8_t rn, uint8_t rm) { return umaddl(rd, 31, rn, rm); }
+static inline uint32_t smulh(uint8_t rd, uint8_t rn, uint8_t rm) { return I32(0x9b407c00 | (rd & 31) | ((rn & 31) << 5) | ((rm & 31) << 16)); }
+static inline uint32_t umulh(uint8_t rd, uint8_t rn, uint8_t rm) { return I32(0x9bc07c00 | (rd & 31) | ((rn & 31) << 5) | ((rm & 31) << 16)); }
 
 /* Data processing: divide */
 static inline uint32_t sdiv(uint8_t rd, uint8_t rn, uint8_t rm) { return I32(0x1ac00c00 | (rd & 31) | ((rn & 31) << 5) | ((rm & 31) << 16)); }
@@ -543,10 +551,13 @@ static inline uint32_t flds_pimm(uint8_t v_dst, uint8_t base, uint16_t offset12)
 static inline uint32_t fldd_pcrel(uint8_t v_dst, int32_t imm19) { return I32(0x5c000000 | (v_dst & 31) | ((imm19 & 0x7ffff) << 5)); }
 static inline uint32_t flds_pcrel(uint8_t v_dst, int32_t imm19) { return I32(0x1c000000 | (v_dst & 31) | ((imm19 & 0x7ffff) << 5)); }
 static inline uint32_t fldq_pcrel(uint8_t v_dst, int32_t imm19) { return I32(0x9c000000 | (v_dst & 31) | ((imm19 & 0x7ffff) << 5)); }
+static inline uint32_t fldpq_postindex(uint8_t v_dst1, uint8_t v_dst2, uint8_t base, int16_t offset) { return I32(0xacc00000 | (v_dst1 & 31) | ((v_dst2 & 31) << 10) | ((base & 31) << 5) | (((offset / 16) & 0x7f) << 15)); }
+static inline uint32_t fstpq_postindex(uint8_t v_src1, uint8_t v_src2, uint8_t base, int16_t offset) { return I32(0xac800000 | (v_src1 & 31) | ((v_src2 & 31) << 10) | ((base & 31) << 5) | (((offset / 16) & 0x7f) << 15)); }
 
 enum TS { TS_B = 1, TS_H = 2, TS_S = 4, TS_D = 8 };
 static inline uint32_t mov_reg_to_simd(uint8_t v_dst, enum TS ts, uint8_t index, uint8_t rn) { return I32(0x4e001c00 | (ts == TS_B ? ((index & 0xf) << 17) : ts == TS_H ? ((index & 7) << 18) : ts == TS_S ? ((index & 3) << 19) : ts == TS_D ? ((index & 1) << 20) : 0) | ((ts & 31) << 16) | (v_dst & 31) | ((rn & 31) << 5)); }
 static inline uint32_t mov_simd_to_reg(uint8_t rd, uint8_t v_src, enum TS ts, uint8_t index) { return I32((ts == TS_D ? 0x4e003c00 : 0x0e003c00) | (ts == TS_B ? ((index & 0xf) << 17) : ts == TS_H ? ((index & 7) << 18) : ts == TS_S ? ((index & 3) << 19) : ts == TS_D ? ((index & 1) << 20) : 0) | ((ts & 31) << 16) | (rd & 31) | ((v_src & 31) << 5)); }
+static inline uint32_t dup_reg_to_simd(uint8_t v_dst, enum TS ts, uint8_t rn) { return I32(0x4e000c00 | ((ts & 31) << 16) | (v_dst & 31) | ((rn & 31) << 5)); }
 static inline uint32_t fmsr(uint8_t v_dst, uint8_t src) { return mov_reg_to_simd(v_dst, TS_S, 0, src); }
 static inline uint32_t fmdhr(uint8_t v_dst, uint8_t src) { return mov_reg_to_simd(v_dst, TS_S, 1, src); }
 static inline uint32_t fmdlr(uint8_t v_dst, uint8_t src) { return mov_reg_to_simd(v_dst, TS_S, 0, src); }
@@ -586,9 +597,18 @@ static inline uint32_t fcvtzs_Sto32(uint8_t dst, uint8_t v_src) { return fcvtzs(
 static inline uint32_t fcvtzs_Sto64(uint8_t dst, uint8_t v_src) { return fcvtzs(dst, v_src, 1, 0); }
 static inline uint32_t fcvtzs_Dto32(uint8_t dst, uint8_t v_src) { return fcvtzs(dst, v_src, 0, 1); }
 static inline uint32_t fcvtzs_Dto64(uint8_t dst, uint8_t v_src) { return fcvtzs(dst, v_src, 1, 1); }
+static inline uint32_t fcvtns(uint8_t dst, uint8_t v_src, uint8_t sf, uint8_t ftype) { return I32(0x1e200000 | ((sf & 1) << 31) | ((ftype & 3) << 22) | ((v_src & 31) << 5) | (dst & 31)); }
+static inline uint32_t fcvtps(uint8_t dst, uint8_t v_src, uint8_t sf, uint8_t ftype) { return I32(0x1e280000 | ((sf & 1) << 31) | ((ftype & 3) << 22) | ((v_src & 31) << 5) | (dst & 31)); }
+static inline uint32_t fcvtms(uint8_t dst, uint8_t v_src, uint8_t sf, uint8_t ftype) { return I32(0x1e300000 | ((sf & 1) << 31) | ((ftype & 3) << 22) | ((v_src & 31) << 5) | (dst & 31)); }
+static inline uint32_t fcvtns_Dto32(uint8_t dst, uint8_t v_src) { return fcvtns(dst, v_src, 0, 1); }
+static inline uint32_t fcvtps_Dto32(uint8_t dst, uint8_t v_src) { return fcvtps(dst, v_src, 0, 1); }
+static inline uint32_t fcvtms_Dto32(uint8_t dst, uint8_t v_src) { return fcvtms(dst, v_src, 0, 1); }
 
 static inline uint32_t frint64x(uint8_t v_dst, uint8_t v_src) { return I32(0x1e67c000 | (v_dst & 31) | ((v_src & 31) << 5)); }
 static inline uint32_t frint64z(uint8_t v_dst, uint8_t v_src) { return I32(0x1e65c000 | (v_dst & 31) | ((v_src & 31) << 5)); }
+static inline uint32_t frint64n(uint8_t v_dst, uint8_t v_src) { return I32(0x1e644000 | (v_dst & 31) | ((v_src & 31) << 5)); }
+static inline uint32_t frint64p(uint8_t v_dst, uint8_t v_src) { return I32(0x1e64c000 | (v_dst & 31) | ((v_src & 31) << 5)); }
+static inline uint32_t frint64m(uint8_t v_dst, uint8_t v_src) { return I32(0x1e654000 | (v_dst & 31) | ((v_src & 31) << 5)); }
 
 #if 0
 enum VFP_REG { FPSID = 0, FPSCR = 1, FPEXT = 8 };
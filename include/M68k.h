@@ -16,6 +16,7 @@
 #include "nodes.h"
 #include "md5.h"
 #include "lists.h"
+#include "config.h"
 
 struct M68KLocalState {
     void *          mls_M68kPtr;
@@ -24,10 +25,26 @@ struct M68KLocalState {
     int32_t         mls_PCRel;
 };
 
+/* Compact per-unit map from ARM instruction offset to the m68k instruction it belongs to */
+struct M68KPCMap {
+    uint32_t        pm_M68kPC;
+    uint16_t        pm_ARMOffset;
+    int16_t         pm_PCRel;
+};
+
+/* Out-of-line stub replacing a load/store which faulted on bus mapped memory */
+struct BusStub {
+    struct BusStub *    bs_Next;
+    uint32_t *          bs_Site;        /* Patched instruction, writable alias */
+    uint32_t            bs_Code[10];
+    uint32_t            bs_Misses;      /* Consecutive accesses which went to plain RAM */
+};
+
 struct M68KTranslationUnit {
     struct Node     mt_HashNode;
     struct Node     mt_LRUNode;
     uint16_t *      mt_M68kAddress;
+    uint32_t        mt_Key;             /* m68k address, with the S bit in bit 0 if units are mode specific */
     uint16_t *      mt_M68kLow;
     uint16_t *      mt_M68kHigh;
     uint32_t        mt_PrologueSize;
@@ -38,8 +55,13 @@ struct M68KTranslationUnit {
     uint64_t        mt_UseCount;
     uint64_t        mt_FetchCount;
     void *          mt_ARMEntryPoint;
-    struct M68KLocalState *  mt_LocalState;
+    struct M68KPCMap *  mt_PCMap;
+    uint32_t        mt_PCMapSize;
+    uint32_t        mt_PeepholeSaved;
+    uint32_t        mt_FPCRMode;        /* FPCR rounding mode the code depends on, 0xffffffff if none */
     uint32_t        mt_CRC32;
+    struct BusStub *    mt_BusStubs;    /* Out-of-line bus access stubs patched into the code */
+    struct Node     mt_ARMIndexNode;    /* Entry in the index of units by JIT page of their code */
     uint32_t        mt_ARMCode[]
 #ifdef __aarch64__
     __attribute__((aligned(64)));
@@ -103,6 +125,14 @@ struct M68KState
     /* Async IRQ part */
     uint32_t PINT;
     uint32_t IPL0;
+    /*
+        PiStorm: IRQ level decoded by the housekeeper, bits 0-3 hold the level (15 for NMI, so it
+        is above any IPM), bits 8-31 a sequence number incremented on every status register read.
+        IPL_TAKEN is the IPL word for which an interrupt was last taken, the same sample is not
+        acted upon twice.
+    */
+    uint32_t IPL;
+    uint32_t IPL_TAKEN;
     uint64_t INSN_COUNT;
 
     uint32_t JIT_CACHE_MISS;
@@ -111,6 +141,15 @@ struct M68KState
     uint32_t JIT_CACHE_FREE;
     uint32_t JIT_SOFTFLUSH_THRESH;
     uint32_t JIT_CONTROL;
+
+    /* Entry point of last executed unit, used by the dispatcher if x12 holds INSN_COUNT */
+    uint64_t JIT_LAST_ENTRY;
+
+    /* CNTPCT value of last paced read in a chipset polling loop */
+    uint64_t POLL_LAST;
+
+    /* CNTPCT value at which the housekeeper has seen IPL lines asserted */
+    uint64_t IPL_STAMP;
 };
 
 #define JCCB_SOFT   0
@@ -274,9 +313,28 @@ uint32_t *EMIT_GetOffsetPC(uint32_t *ptr, int8_t *offset);
 uint32_t *EMIT_AdvancePC(uint32_t *ptr, uint8_t offset);
 uint32_t *EMIT_FlushPC(uint32_t *ptr);
 uint32_t *EMIT_ResetOffsetPC(uint32_t *ptr);
+uint32_t *EMIT_UpdateInsnCount(uint32_t *ptr, uint32_t count);
 uint32_t *EMIT_LoadFromEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *arm_reg, uint8_t ea, uint16_t *m68k_ptr, uint8_t *ext_words, uint8_t read_only, int32_t *imm_offset);
 uint32_t *EMIT_StoreToEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *arm_reg, uint8_t ea, uint16_t *m68k_ptr, uint8_t *ext_words);
+
+/* Calls out of translated code preserving x0-x18, x30 and NZCV, AArch64 only */
+uint32_t *EMIT_BusSaveContext(uint32_t *ptr, int16_t frame);
+uint32_t *EMIT_BusRestoreContext(uint32_t *ptr, int16_t frame);
+uint32_t *EMIT_BusCall(uint32_t *ptr, void *func);
+
+/* Burst transfers to chip RAM at absolute addresses, PiStorm only. Buffer lives at sp + BUS_BLOCK_BUFFER */
+#define BUS_BLOCK_BUFFER    176
+#define BUS_BLOCK_MAX       64
+#define BUS_BLOCK_FRAME     (BUS_BLOCK_BUFFER + BUS_BLOCK_MAX)
+uint8_t EA_IsChipBurst(uint32_t address, uint32_t length);
+uint32_t *EMIT_BusBlockEnter(uint32_t *ptr);
+uint32_t *EMIT_BusBlockTransfer(uint32_t *ptr, uint32_t address, uint32_t length, uint8_t is_load);
+uint32_t *EMIT_BusBlockLeave(uint32_t *ptr, uint8_t pop);
 uint32_t *EMIT_Exception(uint32_t *ptr, uint16_t exception, uint8_t format, ...);
+void M68K_InitExceptionStubs();
+void M68K_ResetExceptionCalls();
+void M68K_RemapExceptionCalls(uint32_t *code, uint32_t length, uint32_t *map);
+void M68K_RelocateExceptionCalls(uint32_t *old, uint32_t *new, uint32_t length);
 
 uint32_t *EMIT_line0(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed);
 uint32_t *EMIT_line4(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed);
@@ -295,6 +353,10 @@ uint32_t *EMIT_line7(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed
 uint32_t *EMIT_line1(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed);
 uint32_t *EMIT_line2(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed);
 uint32_t *EMIT_line3(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed);
+int EMIT_Fusion(uint32_t **arm_ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed);
+uint32_t *EMIT_Bcc_Host(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr, uint8_t host_condition);
+uint32_t *FPU_FlushFlags(uint32_t *ptr);
+void FPU_ClearPendingFlags();
 
 uint32_t GetSR_Line0(uint16_t opcode);
 uint32_t GetSR_Line1(uint16_t opcode);
@@ -353,6 +415,7 @@ uint16_t *M68K_PopReturnAddress(uint8_t *success);
 void M68K_ResetReturnStack();
 int M68K_GetINSNLength(uint16_t *insn_stream);
 int M68K_IsBranch(uint16_t *insn_stream);
+int M68K_MayTrap(uint16_t *insn_stream);
 
 uint8_t EMIT_TestCondition(uint32_t **pptr, uint8_t m68k_condition);
 uint8_t M68K_GetSRMask(uint16_t *m68k_stream);
@@ -361,6 +424,24 @@ struct M68KTranslationUnit *M68K_GetTranslationUnit(uint16_t *ptr);
 void *M68K_TranslateNoCache(uint16_t *m68kcodeptr);
 struct M68KTranslationUnit *M68K_VerifyUnit(struct M68KTranslationUnit *unit);
 void M68K_DumpStats();
+int M68K_GetPCFromARM(uintptr_t arm_pc, uint32_t *m68k_pc);
+struct M68KTranslationUnit *M68K_GetUnitFromARM(uintptr_t arm_pc);
+void M68K_FreeUnit(struct M68KTranslationUnit *unit);
+
+/* S bit of SR the unit is being translated for, -1 if the code has to work in both modes */
+extern int8_t translation_s;
+/* FPCR rounding mode the unit is being translated for, -1 if unknown. Set translation_fpcr_used when relying on it */
+extern int8_t translation_fpcr_rnd;
+extern uint8_t translation_fpcr_used;
+void M68K_FPCRChanged(void);
+/* Largest range of plain RAM within EMU68_BULK_RAM_LOW..EMU68_BULK_RAM_HIGH, taken from the memory map at boot */
+extern uint32_t bulk_ram_low;
+extern uint32_t bulk_ram_high;
+int M68K_GetKnownValue(uint8_t m68k_reg, uint32_t *value);
+int M68K_GetKnownBase(uint32_t address, uint8_t size, uint8_t *m68k_reg, int32_t *offset);
+#ifdef __aarch64__
+uint32_t A64_Peephole(uint32_t *code, uint32_t length, uint32_t *map);
+#endif
 uint8_t M68K_GetCC(uint32_t **ptr);
 uint8_t M68K_ModifyCC(uint32_t **ptr);
 void M68K_FlushCC(uint32_t **ptr);
@@ -369,16 +450,24 @@ static inline __attribute__((always_inline)) struct M68KTranslationUnit *M68K_Fi
 {
     struct M68KTranslationUnit *unit = NULL, *n;
     uintptr_t hash = (uintptr_t)ptr;
+    uint32_t key = (uint32_t)(uintptr_t)ptr;
     extern struct List *ICache;
     extern struct List LRU;
 
+#if EMU68_MODE_SPECIALIZE && defined(__aarch64__)
+    /* Units are specific to the S bit of SR, see M68K_GetTranslationUnit */
+    uint64_t sr;
+    asm volatile("mrs %0, TPIDR_EL0":"=r"(sr));
+    key |= (sr >> SRB_S) & 1;
+#endif
+
     /* Get 16-bit has from the pointer to m68k code */
     hash = (hash ^ (hash >> 16)) & 0xffff;
 
-    /* Find entry with correct address */
+    /* Find entry with correct key */
     ForeachNode(&ICache[hash], n)
     {
-        if (n->mt_M68kAddress == ptr)
+        if (n->mt_Key == key)
         {
             /* Unit found? Move it to the front of LRU list */
             unit = n;
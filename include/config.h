@@ -33,11 +33,57 @@
 #define EMU68_DEF_BRANCH_AUTO   1
 #define EMU68_DEF_BRANCH_AUTO_RANGE 16
 #define EMU68_INSN_COUNTER      1
+/* AArch64: keep the counter in REG_INSN_COUNT, written back to M68KState by the dispatcher */
+#define EMU68_INSN_COUNTER_REG  1
+/* AArch64: count unit entries only and scale them by mean unit length (needs EMU68_INSN_COUNTER_REG) */
+#define EMU68_INSN_COUNTER_SAMPLED 0
 #define EMU68_MAX_LOOP_COUNT    2
 #define EMU68_BRANCH_INLINE_DISTANCE 128
 #define EMU68_USE_RETURN_STACK  1
 #define EMU68_WEAK_CFLUSH       1
 #define EMU68_WEAK_CFLUSH_LIMIT 500
+#define EMU68_PEEPHOLE          1
+#define EMU68_LOOP_IDIOMS       1
+#define EMU68_KNOWN_VALUES      1
+#define EMU68_SHARED_EXITS      1
+#define EMU68_SHARED_EXCEPTIONS 1
+#define EMU68_MODE_SPECIALIZE   1
+#define EMU68_FPCR_SPECIALIZE   1
+/* AArch64: rewrite loads/stores which fault on bus mapped memory into calls of an out-of-line stub */
+#define EMU68_BUS_PATCHING      1
+/* PiStorm: access chipset registers and chip RAM at absolute addresses with direct calls to the bus accessors */
+#define EMU68_BUS_ROUTING       1
+/* AArch64: short entry path for data aborts with a cache of decoded faulting instructions */
+#define EMU68_FAST_ABORT        1
+/* PiStorm: post writes to chip and slow RAM through a queue drained by a dedicated bus owner core */
+#define EMU68_POSTED_WRITES     1
+/* PiStorm: merge posted byte writes to the same word into one bus cycle (needs EMU68_POSTED_WRITES) */
+#define EMU68_WRITE_COALESCE    1
+/* PiStorm: count bus accesses and time spent in them per address region, see ps_profile.h */
+#define EMU68_BUS_PROFILE       0
+/* PiStorm: pace loops polling a chipset register to at most one bus read per interval */
+#define EMU68_POLL_THROTTLE     1
+#define EMU68_POLL_INTERVAL_NS  1500
+/* PiStorm: run bus code against a software model of GPIO and CPLD, set by the build for virt */
+#ifndef EMU68_PS_MODEL
+#define EMU68_PS_MODEL          0
+#endif
+/* PiStorm: watch IPL and RESET lines with GPIO edge detect IRQs instead of a polling housekeeper */
+#if EMU68_PS_MODEL
+#define EMU68_HOUSEKEEPER_IRQ   0
+#else
+#define EMU68_HOUSEKEEPER_IRQ   1
+#endif
+/* PiStorm: histogram of latency from IPL assertion to m68k vector fetch, printed on exit */
+#define EMU68_IPL_LATENCY       0
+
+/* Range of m68k address space which is plain RAM and can be accessed with bulk NEON copies */
+#ifdef PISTORM
+#define EMU68_BULK_RAM_LOW      0x08000000
+#else
+#define EMU68_BULK_RAM_LOW      0x01000000
+#endif
+#define EMU68_BULK_RAM_HIGH     0xf2000000
 
 #ifndef VERSION_STRING_DATE
 #define VERSION_STRING_DATE ""
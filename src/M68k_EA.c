@@ -9,9 +9,243 @@
 */
 
 #include "support.h"
+#include "config.h"
 #include "M68k.h"
 #include "RegisterAllocator.h"
 
+#ifdef __aarch64__
+/*
+    Save x0-x18, x30 and NZCV in a stack frame of given size. The first 176 bytes of the frame
+    hold the registers, the rest is free for the caller. NZCV goes through x30, which is never
+    allocated, so all allocated registers still hold their values afterwards.
+*/
+uint32_t *EMIT_BusSaveContext(uint32_t *ptr, int16_t frame)
+{
+    *ptr++ = stp64_preindex(31, 0, 1, -frame);
+    for (int i=2; i < 18; i+=2)
+        *ptr++ = stp64(31, i, i + 1, i * 8);
+    *ptr++ = stp64(31, 18, 30, 144);
+    *ptr++ = get_nzcv(30);
+    *ptr++ = str64_offset(31, 30, 160);
+
+    return ptr;
+}
+
+/* Restore registers saved by EMIT_BusSaveContext, frame == 0 leaves the frame on the stack */
+uint32_t *EMIT_BusRestoreContext(uint32_t *ptr, int16_t frame)
+{
+    *ptr++ = ldr64_offset(31, 30, 160);
+    *ptr++ = set_nzcv(30);
+    *ptr++ = ldp64(31, 18, 30, 144);
+    for (int i=2; i < 18; i+=2)
+        *ptr++ = ldp64(31, i, i + 1, i * 8);
+    if (frame)
+        *ptr++ = ldp64_postindex(31, 0, 1, frame);
+    else
+        *ptr++ = ldp64(31, 0, 1, 0);
+
+    return ptr;
+}
+
+/* Call func through x30, arguments are set up by the caller */
+uint32_t *EMIT_BusCall(uint32_t *ptr, void *func)
+{
+    union {
+        uint64_t u64;
+        uint32_t u32[2];
+    } u;
+
+    u.u64 = (uintptr_t)func;
+
+    *ptr++ = ldr64_pcrel(30, 2);
+    *ptr++ = b(3);
+    *ptr++ = u.u32[0];
+    *ptr++ = u.u32[1];
+    *ptr++ = blr(30);
+
+    return ptr;
+}
+#endif
+
+#if defined(PISTORM) && defined(__aarch64__) && EMU68_BUS_ROUTING
+#define EA_BUS_ROUTING 1
+#include "ps_protocol.h"
+
+uint32_t SYSBusRead(uint32_t address, uint32_t size);
+void SYSBusWrite(uint32_t address, uint32_t value, uint32_t size);
+void SYSBusReadBlock(uint32_t address, void *buffer, uint32_t length);
+void SYSBusWriteBlock(uint32_t address, const void *buffer, uint32_t length);
+
+enum BusRegion {
+    BR_PLAIN,       /* Fast RAM, ROM and everything else - plain load/store, MMU decides */
+    BR_CHIP,        /* Chip RAM, subject to ROM overlay */
+    BR_CIA,         /* CIA-A and CIA-B */
+    BR_CUSTOM,      /* Custom chip registers */
+    BR_AUTOCONF,    /* Autoconfig space, emulated boards answer here */
+};
+
+static const struct {
+    uint32_t br_Low;
+    uint32_t br_High;
+    enum BusRegion br_Type;
+} bus_regions[] = {
+    { 0x000000, 0x1fffff, BR_CHIP },
+    { 0xbf0000, 0xbfffff, BR_CIA },
+    { 0xdf0000, 0xdfffff, BR_CUSTOM },
+    { 0xe80000, 0xe8ffff, BR_AUTOCONF },
+};
+
+/*
+    Select the accessor to be called for an absolute address known at translation time. Returns
+    NULL if the address is not bus backed and has to be accessed with plain load/store. CIA and
+    custom registers go straight to the PiStorm protocol, except the CIA-A PRA write which may
+    toggle the ROM overlay. Chip RAM and autoconfig space go through SYSBusRead/SYSBusWrite.
+*/
+static void *GetBusAccessor(uint32_t address, uint8_t size, uint8_t is_load)
+{
+    enum BusRegion type = BR_PLAIN;
+
+    if (size != 1 && size != 2 && size != 4)
+        return NULL;
+
+    for (unsigned i=0; i < sizeof(bus_regions) / sizeof(bus_regions[0]); i++)
+    {
+        if (address >= bus_regions[i].br_Low && address + size - 1 <= bus_regions[i].br_High)
+        {
+            type = bus_regions[i].br_Type;
+            break;
+        }
+    }
+
+    switch (type)
+    {
+        case BR_CIA:
+            if (!is_load && address <= 0xbfe001 && address + size > 0xbfe001)
+                return (void *)SYSBusWrite;
+            /* Fallthrough */
+        case BR_CUSTOM:
+            switch (size)
+            {
+                case 1:
+                    return is_load ? (void *)ps_read_8 : (void *)ps_write_8;
+                case 2:
+                    return is_load ? (void *)ps_read_16 : (void *)ps_write_16;
+                default:
+                    return is_load ? (void *)ps_read_32 : (void *)ps_write_32;
+            }
+        case BR_CHIP:
+        case BR_AUTOCONF:
+            return is_load ? (void *)SYSBusRead : (void *)SYSBusWrite;
+        default:
+            return NULL;
+    }
+}
+
+/*
+    Accessor for (d16, An) with the value of An known at translation time, e.g. after lea $dff000,a6.
+    The address the access goes to is returned in address.
+*/
+static void *GetKnownBusAccessor(uint8_t an, int16_t offset, uint8_t size, uint8_t is_load, uint32_t *address)
+{
+    uint32_t base;
+
+    if (!M68K_GetKnownValue(8 + an, &base))
+        return NULL;
+
+    *address = base + offset;
+
+    return GetBusAccessor(*address, size, is_load);
+}
+
+/*
+    Call bus accessor for absolute address. Arguments are w0 = address, w1 = size for loads and
+    w0 = address, w1 = value, w2 = size for stores, the ps_* functions ignore the size. All
+    caller-saved registers and NZCV are preserved, the loaded value ends up in reg.
+*/
+static uint32_t *EMIT_BusAccess(uint32_t *ptr, void *func, uint32_t address, uint8_t size, uint8_t reg, uint8_t is_load)
+{
+    ptr = EMIT_BusSaveContext(ptr, 176);
+
+    if (is_load)
+    {
+        *ptr++ = mov_immed_u8(1, size);
+    }
+    else
+    {
+        if (reg != 1)
+            *ptr++ = mov_reg(1, reg);
+        *ptr++ = mov_immed_u8(2, size);
+    }
+
+    *ptr++ = movw_immed_u16(0, address & 0xffff);
+    if (address >> 16)
+        *ptr++ = movt_immed_u16(0, address >> 16);
+
+    ptr = EMIT_BusCall(ptr, func);
+
+    if (is_load)
+    {
+        /* Zero extend the result and put it where the register will be restored from */
+        *ptr++ = mov_reg(0, 0);
+        if (reg < 18)
+            *ptr++ = str64_offset(31, 0, 8 * reg);
+        else
+            *ptr++ = mov_reg(reg, 0);
+    }
+
+    ptr = EMIT_BusRestoreContext(ptr, 176);
+
+    return ptr;
+}
+
+uint8_t EA_IsChipBurst(uint32_t address, uint32_t length)
+{
+    return length <= BUS_BLOCK_MAX && address + length <= 0x200000;
+}
+
+/*
+    Burst transfer between chip RAM at an absolute address and the buffer at sp + BUS_BLOCK_BUFFER.
+    EMIT_BusBlockEnter saves the context and reserves the frame, the caller stores the data to be
+    written into the buffer (m68k byte order) before EMIT_BusBlockTransfer. EMIT_BusBlockLeave
+    restores the context; with pop == 0 the frame stays so that loaded data can be fetched from
+    the buffer, the caller removes it with add sp, sp, #BUS_BLOCK_FRAME then.
+*/
+uint32_t *EMIT_BusBlockEnter(uint32_t *ptr)
+{
+    return EMIT_BusSaveContext(ptr, BUS_BLOCK_FRAME);
+}
+
+uint32_t *EMIT_BusBlockTransfer(uint32_t *ptr, uint32_t address, uint32_t length, uint8_t is_load)
+{
+    *ptr++ = movw_immed_u16(0, address & 0xffff);
+    if (address >> 16)
+        *ptr++ = movt_immed_u16(0, address >> 16);
+    *ptr++ = add64_immed(1, 31, BUS_BLOCK_BUFFER);
+    *ptr++ = mov_immed_u16(2, length, 0);
+
+    return EMIT_BusCall(ptr, is_load ? (void *)SYSBusReadBlock : (void *)SYSBusWriteBlock);
+}
+
+uint32_t *EMIT_BusBlockLeave(uint32_t *ptr, uint8_t pop)
+{
+    return EMIT_BusRestoreContext(ptr, pop ? BUS_BLOCK_FRAME : 0);
+}
+#else
+#define EA_BUS_ROUTING 0
+
+uint8_t EA_IsChipBurst(uint32_t address, uint32_t length)
+{
+    (void)address;
+    (void)length;
+
+    return 0;
+}
+
+uint32_t *EMIT_BusBlockEnter(uint32_t *ptr) { return ptr; }
+uint32_t *EMIT_BusBlockTransfer(uint32_t *ptr, uint32_t address, uint32_t length, uint8_t is_load) { (void)address; (void)length; (void)is_load; return ptr; }
+uint32_t *EMIT_BusBlockLeave(uint32_t *ptr, uint8_t pop) { (void)pop; return ptr; }
+#endif
+
 static inline __attribute__((always_inline)) uint32_t * load_s16_ext32(uint32_t *ptr, uint8_t reg, int16_t s16)
 {
 #ifdef __aarch64__
@@ -814,10 +1048,21 @@ uint32_t *EMIT_LoadFromEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *ar
             }
             else
             {
-                uint8_t reg_An = RA_MapM68kRegister(&ptr, src_reg + 8);
                 int16_t off16 = (int16_t)BE16(m68k_ptr[(*ext_words)++]);
+#if EA_BUS_ROUTING
+                void *bus_func;
+                uint32_t address;
 
-                ptr = load_reg_from_addr_offset(ptr, size, reg_An, *arm_reg, off16, 0);
+                if ((bus_func = GetKnownBusAccessor(src_reg, off16, size, 1, &address)) != NULL)
+                {
+                    ptr = EMIT_BusAccess(ptr, bus_func, address, size, *arm_reg, 1);
+                }
+                else
+#endif
+                {
+                    uint8_t reg_An = RA_MapM68kRegister(&ptr, src_reg + 8);
+                    ptr = load_reg_from_addr_offset(ptr, size, reg_An, *arm_reg, off16, 0);
+                }
             }
         }
         else if (mode == 6) /* Mode 006: (d8, An, Xn.SIZE*SCALE) */
@@ -1336,10 +1581,25 @@ uint32_t *EMIT_LoadFromEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *ar
             {
                 uint16_t lo16;
                 lo16 = BE16(m68k_ptr[(*ext_words)++]);
+                uint8_t base_reg;
+                int32_t base_off;
+#if EA_BUS_ROUTING
+                void *bus_func;
+#endif
 
                 if (size == 0) {
                     ptr = load_s16_ext32(ptr, *arm_reg, lo16);
                 }
+#if EA_BUS_ROUTING
+                else if ((bus_func = GetBusAccessor((uint32_t)(int16_t)lo16, size, 1)) != NULL)
+                {
+                    ptr = EMIT_BusAccess(ptr, bus_func, (uint32_t)(int16_t)lo16, size, *arm_reg, 1);
+                }
+#endif
+                else if (M68K_GetKnownBase((int16_t)lo16, size, &base_reg, &base_off))
+                {
+                    ptr = load_reg_from_addr_offset(ptr, size, RA_MapM68kRegister(&ptr, base_reg), *arm_reg, base_off, 0);
+                }
                 else
                 {
                     uint8_t tmp_reg = RA_AllocARMRegister(&ptr);
@@ -1353,6 +1613,11 @@ uint32_t *EMIT_LoadFromEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *ar
                 uint16_t hi16, lo16;
                 hi16 = BE16(m68k_ptr[(*ext_words)++]);
                 lo16 = BE16(m68k_ptr[(*ext_words)++]);
+                uint8_t base_reg;
+                int32_t base_off;
+#if EA_BUS_ROUTING
+                void *bus_func;
+#endif
 
                 if (size == 0) {
 #ifdef __aarch64__
@@ -1376,6 +1641,16 @@ uint32_t *EMIT_LoadFromEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *ar
                         *ptr++ = movt_immed_u16(*arm_reg, hi16);
 #endif
                 }
+#if EA_BUS_ROUTING
+                else if ((bus_func = GetBusAccessor(((uint32_t)hi16 << 16) | lo16, size, 1)) != NULL)
+                {
+                    ptr = EMIT_BusAccess(ptr, bus_func, ((uint32_t)hi16 << 16) | lo16, size, *arm_reg, 1);
+                }
+#endif
+                else if (M68K_GetKnownBase(((uint32_t)hi16 << 16) | lo16, size, &base_reg, &base_off))
+                {
+                    ptr = load_reg_from_addr_offset(ptr, size, RA_MapM68kRegister(&ptr, base_reg), *arm_reg, base_off, 0);
+                }
                 else
                 {
                     uint8_t tmp_reg = RA_AllocARMRegister(&ptr);
@@ -1653,10 +1928,21 @@ uint32_t *EMIT_StoreToEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *arm
         }
         else if (mode == 5) /* Mode 005: (d16, An) */
         {
-            uint8_t reg_An = RA_MapM68kRegister(&ptr, src_reg + 8);
             int16_t off16 = (int16_t)BE16(m68k_ptr[(*ext_words)++]);
+#if EA_BUS_ROUTING
+            void *bus_func;
+            uint32_t address;
 
-            ptr = store_reg_to_addr_offset(ptr, size, reg_An, *arm_reg, off16, 0);
+            if ((bus_func = GetKnownBusAccessor(src_reg, off16, size, 0, &address)) != NULL)
+            {
+                ptr = EMIT_BusAccess(ptr, bus_func, address, size, *arm_reg, 0);
+            }
+            else
+#endif
+            {
+                uint8_t reg_An = RA_MapM68kRegister(&ptr, src_reg + 8);
+                ptr = store_reg_to_addr_offset(ptr, size, reg_An, *arm_reg, off16, 0);
+            }
         }
         else if (mode == 6) /* Mode 006: (d8, An, Xn.SIZE*SCALE) */
         {
@@ -2147,10 +2433,25 @@ uint32_t *EMIT_StoreToEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *arm
             {
                 uint16_t lo16;
                 lo16 = BE16(m68k_ptr[(*ext_words)++]);
+                uint8_t base_reg;
+                int32_t base_off;
+#if EA_BUS_ROUTING
+                void *bus_func;
+#endif
 
                 if (size == 0) {
                     ptr = load_s16_ext32(ptr, *arm_reg, lo16);
                 }
+#if EA_BUS_ROUTING
+                else if ((bus_func = GetBusAccessor((uint32_t)(int16_t)lo16, size, 0)) != NULL)
+                {
+                    ptr = EMIT_BusAccess(ptr, bus_func, (uint32_t)(int16_t)lo16, size, *arm_reg, 0);
+                }
+#endif
+                else if (M68K_GetKnownBase((int16_t)lo16, size, &base_reg, &base_off))
+                {
+                    ptr = store_reg_to_addr_offset(ptr, size, RA_MapM68kRegister(&ptr, base_reg), *arm_reg, base_off, 0);
+                }
                 else
                 {
                     uint8_t tmp_reg = RA_AllocARMRegister(&ptr);
@@ -2164,6 +2465,11 @@ uint32_t *EMIT_StoreToEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *arm
                 uint16_t lo16, hi16;
                 hi16 = BE16(m68k_ptr[(*ext_words)++]);
                 lo16 = BE16(m68k_ptr[(*ext_words)++]);
+                uint8_t base_reg;
+                int32_t base_off;
+#if EA_BUS_ROUTING
+                void *bus_func;
+#endif
 
                 if (size == 0) {
 #ifdef __aarch64__
@@ -2188,6 +2494,16 @@ uint32_t *EMIT_StoreToEffectiveAddress(uint32_t *ptr, uint8_t size, uint8_t *arm
 #endif
                 //    *ptr++ = ldr_offset(REG_PC, *arm_reg, pc_off);
                 }
+#if EA_BUS_ROUTING
+                else if ((bus_func = GetBusAccessor(((uint32_t)hi16 << 16) | lo16, size, 0)) != NULL)
+                {
+                    ptr = EMIT_BusAccess(ptr, bus_func, ((uint32_t)hi16 << 16) | lo16, size, *arm_reg, 0);
+                }
+#endif
+                else if (M68K_GetKnownBase(((uint32_t)hi16 << 16) | lo16, size, &base_reg, &base_off))
+                {
+                    ptr = store_reg_to_addr_offset(ptr, size, RA_MapM68kRegister(&ptr, base_reg), *arm_reg, base_off, 0);
+                }
                 else
                 {
                     uint8_t tmp_reg = RA_AllocARMRegister(&ptr);
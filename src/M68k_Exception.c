@@ -10,12 +10,220 @@
 */
 
 #include "support.h"
+#include "tlsf.h"
 #include "M68k.h"
 #include "RegisterAllocator.h"
+#include "config.h"
+
+#if EMU68_SHARED_EXCEPTIONS && defined(__aarch64__)
+
+/*
+    Shared exception stubs. Building the stack frame inline costs about twenty
+    instructions at every site which may trap, although these paths are hardly
+    ever taken. Instead, the translated code publishes SR, saves LR and calls a
+    small per-vector entry which loads the format/vector word and continues in
+    a common body for the frame format:
+
+        msr     TPIDR_EL0, cc
+        stp     x0, x30, [sp, #-16]!    ; str x30 for format 0
+        mov     w0, #address            ; format 2 only
+        bl      entry[format][vector]
+        ldp     x0, x30, [sp], #16      ; ldr x30 for format 0
+        mrs     cc, TPIDR_EL0
+
+    The body switches to the supervisor stack, pushes the frame, updates SR and
+    loads the new PC. It preserves all registers but A7, REG_PC and SR.
+
+    Stubs live in the JIT area, so that they are in range of bl. The unit is
+    translated in a temporary buffer and copied afterwards, therefore the calls
+    are recorded here and relocated once the final location of the code is known.
+*/
+
+#define EXC_FORMATS     2   /* Formats 0 and 2 */
+#define EXC_VECTORS     256
+
+static uint32_t *exc_stubs;
+static uint32_t *exc_stubs_end;
+static uint32_t *exc_entry[EXC_FORMATS][EXC_VECTORS];
+static uint32_t *exc_calls[EMU68_M68K_INSN_DEPTH];
+static uint32_t exc_call_cnt;
+
+static uint32_t *EMIT_ExceptionBody(uint32_t *ptr, uint8_t format)
+{
+    /* x1 holds format/vector word, x0 address for format 2. Save x3, x1-x2 are saved by the entry */
+    *ptr++ = str64_offset(31, 3, 16);
+    *ptr++ = mrs(2, 3, 3, 13, 0, 2);
+    *ptr++ = mrs(3, 3, 3, 13, 0, 3);
+
+    /* Check if we are changing stack due to user->supervisor transition */
+    *ptr++ = tbnz(2, SRB_S, 6);
+    *ptr++ = str_offset(3, REG_A7, __builtin_offsetof(struct M68KState, USP));
+    *ptr++ = tbnz(2, SRB_M, 3);
+    *ptr++ = ldr_offset(3, REG_A7, __builtin_offsetof(struct M68KState, ISP));
+    *ptr++ = b(2);
+    *ptr++ = ldr_offset(3, REG_A7, __builtin_offsetof(struct M68KState, MSP));
+
+    if (format == 2)
+        *ptr++ = str_offset_preindex(REG_A7, 0, -4);
+
+    *ptr++ = strh_offset_preindex(REG_A7, 1, -2);
+    *ptr++ = str_offset_preindex(REG_A7, REG_PC, -4);
+    *ptr++ = strh_offset_preindex(REG_A7, 2, -2);
+
+    /* Clear trace flags, set supervisor */
+    *ptr++ = bic_immed(2, 2, 2, 32 - SRB_T0);
+    *ptr++ = orr_immed(2, 2, 1, 32 - SRB_S);
+    *ptr++ = msr(2, 3, 3, 13, 0, 2);
+
+    /* Fetch new PC from the vector table */
+    *ptr++ = ldr_offset(3, 3, __builtin_offsetof(struct M68KState, VBR));
+    *ptr++ = and_immed(1, 1, 12, 0);
+    *ptr++ = ldr_regoffset(3, REG_PC, 1, UXTX, 0);
+
+    *ptr++ = ldr64_offset(31, 3, 16);
+    *ptr++ = ldp64_postindex(31, 1, 2, 32);
+    *ptr++ = ret();
+
+    return ptr;
+}
+
+void M68K_InitExceptionStubs()
+{
+    extern void *jit_tlsf;
+    const uint32_t body_size = 32;
+    const uint32_t entry_size = 3;
+    uint32_t size = 4 * (EXC_FORMATS * (body_size + EXC_VECTORS * entry_size));
+    uint32_t *body[EXC_FORMATS];
+    uint32_t *ptr;
+
+    exc_stubs = tlsf_malloc_aligned(jit_tlsf, size, 64);
+    ptr = exc_stubs;
+
+    for (int f=0; f < EXC_FORMATS; f++)
+    {
+        body[f] = ptr;
+        ptr = EMIT_ExceptionBody(ptr, f * 2);
+    }
+
+    for (int f=0; f < EXC_FORMATS; f++)
+    {
+        for (int v=0; v < EXC_VECTORS; v++)
+        {
+            exc_entry[f][v] = ptr;
+            *ptr++ = stp64_preindex(31, 1, 2, -32);
+            *ptr++ = mov_immed_u16(1, ((f * 2) << 12) | (v << 2), 0);
+            *ptr = b(body[f] - ptr);
+            ptr++;
+        }
+    }
+
+    exc_stubs_end = ptr;
+
+    kprintf("[ICache] Exception stubs at %p, %d bytes\n", (void *)exc_stubs, 4 * (exc_stubs_end - exc_stubs));
+
+    arm_flush_cache((uintptr_t)exc_stubs, 4 * (exc_stubs_end - exc_stubs));
+    arm_icache_invalidate((uintptr_t)exc_stubs | 0x0000001000000000, 4 * (exc_stubs_end - exc_stubs));
+}
+
+void M68K_ResetExceptionCalls()
+{
+    exc_call_cnt = 0;
+}
+
+/* Peephole pass has compacted the code, map returns new index for old one */
+void M68K_RemapExceptionCalls(uint32_t *code, uint32_t length, uint32_t *map)
+{
+    for (uint32_t i=0; i < exc_call_cnt; i++)
+    {
+        if (exc_calls[i] >= code && exc_calls[i] < code + length)
+            exc_calls[i] = code + map[exc_calls[i] - code];
+        else
+            exc_calls[i] = NULL;
+    }
+}
+
+/* Code emitted at old was copied to new, fix bl offsets pointing to the stubs */
+void M68K_RelocateExceptionCalls(uint32_t *old, uint32_t *new, uint32_t length)
+{
+    for (uint32_t i=0; i < exc_call_cnt; i++)
+    {
+        /* Skip calls from code which was discarded after emission */
+        if (exc_calls[i] < old || exc_calls[i] >= old + length)
+            continue;
+
+        uint32_t insn = INSN_TO_LE(*exc_calls[i]);
+
+        if ((insn & 0xfc000000) != 0x94000000)
+            continue;
+
+        int32_t offset = (int32_t)(insn << 6) >> 6;
+        uint32_t *target = exc_calls[i] + offset;
+
+        if (target < exc_stubs || target >= exc_stubs_end)
+            continue;
+
+        uint32_t *loc = new + (exc_calls[i] - old);
+        *loc = bl(target - loc);
+    }
+}
+
+static uint32_t *EMIT_ExceptionCall(uint32_t *ptr, uint16_t exception, uint8_t format, uint32_t ea)
+{
+    uint8_t cc = RA_ModifyCC(&ptr);
+
+    RA_SetDirtyM68kRegister(&ptr, 15);
+
+    *ptr++ = msr(cc, 3, 3, 13, 0, 2);
+    if (format == 2)
+    {
+        *ptr++ = stp64_preindex(31, 0, 30, -16);
+        *ptr++ = movw_immed_u16(0, ea & 0xffff);
+        if ((ea >> 16) != 0)
+            *ptr++ = movt_immed_u16(0, ea >> 16);
+    }
+    else
+        *ptr++ = str64_offset_preindex(31, 30, -16);
+    exc_calls[exc_call_cnt++] = ptr;
+    *ptr = bl(exc_entry[format / 2][(exception >> 2) & 0xff] - ptr);
+    ptr++;
+    if (format == 2)
+        *ptr++ = ldp64_postindex(31, 0, 30, 16);
+    else
+        *ptr++ = ldr64_offset_postindex(31, 30, 16);
+    *ptr++ = mrs(cc, 3, 3, 13, 0, 2);
+
+    return ptr;
+}
+
+#else
+
+void M68K_InitExceptionStubs() {}
+void M68K_ResetExceptionCalls() {}
+void M68K_RemapExceptionCalls(uint32_t *code, uint32_t length, uint32_t *map) { (void)code; (void)length; (void)map; }
+void M68K_RelocateExceptionCalls(uint32_t *old, uint32_t *new, uint32_t length) { (void)old; (void)new; (void)length; }
+
+#endif
 
 uint32_t *EMIT_Exception(uint32_t *ptr, uint16_t exception, uint8_t format, ...)
 {
     va_list args;
+
+#if EMU68_SHARED_EXCEPTIONS && defined(__aarch64__)
+    if ((format == 0 || format == 2) && exc_stubs != NULL && exc_call_cnt < EMU68_M68K_INSN_DEPTH)
+    {
+        uint32_t ea = 0;
+
+        if (format == 2)
+        {
+            va_start(args, format);
+            ea = va_arg(args, uint32_t);
+            va_end(args);
+        }
+
+        return EMIT_ExceptionCall(ptr, exception, format, ea);
+    }
+#endif
+
     uint8_t ctx = RA_TryCTX(&ptr); //RA_GetCTX(&ptr);
     uint8_t sp = RA_MapM68kRegister(&ptr, 15);
     uint8_t vbr = RA_AllocARMRegister(&ptr);
@@ -31,19 +239,24 @@ uint32_t *EMIT_Exception(uint32_t *ptr, uint16_t exception, uint8_t format, ...)
 
     RA_SetDirtyM68kRegister(&ptr, 15);
 
-    /* Check if we are changing stack due to user->supervisor transition */
-    *ptr++ = tbnz(cc, SRB_S, 6);
+    /* Stack is switched only on user->supervisor transition, skip it if unit runs in supervisor mode */
+    if (translation_s != 1)
+    {
+        /* Check if we are changing stack due to user->supervisor transition */
+        if (translation_s != 0)
+            *ptr++ = tbnz(cc, SRB_S, 6);
 
-    /* We were in user mode. Store A7 as USP */
-    *ptr++ = str_offset(ctx, sp, __builtin_offsetof(struct M68KState, USP));
+        /* We were in user mode. Store A7 as USP */
+        *ptr++ = str_offset(ctx, sp, __builtin_offsetof(struct M68KState, USP));
 
-    /* Check if we need to load ISP or MSP */
-    *ptr++ = tbnz(cc, SRB_M, 3);
+        /* Check if we need to load ISP or MSP */
+        *ptr++ = tbnz(cc, SRB_M, 3);
 
-    /* Load ISP to A7 */
-    *ptr++ = ldr_offset(ctx, sp, __builtin_offsetof(struct M68KState, ISP));
-    *ptr++ = b(2);
-    *ptr++ = ldr_offset(ctx, sp, __builtin_offsetof(struct M68KState, MSP));
+        /* Load ISP to A7 */
+        *ptr++ = ldr_offset(ctx, sp, __builtin_offsetof(struct M68KState, ISP));
+        *ptr++ = b(2);
+        *ptr++ = ldr_offset(ctx, sp, __builtin_offsetof(struct M68KState, MSP));
+    }
 
     if (format == 2 || format == 3)
     {
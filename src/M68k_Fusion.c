@@ -0,0 +1,596 @@
+/*
+    Copyright © 2019 Michal Schulz <michal.schulz@gmx.de>
+    https://github.com/michalsc
+
+    This Source Code Form is subject to the terms of the
+    Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+    with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "config.h"
+#include "support.h"
+#include "M68k.h"
+#include "RegisterAllocator.h"
+
+/*
+    Macro-op fusion. Before an instruction is dispatched through line_array, the instruction stream
+    is matched against the table below. If a sequence of opcodes matches, the fusion emitter
+    translates the whole sequence at once and sets insn_consumed accordingly. An emitter may decline
+    (returning NULL) as long as it has not emitted anything yet, in that case regular translation
+    takes place.
+*/
+
+#define FUSION_MAX_INSN 3
+
+struct FusionDef {
+    uint16_t        fd_Mask[FUSION_MAX_INSN];
+    uint16_t        fd_Match[FUSION_MAX_INSN];
+    uint8_t         fd_Count;
+    uint32_t *      (*fd_Emit)(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed, const struct FusionDef *def);
+    uint32_t *      (*fd_First)(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed);
+    const uint8_t * fd_CondMap;
+};
+
+#ifdef __aarch64__
+
+/*
+    Mapping of m68k conditions to A64 conditions, valid directly after the first instruction of
+    the fused pair has set the host flags. 0xff means the condition cannot be taken from host flags.
+*/
+
+/* subs based (CMP, SUBQ): host C is inverted borrow */
+static const uint8_t cond_sub[16] = {
+    0xff, 0xff, A64_CC_HI, A64_CC_LS, A64_CC_CS, A64_CC_CC, A64_CC_NE, A64_CC_EQ,
+    A64_CC_VC, A64_CC_VS, A64_CC_PL, A64_CC_MI, A64_CC_GE, A64_CC_LT, A64_CC_GT, A64_CC_LE
+};
+
+/* adds based (ADDQ): host C equals m68k C, but HI/LS differ */
+static const uint8_t cond_add[16] = {
+    0xff, 0xff, 0xff, 0xff, A64_CC_CC, A64_CC_CS, A64_CC_NE, A64_CC_EQ,
+    A64_CC_VC, A64_CC_VS, A64_CC_PL, A64_CC_MI, A64_CC_GE, A64_CC_LT, A64_CC_GT, A64_CC_LE
+};
+
+/* cmn with zero (TST): C and V are clear in both */
+static const uint8_t cond_tst[16] = {
+    0xff, 0xff, A64_CC_NE, A64_CC_EQ, 0xff, 0xff, A64_CC_NE, A64_CC_EQ,
+    A64_CC_VC, A64_CC_VS, A64_CC_PL, A64_CC_MI, A64_CC_GE, A64_CC_LT, A64_CC_GT, A64_CC_LE
+};
+
+/*
+    First instruction sets the host flags and materializes the m68k flags with non flag-altering
+    instructions only, subsequent Bcc branches on host flags and does not need to test CC register.
+*/
+static uint32_t *EMIT_FuseBcc(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed, const struct FusionDef *def)
+{
+    uint16_t *bcc_ptr = *m68k_ptr + M68K_GetINSNLength(*m68k_ptr);
+    uint16_t opcode = BE16(*bcc_ptr);
+    uint8_t condition = def->fd_CondMap[(opcode >> 8) & 15];
+
+    if (condition == 0xff)
+        return NULL;
+
+    ptr = def->fd_First(ptr, m68k_ptr, insn_consumed);
+
+    /* First instruction ended translation or consumed more than expected, leave Bcc alone */
+    if (ptr[-1] == INSN_TO_LE(0xffffffff) || *m68k_ptr != bcc_ptr)
+        return ptr;
+
+    (*m68k_ptr)++;
+    ptr = EMIT_Bcc_Host(ptr, opcode, m68k_ptr, condition);
+    *insn_consumed = 2;
+
+    return ptr;
+}
+
+/*
+    Multi-precision add or subtract on data registers, the low longword first:
+        add.l d1,d3 / addx.l d0,d2                  - 64 bit add
+        sub.l d2,d5 / subx.l d1,d4 / subx.l d0,d3   - 96 bit subtract
+    The host carry chains directly from one part to the next, so X is neither stored nor reloaded
+    between them. The Z flag of the sequence is set only if all parts are zero.
+*/
+static uint32_t *EMIT_FuseAddX(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed, const struct FusionDef *def)
+{
+    uint16_t opcode = BE16((*m68k_ptr)[0]);
+    uint8_t is_sub = (opcode & 0xf000) == 0x9000;
+    uint8_t update_mask = M68K_GetSRMask(*m68k_ptr + def->fd_Count - 1);
+    uint8_t dst[FUSION_MAX_INSN];
+
+    /* All parts of the result have to be alive at the end for the Z flag */
+    for (int i=0; i < def->fd_Count; i++)
+    {
+        dst[i] = (BE16((*m68k_ptr)[i]) >> 9) & 7;
+        for (int j=0; j < i; j++)
+            if (dst[j] == dst[i])
+                return NULL;
+    }
+
+    for (int i=0; i < def->fd_Count; i++)
+    {
+        uint8_t src = RA_MapM68kRegister(&ptr, BE16((*m68k_ptr)[i]) & 7);
+        uint8_t reg = RA_MapM68kRegister(&ptr, dst[i]);
+
+        RA_SetDirtyM68kRegister(&ptr, dst[i]);
+
+        if (i == 0)
+            *ptr++ = is_sub ? subs_reg(reg, reg, src, LSL, 0) : adds_reg(reg, reg, src, LSL, 0);
+        else
+            *ptr++ = is_sub ? sbcs(reg, reg, src) : adcs(reg, reg, src);
+    }
+
+    ptr = EMIT_AdvancePC(ptr, 2 * def->fd_Count);
+    *m68k_ptr += def->fd_Count;
+    *insn_consumed = def->fd_Count;
+
+    if (update_mask)
+    {
+        uint8_t cc = RA_ModifyCC(&ptr);
+
+        ptr = EMIT_ClearFlags(ptr, cc, update_mask);
+        if (update_mask & SR_N)
+            ptr = EMIT_SetFlagsConditional(ptr, cc, SR_N, A64_CC_MI);
+        if (update_mask & SR_V)
+            ptr = EMIT_SetFlagsConditional(ptr, cc, SR_V, A64_CC_VS);
+        if (update_mask & (SR_X | SR_C))
+            ptr = EMIT_SetFlagsConditional(ptr, cc, update_mask & (SR_X | SR_C), is_sub ? A64_CC_CC : A64_CC_CS);
+        if (update_mask & SR_Z) {
+            uint8_t tmp = RA_AllocARMRegister(&ptr);
+
+            *ptr++ = orr_reg(tmp, RA_MapM68kRegister(&ptr, dst[0]), RA_MapM68kRegister(&ptr, dst[1]), LSL, 0);
+            if (def->fd_Count > 2)
+                *ptr++ = orr_reg(tmp, tmp, RA_MapM68kRegister(&ptr, dst[2]), LSL, 0);
+            *ptr++ = cmp_immed(tmp, 0);
+            ptr = EMIT_SetFlagsConditional(ptr, cc, SR_Z, A64_CC_EQ);
+
+            RA_FreeARMRegister(&ptr, tmp);
+        }
+    }
+
+    return ptr;
+}
+
+#if EMU68_LOOP_IDIOMS
+
+/*
+    Emit a guarded block loop. Both ranges have to be within plain RAM (bulk_ram_low..bulk_ram_high,
+    taken from the memory map at boot) and, for copies, destination may not overlap the source ahead
+    of it. Otherwise the loop runs one regular iteration at a time, exactly as if no fusion took place.
+*/
+static uint32_t *EMIT_GuardRange(uint32_t *ptr, uint8_t base, uint8_t len, uint8_t tmp, uint8_t tmp2, uint32_t **slow)
+{
+    *ptr++ = mov_immed_u16(tmp, bulk_ram_low & 0xffff, 0);
+    *ptr++ = movk_immed_u16(tmp, bulk_ram_low >> 16, 1);
+    *ptr++ = cmp_reg(base, tmp, LSL, 0);
+    *slow++ = ptr;
+    *ptr++ = b_cc(A64_CC_CC, 0);
+    *ptr++ = adds_reg(tmp, base, len, LSL, 0);
+    *slow++ = ptr;
+    *ptr++ = b_cc(A64_CC_CS, 0);
+    *ptr++ = mov_immed_u16(tmp2, bulk_ram_high & 0xffff, 0);
+    *ptr++ = movk_immed_u16(tmp2, bulk_ram_high >> 16, 1);
+    *ptr++ = cmp_reg(tmp, tmp2, LSL, 0);
+    *slow++ = ptr;
+    *ptr++ = b_cc(A64_CC_HI, 0);
+
+    return ptr;
+}
+
+/*
+    move.l (Ax)+,(Ay)+ / dbra Dn,*-2   - copy
+    move.l Dm,(Ax)+ / dbra Dn,*-2      - fill
+    clr.l (Ax)+ / dbra Dn,*-2          - clear
+*/
+static uint32_t *EMIT_FuseBlockLoop(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed, const struct FusionDef *def)
+{
+    uint16_t opcode = BE16((*m68k_ptr)[0]);
+    uint16_t opcode2 = BE16((*m68k_ptr)[1]);
+    int16_t disp = BE16((*m68k_ptr)[2]);
+    uint8_t is_copy = (opcode & 0xf1f8) == 0x20d8;
+    uint8_t is_clear = (opcode & 0xfff8) == 0x4298;
+    uint8_t counter = opcode2 & 7;
+    uint8_t update_mask = M68K_GetSRMask(*m68k_ptr);
+    uint32_t *slow[8];
+    uint32_t **slow_ptr = slow;
+    uint32_t *done;
+    uint32_t *skip;
+    uint32_t *loop;
+    uint32_t *expired;
+    uint8_t src = 0xff;
+    uint8_t dst;
+    uint8_t val;
+
+    /* Only the tight loop branching back onto itself */
+    if (disp != -4)
+        return NULL;
+    if (bulk_ram_high <= bulk_ram_low)
+        return NULL;
+    if (is_copy && ((opcode >> 9) & 7) == (opcode & 7))
+        return NULL;
+    if (!is_copy && !is_clear && (opcode & 7) == counter)
+        return NULL;
+
+    ptr = EMIT_FlushPC(ptr);
+
+    /* Load CC and CTX before the paths split, both of them rely on it afterwards */
+    uint8_t cc = RA_ModifyCC(&ptr);
+    uint8_t ctx = RA_GetCTX(&ptr);
+
+    uint8_t cnt_reg = RA_MapM68kRegister(&ptr, counter);
+    uint8_t cnt = RA_AllocARMRegister(&ptr);
+    uint8_t len = RA_AllocARMRegister(&ptr);
+    uint8_t tmp = RA_AllocARMRegister(&ptr);
+    uint8_t tmp2 = RA_AllocARMRegister(&ptr);
+    uint8_t vec = RA_AllocFPURegister(&ptr);
+    uint8_t vec2 = RA_AllocFPURegister(&ptr);
+
+    if (is_copy) {
+        src = RA_MapM68kRegister(&ptr, 8 + (opcode & 7));
+        dst = RA_MapM68kRegister(&ptr, 8 + ((opcode >> 9) & 7));
+        val = tmp2;
+    }
+    else if (is_clear) {
+        dst = RA_MapM68kRegister(&ptr, 8 + (opcode & 7));
+        val = 31;
+    }
+    else {
+        dst = RA_MapM68kRegister(&ptr, 8 + ((opcode >> 9) & 7));
+        val = RA_MapM68kRegister(&ptr, opcode & 7);
+    }
+
+    /* Number of iterations is Dn.w + 1, each one moving a long word */
+    *ptr++ = uxth(cnt, cnt_reg);
+    *ptr++ = add_immed(cnt, cnt, 1);
+    *ptr++ = lsl(len, cnt, 2);
+
+    ptr = EMIT_GuardRange(ptr, dst, len, tmp, tmp2, slow_ptr);
+    slow_ptr += 3;
+    if (is_copy)
+    {
+        ptr = EMIT_GuardRange(ptr, src, len, tmp, tmp2, slow_ptr);
+        slow_ptr += 3;
+
+        /* Forward copy is only wrong if destination lies within the source range ahead of it */
+        *ptr++ = sub_reg(tmp, dst, src, LSL, 0);
+        *ptr++ = cmp_reg(tmp, len, LSL, 0);
+        *slow_ptr++ = ptr;
+        *ptr++ = b_cc(A64_CC_CC, 0);
+    }
+
+    /* Fast path: 32 bytes per iteration with NEON, remaining long words one by one */
+    if (!is_copy)
+        *ptr++ = dup_reg_to_simd(vec, TS_S, val);
+    *ptr++ = lsr(tmp, len, 5);
+    skip = ptr;
+    *ptr++ = cbz(tmp, 0);
+    loop = ptr;
+    if (is_copy)
+        *ptr++ = fldpq_postindex(vec, vec2, src, 32);
+    *ptr++ = fstpq_postindex(vec, is_copy ? vec2 : vec, dst, 32);
+    *ptr++ = subs_immed(tmp, tmp, 1);
+    *ptr = b_cc(A64_CC_NE, loop - ptr);
+    ptr++;
+    *skip = cbz(tmp, ptr - skip);
+
+    *ptr++ = ands_immed(tmp, cnt, 3, 0);
+    skip = ptr;
+    *ptr++ = b_cc(A64_CC_EQ, 0);
+    loop = ptr;
+    if (is_copy)
+        *ptr++ = ldr_offset_postindex(src, val, 4);
+    *ptr++ = str_offset_postindex(dst, val, 4);
+    *ptr++ = subs_immed(tmp, tmp, 1);
+    *ptr = b_cc(A64_CC_NE, loop - ptr);
+    ptr++;
+    *skip = b_cc(A64_CC_EQ, ptr - skip);
+
+    if (update_mask)
+    {
+        if (is_clear)
+        {
+            ptr = EMIT_ClearFlags(ptr, cc, update_mask);
+            if (update_mask & SR_Z)
+                ptr = EMIT_SetFlags(ptr, cc, SR_Z);
+        }
+        else
+        {
+            /* Flags reflect the last long word moved */
+            if (is_copy)
+                *ptr++ = ldur_offset(dst, val, -4);
+            *ptr++ = cmn_reg(31, val, LSL, 0);
+            ptr = EMIT_GetNZ00(ptr, cc, &update_mask);
+
+            if (update_mask & SR_Z)
+                ptr = EMIT_SetFlagsConditional(ptr, cc, SR_Z, ARM_CC_EQ);
+            if (update_mask & SR_N)
+                ptr = EMIT_SetFlagsConditional(ptr, cc, SR_N, ARM_CC_MI);
+        }
+    }
+
+    /* Loop counter ends at -1, PC after dbra */
+    *ptr++ = orr_immed(cnt_reg, cnt_reg, 16, 0);
+    *ptr++ = add_immed(REG_PC, REG_PC, 6);
+    done = ptr;
+    *ptr++ = b(0);
+
+    /* Slow path: regular iterations of the loop, leaving early if an interrupt is pending */
+    while (slow_ptr != slow) {
+        slow_ptr--;
+        **slow_ptr = INSN_TO_LE(INSN_TO_LE(**slow_ptr) | (((ptr - *slow_ptr) & 0x7ffff) << 5));
+    }
+
+    loop = ptr;
+    ptr = def->fd_First(ptr, m68k_ptr, insn_consumed);
+    ptr = EMIT_FlushPC(ptr);
+
+    *ptr++ = uxth(tmp, cnt_reg);
+    *ptr++ = subs_immed(tmp, tmp, 1);
+    *ptr++ = bfi(cnt_reg, tmp, 0, 16);
+    expired = ptr;
+    *ptr++ = b_cc(A64_CC_MI, 0);
+    *ptr++ = sub_immed(REG_PC, REG_PC, 2);
+#ifdef PISTORM
+    *ptr++ = ldr_offset(ctx, tmp, __builtin_offsetof(struct M68KState, IPL));
+    *ptr++ = ubfx(len, cc, SRB_IPL, 3);
+    *ptr++ = and_immed(tmp, tmp, 4, 0);
+    *ptr++ = cmp_reg(tmp, len, LSL, 0);
+    *ptr = b_cc(A64_CC_LS, loop - ptr);
+    ptr++;
+#else
+    *ptr++ = ldr_offset(ctx, tmp, __builtin_offsetof(struct M68KState, PINT));
+    *ptr = cbz(tmp, loop - ptr);
+    ptr++;
+#endif
+    *ptr = b(done - ptr);
+    ptr++;
+    *expired = b_cc(A64_CC_MI, ptr - expired);
+    *ptr++ = add_immed(REG_PC, REG_PC, 4);
+
+    *done = b(ptr - done);
+
+    RA_SetDirtyM68kRegister(&ptr, counter);
+    RA_SetDirtyM68kRegister(&ptr, 8 + (is_copy || !is_clear ? ((opcode >> 9) & 7) : (opcode & 7)));
+    if (is_copy)
+        RA_SetDirtyM68kRegister(&ptr, 8 + (opcode & 7));
+
+    RA_FreeARMRegister(&ptr, cnt);
+    RA_FreeARMRegister(&ptr, len);
+    RA_FreeARMRegister(&ptr, tmp);
+    RA_FreeARMRegister(&ptr, tmp2);
+    RA_FreeFPURegister(&ptr, vec);
+    RA_FreeFPURegister(&ptr, vec2);
+
+    /* Skip the dbra opcode and displacement, translation ends here */
+    *m68k_ptr += 2;
+    *insn_consumed = 2;
+    *ptr++ = INSN_TO_LE(0xfffffff1);
+
+    return ptr;
+}
+
+#endif
+
+#if defined(PISTORM) && EMU68_POLL_THROTTLE
+
+/* CIA-A/B and custom chip registers */
+static int IsChipsetRegister(uint32_t address)
+{
+    return (address >= 0xbf0000 && address < 0xc00000) || (address >= 0xd80000 && address < 0xe00000);
+}
+
+/*
+    Test of a chipset register followed by a conditional branch back onto the test:
+        .wait:  btst #14,$dff002 / bne.s .wait
+                tst.b (a0) / bpl.s .wait
+                cmp.b $dff006,d0 / bne.s .wait
+    Every iteration is a bus read competing with chipset DMA. Reads are paced to at most one per
+    EMU68_POLL_INTERVAL_NS, measured from the previous paced read, so the first test of a wait
+    costs nothing and the loop still leaves as soon as the register changes. For (An) and d16(An)
+    the address is checked at runtime, absolute addresses are checked here.
+*/
+static uint32_t *EMIT_FusePoll(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed, const struct FusionDef *def)
+{
+    uint16_t *start = *m68k_ptr;
+    uint16_t opcode = BE16(start[0]);
+    uint16_t *bcc_ptr = start + M68K_GetINSNLength(start);
+    uint16_t bcc = BE16(*bcc_ptr);
+    uint16_t *ext = start + ((opcode & 0xffc0) == 0x0800 ? 2 : 1);
+    uint8_t mode = (opcode >> 3) & 7;
+    uint8_t an = opcode & 7;
+    int32_t disp = (int8_t)(bcc & 0xff);
+    int16_t d16 = 0;
+    uint32_t *skip = NULL;
+    uint32_t *loop;
+    uint64_t frq;
+    uint32_t ticks;
+
+    /* Bcc only, no BRA/BSR nor 32-bit displacement */
+    if (((bcc >> 8) & 15) < 2 || disp == -1)
+        return NULL;
+    if (disp == 0)
+        disp = (int16_t)BE16(bcc_ptr[1]);
+    if (bcc_ptr + 1 + disp / 2 != start)
+        return NULL;
+
+    if (mode == 7)
+    {
+        uint32_t address;
+
+        if (an == 0)
+            address = (int16_t)BE16(ext[0]);
+        else if (an == 1)
+            address = ((uint32_t)BE16(ext[0]) << 16) | BE16(ext[1]);
+        else
+            return NULL;
+
+        if (!IsChipsetRegister(address))
+            return NULL;
+    }
+    else if (mode == 5)
+        d16 = BE16(ext[0]);
+    else if (mode != 2)
+        return NULL;
+
+    asm volatile("mrs %0, CNTFRQ_EL0":"=r"(frq));
+    ticks = (frq & 0xffffffff) * EMU68_POLL_INTERVAL_NS / 1000000000;
+    if (ticks == 0)
+        ticks = 1;
+    else if (ticks > 4095)
+        ticks = 4095;
+
+    uint8_t ctx = RA_GetCTX(&ptr);
+    uint8_t now = RA_AllocARMRegister(&ptr);
+    uint8_t next = RA_AllocARMRegister(&ptr);
+
+    if (mode != 7)
+    {
+        uint8_t base = RA_MapM68kRegister(&ptr, 8 + an);
+
+        if (d16 != 0)
+        {
+            *ptr++ = movw_immed_u16(next, d16 < 0 ? -d16 : d16);
+            if (d16 < 0)
+                *ptr++ = sub_reg(now, base, next, LSL, 0);
+            else
+                *ptr++ = add_reg(now, base, next, LSL, 0);
+            base = now;
+        }
+
+        *ptr++ = sub_immed_lsl12(next, base, 0xbf0);
+        *ptr++ = cmp_immed_lsl12(next, 0x10);
+        *ptr++ = b_cc(A64_CC_CC, 4);
+        *ptr++ = sub_immed_lsl12(next, base, 0xd80);
+        *ptr++ = cmp_immed_lsl12(next, 0x80);
+        skip = ptr;
+        *ptr++ = b_cc(A64_CC_CS, 0);
+    }
+
+    /* Wait until the interval since last paced read has passed */
+    *ptr++ = mrs(now, 3, 3, 14, 0, 1);
+    *ptr++ = ldr64_offset(ctx, next, __builtin_offsetof(struct M68KState, POLL_LAST));
+    *ptr++ = add64_immed(next, next, ticks);
+    loop = ptr;
+    *ptr++ = cmp64_reg(now, next, LSL, 0);
+    *ptr++ = b_cc(A64_CC_CS, 4);
+    *ptr++ = hint(1);
+    *ptr++ = mrs(now, 3, 3, 14, 0, 1);
+    *ptr = b(loop - ptr);
+    ptr++;
+    *ptr++ = str64_offset(ctx, now, __builtin_offsetof(struct M68KState, POLL_LAST));
+
+    if (skip)
+        *skip = b_cc(A64_CC_CS, ptr - skip);
+
+    RA_FreeARMRegister(&ptr, now);
+    RA_FreeARMRegister(&ptr, next);
+
+    if (def->fd_CondMap && def->fd_CondMap[(bcc >> 8) & 15] != 0xff)
+        return EMIT_FuseBcc(ptr, m68k_ptr, insn_consumed, def);
+
+    return def->fd_First(ptr, m68k_ptr, insn_consumed);
+}
+
+#endif
+
+static const struct FusionDef FusionTable[] = {
+#if EMU68_LOOP_IDIOMS
+    /* MOVE.L (Ax)+,(Ay)+ / MOVE.L Dm,(Ax)+ / CLR.L (Ax)+ ; DBRA Dn */
+    { { 0xf1f8, 0xfff8 }, { 0x20d8, 0x51c8 }, 2, EMIT_FuseBlockLoop, EMIT_move, NULL },
+    { { 0xf1f8, 0xfff8 }, { 0x20c0, 0x51c8 }, 2, EMIT_FuseBlockLoop, EMIT_move, NULL },
+    { { 0xfff8, 0xfff8 }, { 0x4298, 0x51c8 }, 2, EMIT_FuseBlockLoop, EMIT_line4, NULL },
+#endif
+
+#if defined(PISTORM) && EMU68_POLL_THROTTLE
+    /* BTST #imm, <ea> / BTST Dn, <ea> / TST.x <ea> / CMP.x <ea>, Dn ; Bcc back onto itself */
+    { { 0xffc0, 0xf000 }, { 0x0800, 0x6000 }, 2, EMIT_FusePoll, EMIT_line0, NULL },
+    { { 0xf1c0, 0xf000 }, { 0x0100, 0x6000 }, 2, EMIT_FusePoll, EMIT_line0, NULL },
+    { { 0xffc0, 0xf000 }, { 0x4a00, 0x6000 }, 2, EMIT_FusePoll, EMIT_line4, cond_tst },
+    { { 0xffc0, 0xf000 }, { 0x4a40, 0x6000 }, 2, EMIT_FusePoll, EMIT_line4, cond_tst },
+    { { 0xffc0, 0xf000 }, { 0x4a80, 0x6000 }, 2, EMIT_FusePoll, EMIT_line4, cond_tst },
+    { { 0xf1c0, 0xf000 }, { 0xb000, 0x6000 }, 2, EMIT_FusePoll, EMIT_lineB, cond_sub },
+    { { 0xf1c0, 0xf000 }, { 0xb040, 0x6000 }, 2, EMIT_FusePoll, EMIT_lineB, cond_sub },
+    { { 0xf1c0, 0xf000 }, { 0xb080, 0x6000 }, 2, EMIT_FusePoll, EMIT_lineB, cond_sub },
+#endif
+
+    /* CMP.B/W/L <ea>, Dn ; Bcc */
+    { { 0xf1c0, 0xf000 }, { 0xb000, 0x6000 }, 2, EMIT_FuseBcc, EMIT_lineB, cond_sub },
+    { { 0xf1c0, 0xf000 }, { 0xb040, 0x6000 }, 2, EMIT_FuseBcc, EMIT_lineB, cond_sub },
+    { { 0xf1c0, 0xf000 }, { 0xb080, 0x6000 }, 2, EMIT_FuseBcc, EMIT_lineB, cond_sub },
+
+    /* ADD.L Dx, Dy ; ADDX.L Dx, Dy (; ADDX.L Dx, Dy) and the same with SUB/SUBX */
+    { { 0xf1f8, 0xf1f8, 0xf1f8 }, { 0xd080, 0xd180, 0xd180 }, 3, EMIT_FuseAddX, NULL, NULL },
+    { { 0xf1f8, 0xf1f8 }, { 0xd080, 0xd180 }, 2, EMIT_FuseAddX, NULL, NULL },
+    { { 0xf1f8, 0xf1f8, 0xf1f8 }, { 0x9080, 0x9180, 0x9180 }, 3, EMIT_FuseAddX, NULL, NULL },
+    { { 0xf1f8, 0xf1f8 }, { 0x9080, 0x9180 }, 2, EMIT_FuseAddX, NULL, NULL },
+
+    /* TST.B/W/L <ea> ; Bcc */
+    { { 0xffc0, 0xf000 }, { 0x4a00, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line4, cond_tst },
+    { { 0xffc0, 0xf000 }, { 0x4a40, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line4, cond_tst },
+    { { 0xffc0, 0xf000 }, { 0x4a80, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line4, cond_tst },
+
+    /* SUBQ.B/W/L #imm, Dn ; Bcc */
+    { { 0xf1f8, 0xf000 }, { 0x5100, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line5, cond_sub },
+    { { 0xf1f8, 0xf000 }, { 0x5140, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line5, cond_sub },
+    { { 0xf1f8, 0xf000 }, { 0x5180, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line5, cond_sub },
+
+    /* ADDQ.B/W/L #imm, Dn ; Bcc */
+    { { 0xf1f8, 0xf000 }, { 0x5000, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line5, cond_add },
+    { { 0xf1f8, 0xf000 }, { 0x5040, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line5, cond_add },
+    { { 0xf1f8, 0xf000 }, { 0x5080, 0x6000 }, 2, EMIT_FuseBcc, EMIT_line5, cond_add },
+};
+
+int EMIT_Fusion(uint32_t **arm_ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
+{
+    for (unsigned i=0; i < sizeof(FusionTable) / sizeof(FusionTable[0]); i++)
+    {
+        const struct FusionDef *def = &FusionTable[i];
+        uint16_t *stream = *m68k_ptr;
+        int match = 1;
+
+        for (int j=0; j < def->fd_Count; j++)
+        {
+            if ((BE16(*stream) & def->fd_Mask[j]) != def->fd_Match[j])
+            {
+                match = 0;
+                break;
+            }
+            if (j + 1 < def->fd_Count)
+                stream += M68K_GetINSNLength(stream);
+        }
+
+        if (match)
+        {
+            uint32_t *tmpptr;
+
+            /*
+                The translator flushes pending FPSR condition codes only in front of a branch or an
+                instruction which may trap. Here such an instruction can be inside the fused sequence,
+                so flush before anything of it is emitted. The flush stays in place even if the
+                emitter declines.
+            */
+            if (M68K_IsBranch(stream) || M68K_MayTrap(stream))
+                *arm_ptr = FPU_FlushFlags(*arm_ptr);
+
+            tmpptr = def->fd_Emit(*arm_ptr, m68k_ptr, insn_consumed, def);
+            if (tmpptr)
+            {
+                *arm_ptr = tmpptr;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+#else
+
+int EMIT_Fusion(uint32_t **arm_ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
+{
+    (void)arm_ptr;
+    (void)m68k_ptr;
+    (void)insn_consumed;
+
+    return 0;
+}
+
+#endif
@@ -10,6 +10,11 @@
 #include "support.h"
 #include "M68k.h"
 #include "RegisterAllocator.h"
+#include "config.h"
+
+#if defined(PISTORM) && EMU68_BUS_PROFILE
+#include "ps_profile.h"
+#endif
 
 uint32_t *EMIT_MUL_DIV(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr);
 
@@ -982,8 +987,27 @@ static uint32_t *EMIT_MOVEfromSR(uint32_t *ptr, uint16_t opcode, uint16_t **m68k
     uint8_t ext_words = 0;
     uint32_t *tmpptr;
 
+    /* Unit translated for supervisor mode, plain store of SR */
+    if (translation_s == 1)
+    {
+        ptr = EMIT_StoreToEffectiveAddress(ptr, 2, &cc, opcode & 0x3f, *m68k_ptr, &ext_words);
+        ptr = EMIT_AdvancePC(ptr, 2 * (ext_words + 1));
+        (*m68k_ptr) += ext_words;
+
+        return ptr;
+    }
+
     ptr = EMIT_FlushPC(ptr);
 
+    /* Unit translated for user mode, MOVE from SR can only trap */
+    if (translation_s == 0)
+    {
+        ptr = EMIT_Exception(ptr, VECTOR_PRIVILEGE_VIOLATION, 0);
+        *ptr++ = INSN_TO_LE(0xffffffff);
+
+        return ptr;
+    }
+
     /* Test if supervisor mode is active */
     *ptr++ = ands_immed(31, cc, 1, 32 - SRB_S);
     tmpptr = ptr;
@@ -1587,20 +1611,25 @@ static uint32_t *EMIT_STOP(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr,
     *ptr++ = wfi();
 #else
     uint8_t tmpreg = RA_AllocARMRegister(&ptr);
+    uint8_t tmpreg2 = RA_AllocARMRegister(&ptr);
     uint32_t *start, *end;
+
+    /* Wait for a new sample of IRQ level above the new IPM */
     start = ptr;
     *ptr++ = wfe();
-    *ptr++ = ldr_offset(ctx, tmpreg, __builtin_offsetof(struct M68KState, IPL0));
+    *ptr++ = ldr_offset(ctx, tmpreg, __builtin_offsetof(struct M68KState, IPL));
+    *ptr++ = ldr_offset(ctx, tmpreg2, __builtin_offsetof(struct M68KState, IPL_TAKEN));
+    *ptr++ = cmp_reg(tmpreg, tmpreg2, LSL, 0);
     end = ptr;
-    *ptr++ = cbnz(tmpreg, start - end);
-#if 0
-    *ptr++ = mov_immed_u16(tmpreg, 0xf220, 1);
-    *ptr++ = ldr_offset(tmpreg, tmpreg, 0x34);
+    *ptr++ = b_cc(A64_CC_EQ, start - end);
+    *ptr++ = and_immed(tmpreg, tmpreg, 4, 0);
+    *ptr++ = ubfx(tmpreg2, cc, SRB_IPL, 3);
+    *ptr++ = cmp_reg(tmpreg, tmpreg2, LSL, 0);
     end = ptr;
-    *ptr++ = tbnz(tmpreg, 25, start - end);
-#endif 
+    *ptr++ = b_cc(A64_CC_LS, start - end);
 
     RA_FreeARMRegister(&ptr, tmpreg);
+    RA_FreeARMRegister(&ptr, tmpreg2);
 #endif
 
 
@@ -1857,6 +1886,47 @@ static uint32_t *EMIT_RTR(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr, u
     return ptr;
 }
 
+/* Load current value of the m68k instruction counter into reg */
+static uint32_t *EMIT_GetInsnCount(uint32_t *ptr, uint8_t ctx, uint8_t reg)
+{
+#if EMU68_INSN_COUNTER_SAMPLED
+    extern uint32_t insn_count_total;
+    extern uint32_t unit_count_total;
+    uint32_t mean = unit_count_total ? insn_count_total / unit_count_total : 1;
+    uint8_t tmp = RA_AllocARMRegister(&ptr);
+
+    *ptr++ = movw_immed_u16(tmp, mean & 0xffff);
+    if (mean >> 16)
+        *ptr++ = movt_immed_u16(tmp, mean >> 16);
+    *ptr++ = mul64(reg, REG_INSN_COUNT, tmp);
+
+    RA_FreeARMRegister(&ptr, tmp);
+#elif EMU68_INSN_COUNTER_REG
+    *ptr++ = mov64_reg(reg, REG_INSN_COUNT);
+#else
+    *ptr++ = ldr64_offset(ctx, reg, __builtin_offsetof(struct M68KState, INSN_COUNT));
+#endif
+    (void)ctx;
+    *ptr++ = add64_immed(reg, reg, insn_count & 0xfff);
+    if (insn_count & 0xfff000)
+        *ptr++ = add64_immed_lsl12(reg, reg, insn_count >> 12);
+
+    return ptr;
+}
+
+#if defined(PISTORM) && EMU68_BUS_PROFILE && defined(__aarch64__)
+/* Call func(reg) from translated code, all caller-saved registers and NZCV are preserved */
+static uint32_t *EMIT_CallWithArg(uint32_t *ptr, void *func, uint8_t reg)
+{
+    ptr = EMIT_BusSaveContext(ptr, 176);
+    *ptr++ = mov_reg(0, reg);
+    ptr = EMIT_BusCall(ptr, func);
+    ptr = EMIT_BusRestoreContext(ptr, 176);
+
+    return ptr;
+}
+#endif
+
 static uint32_t *EMIT_MOVEC(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr, uint16_t *insn_consumed)
 {
     (void)insn_consumed;
@@ -1874,12 +1944,24 @@ static uint32_t *EMIT_MOVEC(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr,
     (*m68k_ptr) += 1;
     ptr = EMIT_FlushPC(ptr);
 
-    /* Test if supervisor mode is active */
-    *ptr++ = ands_immed(31, cc, 1, 32 - SRB_S);
+    /* Unit translated for user mode, MOVEC can only trap */
+    if (translation_s == 0)
+    {
+        ptr = EMIT_Exception(ptr, VECTOR_PRIVILEGE_VIOLATION, 0);
+        *ptr++ = INSN_TO_LE(0xffffffff);
+        return ptr;
+    }
 
-    /* Branch to exception if not in supervisor */
-    tmpptr = ptr;
-    *ptr++ = b_cc(A64_CC_EQ, 4);
+    tmpptr = NULL;
+    if (translation_s != 1)
+    {
+        /* Test if supervisor mode is active */
+        *ptr++ = ands_immed(31, cc, 1, 32 - SRB_S);
+
+        /* Branch to exception if not in supervisor */
+        tmpptr = ptr;
+        *ptr++ = b_cc(A64_CC_EQ, 4);
+    }
 
     if (dr)
     {
@@ -1935,6 +2017,11 @@ static uint32_t *EMIT_MOVEC(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr,
                 *ptr++ = str_offset(ctx, tmp, __builtin_offsetof(struct M68KState, JIT_CONTROL));
                 RA_FreeARMRegister(&ptr, tmp);
                 break;
+#if defined(PISTORM) && EMU68_BUS_PROFILE
+            case 0x0ed: /* BUSPROF - bus profiler: 0 resets, 1 dumps to log, else copies snapshot to given address */
+                ptr = EMIT_CallWithArg(ptr, (void *)bp_control, reg);
+                break;
+#endif
             case 0x003: // TCR - write bits 15, 14, read all zeros for now
                 tmp = RA_AllocARMRegister(&ptr);
                 *ptr++ = bic_immed(tmp, reg, 30, 16);
@@ -2043,19 +2130,13 @@ static uint32_t *EMIT_MOVEC(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr,
                 break;
             case 0x0e3: /* INSNCNTLO - lower 32 bits of m68k instruction counter */
                 tmp = RA_AllocARMRegister(&ptr);
-                *ptr++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-                *ptr++ = add64_immed(tmp, tmp, insn_count & 0xfff);
-                if (insn_count & 0xfff000)
-                    *ptr++ = add64_immed_lsl12(tmp, tmp, insn_count >> 12);
+                ptr = EMIT_GetInsnCount(ptr, ctx, tmp);
                 *ptr++ = mov_reg(reg, tmp);
                 RA_FreeARMRegister(&ptr, tmp);
                 break;
             case 0x0e4: /* INSNCNTHI - higher 32 bits of m68k instruction counter */
                 tmp = RA_AllocARMRegister(&ptr);
-                *ptr++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-                *ptr++ = add64_immed(tmp, tmp, insn_count & 0xfff);
-                if (insn_count & 0xfff000)
-                    *ptr++ = add64_immed_lsl12(tmp, tmp, insn_count >> 12);
+                ptr = EMIT_GetInsnCount(ptr, ctx, tmp);
                 *ptr++ = lsr64(reg, tmp, 32);
                 RA_FreeARMRegister(&ptr, tmp);
                 break;
@@ -2124,6 +2205,14 @@ static uint32_t *EMIT_MOVEC(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr,
     if (!illegal) {
         *ptr++ = add_immed(REG_PC, REG_PC, 4);
     }
+
+    /* Unit translated for supervisor mode, no check needed */
+    if (tmpptr == NULL)
+    {
+        *ptr++ = INSN_TO_LE(0xffffffff);
+        return ptr;
+    }
+
     *tmpptr = b_cc(A64_CC_EQ, 1 + ptr - tmpptr);
     tmpptr = ptr;
     *ptr++ = b_cc(A64_CC_AL, 0);
@@ -2159,11 +2248,22 @@ static uint32_t *EMIT_MOVEUSP(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_pt
     uint8_t cc = RA_ModifyCC(&ptr);
     uint8_t an = RA_MapM68kRegister(&ptr, 8 + (opcode & 7));
 
-    /* Test if supervisor mode is active */
-    *ptr++ = ands_immed(31, cc, 1, 32 - SRB_S);
+    /* Unit translated for user mode, MOVE USP can only trap */
+    if (translation_s == 0)
+    {
+        ptr = EMIT_Exception(ptr, VECTOR_PRIVILEGE_VIOLATION, 0);
+        *ptr++ = INSN_TO_LE(0xffffffff);
+        return ptr;
+    }
 
-    /* Branch to exception if not in supervisor */
-    *ptr++ = b_cc(A64_CC_EQ, 4);
+    if (translation_s != 1)
+    {
+        /* Test if supervisor mode is active */
+        *ptr++ = ands_immed(31, cc, 1, 32 - SRB_S);
+
+        /* Branch to exception if not in supervisor */
+        *ptr++ = b_cc(A64_CC_EQ, 4);
+    }
     if (opcode & 8)
     {
         *ptr++ = ldr_offset(ctx, an, __builtin_offsetof(struct M68KState, USP));
@@ -2174,6 +2274,14 @@ static uint32_t *EMIT_MOVEUSP(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_pt
         *ptr++ = str_offset(ctx, an, __builtin_offsetof(struct M68KState, USP));
     }
     *ptr++ = add_immed(REG_PC, REG_PC, 2);
+
+    /* Unit translated for supervisor mode, no check needed */
+    if (translation_s == 1)
+    {
+        *ptr++ = INSN_TO_LE(0xffffffff);
+        return ptr;
+    }
+
     tmp = ptr;
     *ptr++ = b_cc(A64_CC_AL, 10);
 
@@ -2381,6 +2489,79 @@ static uint32_t *EMIT_MOVEM(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr,
             block_size += size ? 4:2;
     }
 
+#ifdef __aarch64__
+    /* Absolute address with the whole block in chip RAM - transfer it in one bus burst */
+    if ((opcode & 0x3e) == 0x38)
+    {
+        uint32_t address;
+        uint16_t offset = BUS_BLOCK_BUFFER;
+
+        ext_words = (opcode & 1) ? 2 : 1;
+
+        if (opcode & 1)
+            address = (BE16((*m68k_ptr)[0]) << 16) | BE16((*m68k_ptr)[1]);
+        else
+            address = (int16_t)BE16((*m68k_ptr)[0]);
+
+        if (EA_IsChipBurst(address, block_size))
+        {
+            ptr = EMIT_BusBlockEnter(ptr);
+
+            if (dir == 0)
+            {
+                for (int i=0; i < 16; i++)
+                {
+                    if (mask & (1 << i))
+                    {
+                        uint8_t reg = RA_MapM68kRegister(&ptr, i);
+                        if (size) {
+                            *ptr++ = str_offset(31, reg, offset);
+                            offset += 4;
+                        }
+                        else {
+                            *ptr++ = strh_offset(31, reg, offset);
+                            offset += 2;
+                        }
+                    }
+                }
+
+                ptr = EMIT_BusBlockTransfer(ptr, address, block_size, 0);
+                ptr = EMIT_BusBlockLeave(ptr, 1);
+            }
+            else
+            {
+                ptr = EMIT_BusBlockTransfer(ptr, address, block_size, 1);
+                ptr = EMIT_BusBlockLeave(ptr, 0);
+
+                for (int i=0; i < 16; i++)
+                {
+                    if (mask & (1 << i))
+                    {
+                        uint8_t reg = RA_MapM68kRegisterForWrite(&ptr, i);
+                        if (size) {
+                            *ptr++ = ldr_offset(31, reg, offset);
+                            offset += 4;
+                        }
+                        else {
+                            *ptr++ = ldrsh_offset(31, reg, offset);
+                            offset += 2;
+                        }
+                    }
+                }
+
+                *ptr++ = add64_immed(31, 31, BUS_BLOCK_FRAME);
+            }
+
+            ptr = EMIT_AdvancePC(ptr, 2*(ext_words + 1));
+            (*m68k_ptr) += ext_words;
+
+            return ptr;
+        }
+
+        ext_words = 0;
+    }
+#endif
+
     if (dir == 0)
     {
         uint8_t base = 0xff;
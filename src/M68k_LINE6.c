@@ -130,13 +130,19 @@ uint32_t *EMIT_BRA(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
 
 uint32_t *EMIT_BSR(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr) __attribute__((alias("EMIT_BRA")));
 
-uint32_t *EMIT_Bcc(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
+/*
+    Emit Bcc. If host_condition is not 0xff, the host NZCV flags are expected to hold the result of
+    preceding (fused) instruction and the branch is taken on that A64 condition instead of testing
+    the m68k CC register.
+*/
+uint32_t *EMIT_Bcc_Host(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr, uint8_t host_condition)
 {
         uint32_t *tmpptr;
     uint8_t m68k_condition = (opcode >> 8) & 15;
     uint8_t success_condition = 0;
 
 #ifndef __aarch64__
+    (void)host_condition;
     success_condition = EMIT_TestCondition(&ptr, m68k_condition);
 #endif
 
@@ -243,7 +249,10 @@ uint32_t *EMIT_Bcc(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         RA_FreeARMRegister(&ptr, pc_no);
         pc_no = REG_PC;
     }
-    success_condition = EMIT_TestCondition(&ptr, m68k_condition);
+    if (host_condition != 0xff)
+        success_condition = host_condition;
+    else
+        success_condition = EMIT_TestCondition(&ptr, m68k_condition);
     *ptr++ = csel(REG_PC, pc_yes, pc_no, success_condition);
     RA_FreeARMRegister(&ptr, pc_yes);
     RA_FreeARMRegister(&ptr, pc_no);
@@ -299,6 +308,11 @@ uint32_t *EMIT_Bcc(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
     return ptr;
 }
 
+uint32_t *EMIT_Bcc(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
+{
+    return EMIT_Bcc_Host(ptr, opcode, m68k_ptr, 0xff);
+}
+
 static struct OpcodeDef InsnTable[16] = {
     [0]         = { { EMIT_BRA }, NULL, 0, 0, 0, 0, 0 },
     [1]         = { { EMIT_BSR }, NULL, 0, 0, 0, 0, 0 },
@@ -1570,6 +1570,68 @@ static uint32_t *EMIT_ROXL(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
     return ptr;
 }
 
+/*
+    Bitfields with constant offset and width are accessed with the narrowest load/store which
+    covers them, instead of a 64-bit access. The loaded value is zero extended, so the code can
+    keep working on a 64-bit view of memory with the field at bit offset 64 - 8 * size + offset.
+    Besides being cheaper, this avoids touching bytes beyond the field (chip registers, page ends).
+*/
+static inline uint8_t BF_AccessSize(uint8_t offset, uint8_t width)
+{
+    uint8_t end = offset + width;
+
+    if (end <= 8)
+        return 1;
+    else if (end <= 16)
+        return 2;
+    else if (end <= 32)
+        return 4;
+    else
+        return 8;
+}
+
+static uint32_t *BF_Load(uint32_t *ptr, uint8_t base, uint8_t reg, uint8_t size)
+{
+    switch (size)
+    {
+        case 1:
+            *ptr++ = ldrb_offset(base, reg, 0);
+            break;
+        case 2:
+            *ptr++ = ldrh_offset(base, reg, 0);
+            break;
+        case 4:
+            *ptr++ = ldr_offset(base, reg, 0);
+            break;
+        default:
+            *ptr++ = ldr64_offset(base, reg, 0);
+            break;
+    }
+
+    return ptr;
+}
+
+static uint32_t *BF_Store(uint32_t *ptr, uint8_t base, uint8_t reg, uint8_t size)
+{
+    switch (size)
+    {
+        case 1:
+            *ptr++ = strb_offset(base, reg, 0);
+            break;
+        case 2:
+            *ptr++ = strh_offset(base, reg, 0);
+            break;
+        case 4:
+            *ptr++ = str_offset(base, reg, 0);
+            break;
+        default:
+            *ptr++ = str64_offset(base, reg, 0);
+            break;
+    }
+
+    return ptr;
+}
+
 static uint32_t *EMIT_BFTST(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
 {
     uint8_t update_mask = M68K_GetSRMask(&(*m68k_ptr)[-1]);
@@ -1595,15 +1657,23 @@ static uint32_t *EMIT_BFTST(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
             {
                 uint8_t tmp = RA_AllocARMRegister(&ptr);
 
-                // Get the source, expand to 64 bit to allow rotating
-                *ptr++ = lsl64(tmp, src, 32);
-                *ptr++ = orr64_reg(tmp, tmp, src, LSL, 0);
-
                 // Get width
                 if (width == 0) width = 32;
 
-                // Extract bitfield
-                *ptr++ = sbfx64(tmp, tmp, 64 - (offset + width), width);
+                if (offset + width <= 32)
+                {
+                    // Field does not wrap around, extract it directly
+                    *ptr++ = sbfx(tmp, src, 32 - (offset + width), width);
+                }
+                else
+                {
+                    // Get the source, expand to 64 bit to allow rotating
+                    *ptr++ = lsl64(tmp, src, 32);
+                    *ptr++ = orr64_reg(tmp, tmp, src, LSL, 0);
+
+                    // Extract bitfield
+                    *ptr++ = sbfx64(tmp, tmp, 64 - (offset + width), width);
+                }
                 if (update_mask)
                 {
                     uint8_t cc = RA_ModifyCC(&ptr);
@@ -1747,11 +1817,14 @@ static uint32_t *EMIT_BFTST(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
             if (width == 0)
                 width = 32;
 
-            // No need to precalculate base address here, we are all good if we fetch full 64 bit now
-            *ptr++ = ldr64_offset(base, tmp, 0);
+            uint8_t size = BF_AccessSize(offset, width);
+            uint8_t shift = offset + 64 - 8 * size;
+
+            // Fetch the smallest part of memory containing the bitfield
+            ptr = BF_Load(ptr, base, tmp, size);
 
             // Extract bitfield
-            *ptr++ = sbfx64(tmp, tmp, 64 - offset - width, width);
+            *ptr++ = sbfx64(tmp, tmp, 64 - shift - width, width);
 
             if (update_mask) {
                 uint8_t cc = RA_ModifyCC(&ptr);
@@ -1916,7 +1989,12 @@ static uint32_t *EMIT_BFEXTU(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr
                 If offset == 0 and width == 0 the register value from Dn is already extracted bitfield,
                 otherwise extract bitfield
             */
-            if (offset != 0 || width != 32)
+            if (offset + width <= 32)
+            {
+                // Field does not wrap around, extract it directly
+                *ptr++ = ubfx(dest, src, 32 - (offset + width), width);
+            }
+            else if (offset != 0 || width != 32)
             {
                 uint8_t tmp = RA_AllocARMRegister(&ptr);
 
@@ -2090,11 +2168,14 @@ static uint32_t *EMIT_BFEXTU(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr
             if (width == 0)
                 width = 32;
 
-            // No need to precalculate base address here, we are all good if we fetch full 64 bit now
-            *ptr++ = ldr64_offset(base, tmp, 0);
+            uint8_t size = BF_AccessSize(offset, width);
+            uint8_t shift = offset + 64 - 8 * size;
+
+            // Fetch the smallest part of memory containing the bitfield
+            ptr = BF_Load(ptr, base, tmp, size);
 
             // Extract bitfield
-            *ptr++ = ubfx64(tmp, tmp, 64 - offset - width, width);
+            *ptr++ = ubfx64(tmp, tmp, 64 - shift - width, width);
 
             // Copy to destination
             *ptr++ = mov_reg(dest, tmp);
@@ -2279,20 +2360,28 @@ static uint32_t *EMIT_BFEXTS(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr
             */
             if (offset != 0 || width != 0)
             {
-                uint8_t tmp = RA_AllocARMRegister(&ptr);
-
-                // Get the source, expand to 64 bit to allow rotating
-                *ptr++ = lsl64(tmp, src, 32);
-                *ptr++ = orr64_reg(tmp, tmp, src, LSL, 0);
-
                 // Get width
                 if (width == 0) width = 32;
 
-                // Extract bitfield
-                *ptr++ = sbfx64(tmp, tmp, 64 - (offset + width), width);
-                *ptr++ = mov_reg(dest, tmp);
+                if (offset + width <= 32)
+                {
+                    // Field does not wrap around, extract it directly
+                    *ptr++ = sbfx(dest, src, 32 - (offset + width), width);
+                }
+                else
+                {
+                    uint8_t tmp = RA_AllocARMRegister(&ptr);
 
-                RA_FreeARMRegister(&ptr, tmp);
+                    // Get the source, expand to 64 bit to allow rotating
+                    *ptr++ = lsl64(tmp, src, 32);
+                    *ptr++ = orr64_reg(tmp, tmp, src, LSL, 0);
+
+                    // Extract bitfield
+                    *ptr++ = sbfx64(tmp, tmp, 64 - (offset + width), width);
+                    *ptr++ = mov_reg(dest, tmp);
+
+                    RA_FreeARMRegister(&ptr, tmp);
+                }
             }
             else
             {
@@ -2455,11 +2544,14 @@ static uint32_t *EMIT_BFEXTS(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr
             if (width == 0)
                 width = 32;
 
-            // No need to precalculate base address here, we are all good if we fetch full 64 bit now
-            *ptr++ = ldr64_offset(base, tmp, 0);
+            uint8_t size = BF_AccessSize(offset, width);
+            uint8_t shift = offset + 64 - 8 * size;
+
+            // Fetch the smallest part of memory containing the bitfield
+            ptr = BF_Load(ptr, base, tmp, size);
 
             // Extract bitfield
-            *ptr++ = sbfx64(tmp, tmp, 64 - offset - width, width);
+            *ptr++ = sbfx64(tmp, tmp, 64 - shift - width, width);
 
             // Copy to destination
             *ptr++ = mov_reg(dest, tmp);
@@ -2669,11 +2761,12 @@ static uint32_t *EMIT_BFFFO_reg(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_
         }
         else
         {
+            *ptr++ = clz(dest, src);
+
             if (update_mask)
             {
                 uint8_t cc = RA_ModifyCC(&ptr);
                 *ptr++ = cmn_reg(31, src, LSL, 0);
-                *ptr++ = clz(dest, src);
                 ptr = EMIT_GetNZ00(ptr, cc, &update_mask);
             }
         }
@@ -2846,12 +2939,15 @@ static uint32_t *EMIT_BFFFO(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         if (width == 0)
             width = 32;
 
-        // No need to precalculate base address here, we are all good if we fetch full 64 bit now
-        *ptr++ = ldr64_offset(base, tmp, 0);
+        uint8_t size = BF_AccessSize(offset, width);
+        uint8_t shift = offset + 64 - 8 * size;
+
+        // Fetch the smallest part of memory containing the bitfield
+        ptr = BF_Load(ptr, base, tmp, size);
 
         // If offset != 0, shift left by offset bits
-        if (offset != 0) {
-            *ptr++ = lsl64(tmp, tmp, offset);
+        if (shift != 0) {
+            *ptr++ = lsl64(tmp, tmp, shift);
         }
 
         // Mask the bitfield, update condition codes
@@ -3269,9 +3365,12 @@ static uint32_t *EMIT_BFCHG(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         
         if (width == 0)
             width = 32;
+
+        uint8_t size = BF_AccessSize(offset, width);
+        uint8_t shift = offset + 64 - 8 * size;
         
-        // No need to precalculate base address here, we are all good if we fetch full 64 bit now
-        *ptr++ = ldr64_offset(base, tmp, 0);
+        // Fetch the smallest part of memory containing the bitfield
+        ptr = BF_Load(ptr, base, tmp, size);
 
         // If mask needs to be updated, extract the bitfield
         if (update_mask)
@@ -3280,8 +3379,8 @@ static uint32_t *EMIT_BFCHG(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
             uint8_t testreg = RA_AllocARMRegister(&ptr);
 
             // If offset != 0, shift left by offset bits
-            if (offset != 0) {
-                *ptr++ = lsl64(testreg, tmp, offset);
+            if (shift != 0) {
+                *ptr++ = lsl64(testreg, tmp, shift);
                 *ptr++ = ands64_immed(31, testreg, width, width, 1);
             }
             else {
@@ -3294,10 +3393,10 @@ static uint32_t *EMIT_BFCHG(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         }
 
         // Set entire bitfield to zeros
-        *ptr++ = eor64_immed(tmp, tmp, width, width + offset, 1);
+        *ptr++ = eor64_immed(tmp, tmp, width, width + shift, 1);
 
         // Store back
-        *ptr++ = str64_offset(base, tmp, 0);
+        ptr = BF_Store(ptr, base, tmp, size);
         
         RA_FreeARMRegister(&ptr, tmp);
     }
@@ -3714,9 +3813,12 @@ static uint32_t *EMIT_BFSET(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         
         if (width == 0)
             width = 32;
+
+        uint8_t size = BF_AccessSize(offset, width);
+        uint8_t shift = offset + 64 - 8 * size;
         
-        // No need to precalculate base address here, we are all good if we fetch full 64 bit now
-        *ptr++ = ldr64_offset(base, tmp, 0);
+        // Fetch the smallest part of memory containing the bitfield
+        ptr = BF_Load(ptr, base, tmp, size);
 
         // If mask needs to be updated, extract the bitfield
         if (update_mask)
@@ -3725,8 +3827,8 @@ static uint32_t *EMIT_BFSET(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
             uint8_t testreg = RA_AllocARMRegister(&ptr);
 
             // If offset != 0, shift left by offset bits
-            if (offset != 0) {
-                *ptr++ = lsl64(testreg, tmp, offset);
+            if (shift != 0) {
+                *ptr++ = lsl64(testreg, tmp, shift);
                 *ptr++ = ands64_immed(31, testreg, width, width, 1);
             }
             else {
@@ -3739,10 +3841,10 @@ static uint32_t *EMIT_BFSET(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         }
 
         // Set entire bitfield to ones
-        *ptr++ = orr64_immed(tmp, tmp, width, width + offset, 1);
+        *ptr++ = orr64_immed(tmp, tmp, width, width + shift, 1);
 
         // Store back
-        *ptr++ = str64_offset(base, tmp, 0);
+        ptr = BF_Store(ptr, base, tmp, size);
         
         RA_FreeARMRegister(&ptr, tmp);
     }
@@ -4159,9 +4261,12 @@ static uint32_t *EMIT_BFCLR(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         
         if (width == 0)
             width = 32;
+
+        uint8_t size = BF_AccessSize(offset, width);
+        uint8_t shift = offset + 64 - 8 * size;
         
-        // No need to precalculate base address here, we are all good if we fetch full 64 bit now
-        *ptr++ = ldr64_offset(base, tmp, 0);
+        // Fetch the smallest part of memory containing the bitfield
+        ptr = BF_Load(ptr, base, tmp, size);
 
         // If mask needs to be updated, extract the bitfield
         if (update_mask)
@@ -4170,8 +4275,8 @@ static uint32_t *EMIT_BFCLR(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
             uint8_t testreg = RA_AllocARMRegister(&ptr);
 
             // If offset != 0, shift left by offset bits
-            if (offset != 0) {
-                *ptr++ = lsl64(testreg, tmp, offset);
+            if (shift != 0) {
+                *ptr++ = lsl64(testreg, tmp, shift);
                 *ptr++ = ands64_immed(31, testreg, width, width, 1);
             }
             else {
@@ -4184,10 +4289,10 @@ static uint32_t *EMIT_BFCLR(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         }
 
         // Set entire bitfield to zeros
-        *ptr++ = bic64_immed(tmp, tmp, width, width + offset, 1);
+        *ptr++ = bic64_immed(tmp, tmp, width, width + shift, 1);
 
         // Store back
-        *ptr++ = str64_offset(base, tmp, 0);
+        ptr = BF_Store(ptr, base, tmp, size);
         
         RA_FreeARMRegister(&ptr, tmp);
     }
@@ -4633,9 +4738,12 @@ static uint32_t *EMIT_BFINS(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         
         if (width == 0)
             width = 32;
+
+        uint8_t size = BF_AccessSize(offset, width);
+        uint8_t shift = offset + 64 - 8 * size;
         
-        // No need to precalculate base address here, we are all good if we fetch full 64 bit now
-        *ptr++ = ldr64_offset(base, tmp, 0);
+        // Fetch the smallest part of memory containing the bitfield
+        ptr = BF_Load(ptr, base, tmp, size);
 
         // If mask needs to be updated, extract the bitfield
         if (update_mask)
@@ -4648,10 +4756,10 @@ static uint32_t *EMIT_BFINS(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         }
 
         // Insert source bitfield
-        *ptr++ = bfi64(tmp, src, 64 - (offset + width), width); 
+        *ptr++ = bfi64(tmp, src, 64 - (shift + width), width); 
 
         // Store back
-        *ptr++ = str64_offset(base, tmp, 0);
+        ptr = BF_Store(ptr, base, tmp, size);
         
         RA_FreeARMRegister(&ptr, tmp);
     }
@@ -14,146 +14,7 @@
 #include "lists.h"
 #include "tlsf.h"
 #include "math/libm.h"
-
-enum {
-    C_PI = 0,
-    C_PI_2,
-    C_PI_4,
-    C_1_PI,
-    C_2_PI,
-    C_2_SQRTPI,
-    C_1_2PI,
-    C_SQRT2,
-    C_SQRT1_2,
-    C_0_5,
-    C_1_5,
-    C_LOG10_2 = 0x0b,
-    C_E,
-    C_LOG2E,
-    C_LOG10E,
-    C_ZERO,
-    C_SIN_COEFF = 0x10,  /* 21-poly for sine approximation - error margin within double precision */
-    C_COS_COEFF = 0x20,  /* 20-poly for cosine approximation -error margin within double precision */
-
-    C_SIN_COEFF_SINGLE = 0x1a,
-    C_COS_COEFF_SINGLE = 0x2a,
-
-    C_LN2 = 0x30,
-    C_LN10,
-    C_10P0,
-    C_10P1,
-    C_10P2,
-    C_10P4,
-    C_10P8,
-    C_10P16,
-    C_10P32,
-    C_10P64,
-    C_10P128,
-    C_10P256,
-    C_10P512,
-    C_10P1024,
-    C_10P2048,
-    C_10P4096,
-
-    C_TWO54,
-    C_LN2HI,
-    C_LN2LO,
-    C_LG1,
-    C_LG2,
-    C_LG3,
-    C_LG4,
-    C_LG5,
-    C_LG6,
-    C_LG7
-};
-
-static double const __attribute__((used)) constants[128] = {
-    [C_PI] =        3.14159265358979323846264338327950288, /* Official */
-    [C_PI_2] =      1.57079632679489661923132169163975144,
-    [C_PI_4] =      0.785398163397448309615660845819875721,
-    [C_1_PI] =      0.318309886183790671537767526745028724,
-    [C_2_PI] =      0.636619772367581343075535053490057448,
-    [C_2_SQRTPI] =  1.12837916709551257389615890312154517,
-    [C_1_2PI] =     0.1591549430918953357688837633725143620,
-    [C_SQRT2] =     1.41421356237309504880168872420969808,
-    [C_SQRT1_2] =   0.707106781186547524400844362104849039,
-    [C_0_5] =       0.5,
-    [C_1_5] =       1.5,
-    [C_LOG10_2] =   0.301029995663981195214, /* Official - Log10(2) */
-    [C_E] =         2.71828182845904523536028747135266250,                /* Official */
-    [C_LOG2E] =     1.44269504088896340735992468100189214,            /* Official */
-    [C_LOG10E] =    0.434294481903251827651128918916605082,           /* Official */
-    [C_ZERO] =      0.0,                /* Official */
-
-    /* Polynom coefficients for sin(x*Pi), x=0..0.5*/
-
-    [C_SIN_COEFF] = -2.11100178050346585936E-5,
-                    4.65963708473294521719E-4,
-                    -7.37035513524020578156E-3,
-                    8.21458769726032277098E-2,
-                    -5.99264528627362954518E-1,
-                    2.55016403985097679243,
-                    -5.16771278004952168888,
-                    3.14159265358979102647,
-
-    /* Reduced number of polynom coefficients for sin(x*Pi), x=0..0.5 */
-
-    [C_SIN_COEFF_SINGLE] =
-                    7.74455095806670556524E-2,
-                    -5.98160819620617657839E-1,
-                    2.55005088882843729408,
-                    -5.1677080762924026306,
-                    3.14159259939191476447,
-
-    /* Polynom coefficients for cos(x*Pi), x=0..0.5 */
-
-    [C_COS_COEFF] = 4.15383875943350535407E-6,
-                    -1.04570624685965272291E-4,
-                    1.92955784205552168426E-3,
-                    -2.58068890507489103003E-2,
-                    2.35330630164104256943E-1,
-                    -1.33526276884550367708,
-                    4.05871212641655666324,
-                    -4.93480220054467742126,
-                    9.99999999999999997244E-1,
-
-    /* Reduced number of polynom coefficients for cos(x*Pi), x=0..0.5 */
-    [C_COS_COEFF_SINGLE] =
-                    2.20485796302921884119E-1,
-                    -1.33223541188749370639,
-                    4.058461009872062766402,
-                    -4.93479497666537363458,
-                    9.99999967245121125386E-1,
-
-    [C_LN2] =       0.693147180559945309417232121458176568,              /* Official */
-    [C_LN10] =      2.30258509299404568401799145468436421,             /* Official */
-    [C_10P0] =      1.0,                /* Official */
-    [C_10P1] =      1E1,                /* Official */
-    [C_10P2] =      1E2,                /* Official */
-    [C_10P4] =      1E4,                /* Official */
-    [C_10P8] =      1E8,                /* Official */
-    [C_10P16] =     1E16,               /* Official */
-    [C_10P32] =     1E32,               /* Official */
-    [C_10P64] =     1E64,               /* Official */
-    [C_10P128] =    1E128,              /* Official */
-    [C_10P256] =    1E256,              /* Official */
-    [C_10P512] =    0x1.fffffep+127f,           /* Official 1E512 - too large for double! */
-    [C_10P1024] =   0x1.fffffep+127f,           /* Official 1E1024 - too large for double! */
-    [C_10P2048] =   0x1.fffffep+127f,           /* Official 1E2048 - too large for double! */
-    [C_10P4096] =   0x1.fffffep+127f,           /* Official 1E4096 - too large for double! */
-
-    [C_TWO54] =     1.80143985094819840000e+16,
-    [C_LN2HI] =     6.93147180369123816490e-01,
-    [C_LN2LO] =     1.90821492927058770002e-10,
-
-    [C_LG1] =       6.666666666666735130e-01,
-    [C_LG2] =       3.999999999940941908e-01,
-    [C_LG3] =       2.857142874366239149e-01,
-    [C_LG4] =       2.222219843214978396e-01,
-    [C_LG5] =       1.818357216161805012e-01,
-    [C_LG6] =       1.531383769920937332e-01,
-    [C_LG7] =       1.479819860511658591e-01,
-};
+#include "M68k_PolyKernels.h"
 
 /*
     Returns reminder of absolute double number divided by 2, i.e. for any number it calculates result
@@ -327,6 +188,31 @@ void  __attribute__((used)) stub_PolyCosineSingle(void)
     );
 }
 
+/*
+    Call one of the polynomial kernels above. They preserve all registers except d0, so only
+    x0 (used for the address) and x30 are saved.
+*/
+static uint32_t *FPU_EmitPolyCall(uint32_t *ptr, uint8_t fp_dst, uint8_t fp_src, void (*kernel)(void))
+{
+    union {
+        uint64_t u64;
+        uint32_t u32[2];
+    } u;
+
+    u.u64 = (uintptr_t)kernel;
+
+    *ptr++ = stp64_preindex(31, 0, 30, -16);
+    *ptr++ = fcpyd(0, fp_src);
+    *ptr++ = ldr64_pcrel(0, 3);
+    *ptr++ = blr(0);
+    *ptr++ = b(3);
+    *ptr++ = u.u32[0];
+    *ptr++ = u.u32[1];
+    *ptr++ = fcpyd(fp_dst, 0);
+    *ptr++ = ldp64_postindex(31, 0, 30, 16);
+
+    return ptr;
+}
 
 #else
 
@@ -520,6 +406,81 @@ int FPSR_Update_Needed(uint16_t **m68k_ptr)
     return 0;
 }
 
+/*
+    Conversion of double to 32-bit integer and FINT round according to the FPCR mode the unit is
+    translated for. If the mode is not known, fall back to truncation and the host rounding mode.
+*/
+static uint32_t FPU_ConvertToInt32(uint8_t int_reg, uint8_t fp_reg)
+{
+    if (translation_fpcr_rnd >= 0)
+        translation_fpcr_used = 1;
+
+    switch (translation_fpcr_rnd)
+    {
+        case 0:     /* RN */
+            return fcvtns_Dto32(int_reg, fp_reg);
+        case 2:     /* RM */
+            return fcvtms_Dto32(int_reg, fp_reg);
+        case 3:     /* RP */
+            return fcvtps_Dto32(int_reg, fp_reg);
+        default:    /* RZ */
+            return fcvtzs_Dto32(int_reg, fp_reg);
+    }
+}
+
+static uint32_t FPU_RoundToInt(uint8_t fp_dst, uint8_t fp_src)
+{
+    if (translation_fpcr_rnd >= 0)
+        translation_fpcr_used = 1;
+
+    switch (translation_fpcr_rnd)
+    {
+        case 0:     /* RN */
+            return frint64n(fp_dst, fp_src);
+        case 1:     /* RZ */
+            return frint64z(fp_dst, fp_src);
+        case 2:     /* RM */
+            return frint64m(fp_dst, fp_src);
+        case 3:     /* RP */
+            return frint64p(fp_dst, fp_src);
+        default:
+            return frint64x(fp_dst, fp_src);
+    }
+}
+
+/*
+    FPSR condition codes of general operations are computed lazily. The operation only records the
+    register holding its result, the flags are derived from it once something may observe them: an
+    FPU instruction other than a general operation, a branch or the end of the unit. Another
+    general operation replaces the pending result, so a run of FPU arithmetic sets FPSR only once.
+*/
+static uint8_t fpsr_pending = 0xff;
+
+static inline void FPU_SetFlagsPending(uint8_t fp_reg)
+{
+    fpsr_pending = fp_reg;
+}
+
+void FPU_ClearPendingFlags()
+{
+    fpsr_pending = 0xff;
+}
+
+uint32_t *FPU_FlushFlags(uint32_t *ptr)
+{
+    if (fpsr_pending != 0xff)
+    {
+        uint8_t fpsr = RA_ModifyFPSR(&ptr);
+
+        *ptr++ = fcmpzd(fpsr_pending);
+        ptr = EMIT_GetFPUFlags(ptr, fpsr);
+
+        fpsr_pending = 0xff;
+    }
+
+    return ptr;
+}
+
 /* Allocates FPU register and fetches data according to the R/M field of the FPU opcode */
 uint32_t *FPU_FetchData(uint32_t *ptr, uint16_t **m68k_ptr, uint8_t *reg, uint16_t opcode,
         uint16_t opcode2, uint8_t *ext_count)
@@ -1016,15 +977,14 @@ uint32_t *FPU_StoreData(uint32_t *ptr, uint16_t **m68k_ptr, uint8_t reg, uint16_
 
             case SIZE_L:
                 int_reg = RA_MapM68kRegisterForWrite(&ptr, ea & 7); // Destination for write only, discard contents
-                // No rounding mode specified? Round to zero?
-                *ptr++ = fcvtzs_Dto32(int_reg, reg);
+                *ptr++ = FPU_ConvertToInt32(int_reg, reg);
                 RA_FreeARMRegister(&ptr, int_reg);
                 break;
 
             case SIZE_W:
                 int_reg = RA_MapM68kRegister(&ptr, ea & 7);
                 tmp_reg = RA_AllocARMRegister(&ptr);
-                *ptr++ = fcvtzs_Dto32(tmp_reg, reg);
+                *ptr++ = FPU_ConvertToInt32(tmp_reg, reg);
                 *ptr++ = bfi(int_reg, tmp_reg, 0, 16);
                 RA_SetDirtyM68kRegister(&ptr, ea & 7);
                 RA_FreeARMRegister(&ptr, tmp_reg);
@@ -1034,7 +994,7 @@ uint32_t *FPU_StoreData(uint32_t *ptr, uint16_t **m68k_ptr, uint8_t reg, uint16_
             case SIZE_B:
                 int_reg = RA_MapM68kRegister(&ptr, ea & 7);
                 tmp_reg = RA_AllocARMRegister(&ptr);
-                *ptr++ = fcvtzs_Dto32(tmp_reg, reg);
+                *ptr++ = FPU_ConvertToInt32(tmp_reg, reg);
                 *ptr++ = bfi(int_reg, tmp_reg, 0, 8);
                 RA_SetDirtyM68kRegister(&ptr, ea & 7);
                 RA_FreeARMRegister(&ptr, tmp_reg);
@@ -1205,7 +1165,7 @@ uint32_t *FPU_StoreData(uint32_t *ptr, uint16_t **m68k_ptr, uint8_t reg, uint16_
                 break;
             case SIZE_L:
                 val_reg = RA_AllocARMRegister(&ptr);
-                *ptr++ = fcvtzs_Dto32(val_reg, reg);
+                *ptr++ = FPU_ConvertToInt32(val_reg, reg);
 
                 if (pre_sz)
                 {
@@ -1248,7 +1208,7 @@ uint32_t *FPU_StoreData(uint32_t *ptr, uint16_t **m68k_ptr, uint8_t reg, uint16_
                 break;
             case SIZE_W:
                 val_reg = RA_AllocARMRegister(&ptr);
-                *ptr++ = fcvtzs_Dto32(val_reg, reg);
+                *ptr++ = FPU_ConvertToInt32(val_reg, reg);
 
                 if (pre_sz)
                 {
@@ -1291,7 +1251,7 @@ uint32_t *FPU_StoreData(uint32_t *ptr, uint16_t **m68k_ptr, uint8_t reg, uint16_
                 break;
             case SIZE_B:
                 val_reg = RA_AllocARMRegister(&ptr);
-                *ptr++ = fcvtzs_Dto32(val_reg, reg);
+                *ptr++ = FPU_ConvertToInt32(val_reg, reg);
 
                 if (pre_sz)
                 {
@@ -1625,7 +1585,7 @@ void *invalidate_instruction_cache(uintptr_t target_addr, uint16_t *pc, uint32_t
                     // kprintf("[LINEF] Unit %p, %08x-%08x match! Removing.\n", u, u->mt_M68kLow, u->mt_M68kHigh);
                     REMOVE(&u->mt_LRUNode);
                     REMOVE(&u->mt_HashNode);
-                    tlsf_free(jit_tlsf, u);
+                    M68K_FreeUnit(u);
 
                     __m68k_state->JIT_UNIT_COUNT--;
                     __m68k_state->JIT_CACHE_FREE = tlsf_get_free_size(jit_tlsf);
@@ -1658,7 +1618,7 @@ void *invalidate_instruction_cache(uintptr_t target_addr, uint16_t *pc, uint32_t
                 {
                     REMOVE(&u->mt_LRUNode);
                     REMOVE(&u->mt_HashNode);
-                    tlsf_free(jit_tlsf, u);
+                    M68K_FreeUnit(u);
 
                     __m68k_state->JIT_UNIT_COUNT--;
                     __m68k_state->JIT_CACHE_FREE = tlsf_get_free_size(jit_tlsf);
@@ -1687,7 +1647,7 @@ void *invalidate_instruction_cache(uintptr_t target_addr, uint16_t *pc, uint32_t
                         u = (struct M68KTranslationUnit *)((intptr_t)n - __builtin_offsetof(struct M68KTranslationUnit, mt_LRUNode));
                         // kprintf("[LINEF] Removing unit %p\n", u);                
                         REMOVE(&u->mt_HashNode);
-                        tlsf_free(jit_tlsf, u);
+                        M68K_FreeUnit(u);
                         
                         __m68k_state->JIT_UNIT_COUNT--;
                         __m68k_state->JIT_CACHE_FREE = tlsf_get_free_size(jit_tlsf);
@@ -1700,7 +1660,7 @@ void *invalidate_instruction_cache(uintptr_t target_addr, uint16_t *pc, uint32_t
                     u = (struct M68KTranslationUnit *)((intptr_t)n - __builtin_offsetof(struct M68KTranslationUnit, mt_LRUNode));
                     // kprintf("[LINEF] Removing unit %p\n", u);                
                     REMOVE(&u->mt_HashNode);
-                    tlsf_free(jit_tlsf, u);
+                    M68K_FreeUnit(u);
 
                     __m68k_state->JIT_UNIT_COUNT--;
                     __m68k_state->JIT_CACHE_FREE = tlsf_get_free_size(jit_tlsf);
@@ -1733,6 +1693,10 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
     (*m68k_ptr)++;
     *insn_consumed = 1;
 
+    /* General operations replace the condition codes, anything else may observe them */
+    if ((opcode & 0xffc0) != 0xf200 || (opcode2 & 0xa000) != 0)
+        ptr = FPU_FlushFlags(ptr);
+
     /* FMOVECR reg */
     if (opcode == 0xf200 && (opcode2 & 0xfc00) == 0x5c00)
     {
@@ -1766,6 +1730,8 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
+        FPU_ClearPendingFlags();
+
         if (FPSR_Update_Needed(m68k_ptr))
         {
             uint8_t fpsr = RA_ModifyFPSR(&ptr);
@@ -1812,13 +1778,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FADD */
     else if ((opcode & 0xffc0) == 0xf200 && ((opcode2 & 0xa07f) == 0x0022 || (opcode2 & 0xa07b) == 0x0062))
@@ -1848,13 +1808,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FBcc */
     else if ((opcode & 0xff80) == 0xf280)
@@ -2080,6 +2034,8 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
+        FPU_ClearPendingFlags();
+
         if (FPSR_Update_Needed(m68k_ptr))
         {
             uint8_t fpsr = RA_ModifyFPSR(&ptr);
@@ -2104,13 +2060,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FSGLDIV */
     else if ((opcode & 0xffc0) == 0xf200 && ((opcode2 & 0xa07f) == 0x0024))
@@ -2132,13 +2082,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FSINCOS */
     else if ((opcode & 0xffc0) == 0xf200 && ((opcode2 & 0xa078) == 0x0030))
@@ -2187,13 +2131,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst_sin);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst_sin);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2206,20 +2144,14 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = FPU_FetchData(ptr, m68k_ptr, &fp_src, opcode, opcode2, &ext_count);
         fp_dst = RA_MapFPURegisterForWrite(&ptr, fp_dst);
 
-        *ptr++ = frint64x(fp_dst, fp_src);
+        *ptr++ = FPU_RoundToInt(fp_dst, fp_src);
 
         RA_FreeFPURegister(&ptr, fp_src);
 
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FINTRZ */
     else if ((opcode & 0xffc0) == 0xf200 && (opcode2 & 0xa07f) == 0x0003)
@@ -2242,13 +2174,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FSCALE */
     else if ((opcode & 0xffc0) == 0xf200 && (opcode2 & 0xa07f) == 0x0026)
@@ -2289,13 +2215,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FLOGN */
     else if ((opcode & 0xffc0) == 0xf200 && (opcode2 & 0xa07f) == 0x0014)
@@ -2306,48 +2226,14 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = FPU_FetchData(ptr, m68k_ptr, &fp_src, opcode, opcode2, &ext_count);
         fp_dst = RA_MapFPURegisterForWrite(&ptr, fp_dst);
 
-        *ptr++ = fcpyd(0, fp_src);
-
-        union {
-            uint64_t u64;
-            uint32_t u32[2];
-        } u;
-
-        u.u64 = (uintptr_t)log;
-
-        *ptr++ = stp64_preindex(31, 0, 1, -80);
-        *ptr++ = stp64(31, 2, 3, 16);
-        *ptr++ = stp64(31, 4, 5, 32);
-        *ptr++ = stp64(31, 6, 7, 48);
-        *ptr++ = str64_offset(31, 30, 64);
-
-        *ptr++ = adr(30, 20);
-        *ptr++ = ldr64_pcrel(0, 2);
-        *ptr++ = br(0);
-
-        *ptr++ = u.u32[0];
-        *ptr++ = u.u32[1];
-
-        *ptr++ = fcpyd(fp_dst, 0);
-
-        *ptr++ = ldp64(31, 2, 3, 16);
-        *ptr++ = ldp64(31, 4, 5, 32);
-        *ptr++ = ldp64(31, 6, 7, 48);
-        *ptr++ = ldr64_offset(31, 30, 64);
-        *ptr++ = ldp64_postindex(31, 0, 1, 80);
+        ptr = FPU_EmitPolyCall(ptr, fp_dst, fp_src, PolyLog);
 
         RA_FreeFPURegister(&ptr, fp_src);
 
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2395,13 +2281,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2449,13 +2329,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2468,48 +2342,14 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = FPU_FetchData(ptr, m68k_ptr, &fp_src, opcode, opcode2, &ext_count);
         fp_dst = RA_MapFPURegisterForWrite(&ptr, fp_dst);
 
-        *ptr++ = fcpyd(0, fp_src);
-
-        union {
-            uint64_t u64;
-            uint32_t u32[2];
-        } u;
-
-        u.u64 = (uintptr_t)log2;
-
-        *ptr++ = stp64_preindex(31, 0, 1, -80);
-        *ptr++ = stp64(31, 2, 3, 16);
-        *ptr++ = stp64(31, 4, 5, 32);
-        *ptr++ = stp64(31, 6, 7, 48);
-        *ptr++ = str64_offset(31, 30, 64);
-
-        *ptr++ = adr(30, 20);
-        *ptr++ = ldr64_pcrel(0, 2);
-        *ptr++ = br(0);
-
-        *ptr++ = u.u32[0];
-        *ptr++ = u.u32[1];
-
-        *ptr++ = fcpyd(fp_dst, 0);
-
-        *ptr++ = ldp64(31, 2, 3, 16);
-        *ptr++ = ldp64(31, 4, 5, 32);
-        *ptr++ = ldp64(31, 6, 7, 48);
-        *ptr++ = ldr64_offset(31, 30, 64);
-        *ptr++ = ldp64_postindex(31, 0, 1, 80);
+        ptr = FPU_EmitPolyCall(ptr, fp_dst, fp_src, PolyLog2);
 
         RA_FreeFPURegister(&ptr, fp_src);
 
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2522,48 +2362,14 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = FPU_FetchData(ptr, m68k_ptr, &fp_src, opcode, opcode2, &ext_count);
         fp_dst = RA_MapFPURegisterForWrite(&ptr, fp_dst);
 
-        *ptr++ = fcpyd(0, fp_src);
-
-        union {
-            uint64_t u64;
-            uint32_t u32[2];
-        } u;
-
-        u.u64 = (uintptr_t)exp;
-
-        *ptr++ = stp64_preindex(31, 0, 1, -80);
-        *ptr++ = stp64(31, 2, 3, 16);
-        *ptr++ = stp64(31, 4, 5, 32);
-        *ptr++ = stp64(31, 6, 7, 48);
-        *ptr++ = str64_offset(31, 30, 64);
-
-        *ptr++ = adr(30, 20);
-        *ptr++ = ldr64_pcrel(0, 2);
-        *ptr++ = br(0);
-
-        *ptr++ = u.u32[0];
-        *ptr++ = u.u32[1];
-
-        *ptr++ = fcpyd(fp_dst, 0);
-
-        *ptr++ = ldp64(31, 2, 3, 16);
-        *ptr++ = ldp64(31, 4, 5, 32);
-        *ptr++ = ldp64(31, 6, 7, 48);
-        *ptr++ = ldr64_offset(31, 30, 64);
-        *ptr++ = ldp64_postindex(31, 0, 1, 80);
+        ptr = FPU_EmitPolyCall(ptr, fp_dst, fp_src, PolyExp);
 
         RA_FreeFPURegister(&ptr, fp_src);
 
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2611,13 +2417,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2665,13 +2465,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2719,13 +2513,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2773,13 +2561,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2827,13 +2609,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2881,13 +2657,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2935,13 +2705,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -2989,13 +2753,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -3043,13 +2801,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -3097,13 +2849,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -3116,48 +2862,14 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = FPU_FetchData(ptr, m68k_ptr, &fp_src, opcode, opcode2, &ext_count);
         fp_dst = RA_MapFPURegisterForWrite(&ptr, fp_dst);
 
-        *ptr++ = fcpyd(0, fp_src);
-
-        union {
-            uint64_t u64;
-            uint32_t u32[2];
-        } u;
-
-        u.u64 = (uintptr_t)exp2;
-
-        *ptr++ = stp64_preindex(31, 0, 1, -80);
-        *ptr++ = stp64(31, 2, 3, 16);
-        *ptr++ = stp64(31, 4, 5, 32);
-        *ptr++ = stp64(31, 6, 7, 48);
-        *ptr++ = str64_offset(31, 30, 64);
-
-        *ptr++ = adr(30, 20);
-        *ptr++ = ldr64_pcrel(0, 2);
-        *ptr++ = br(0);
-
-        *ptr++ = u.u32[0];
-        *ptr++ = u.u32[1];
-
-        *ptr++ = fcpyd(fp_dst, 0);
-
-        *ptr++ = ldp64(31, 2, 3, 16);
-        *ptr++ = ldp64(31, 4, 5, 32);
-        *ptr++ = ldp64(31, 6, 7, 48);
-        *ptr++ = ldr64_offset(31, 30, 64);
-        *ptr++ = ldp64_postindex(31, 0, 1, 80);
+        ptr = FPU_EmitPolyCall(ptr, fp_dst, fp_src, PolyTwoToX);
 
         RA_FreeFPURegister(&ptr, fp_src);
 
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -3201,13 +2913,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FMOVE to MEM */
     else if ((opcode & 0xffc0) == 0xf200 && (opcode2 & 0xe07f) == 0x6000)
@@ -3269,6 +2975,14 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
             case 0x1000:    /* FPCR */
                 tmp = RA_AllocARMRegister(&ptr);
                 reg = RA_ModifyFPCR(&ptr);
+#if EMU68_FPCR_SPECIALIZE && defined(__aarch64__)
+                /* Rounding mode changed? Store new FPCR and let the translator drop units made for the old one */
+                *ptr++ = eor_reg(tmp, reg, src, LSL, 0);
+                *ptr++ = tst_immed(tmp, 2, 28);
+                *ptr++ = b_cc(A64_CC_EQ, 3);
+                *ptr++ = strh_offset(reg_CTX, src, __builtin_offsetof(struct M68KState, FPCR));
+                *ptr++ = svc(0x103);
+#endif
                 *ptr++ = mov_reg(reg, src);
 #ifndef __aarch64__
                 *ptr++ = fmxr(tmp, FPSCR);
@@ -3293,6 +3007,12 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
 
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
+
+#if EMU68_FPCR_SPECIALIZE && defined(__aarch64__)
+        /* Code following FPCR update has to be translated for the new rounding mode */
+        if ((opcode2 & 0x1c00) == 0x1000)
+            *ptr++ = INSN_TO_LE(0xffffffff);
+#endif
     }
     /* FMOVEM */
     else if ((opcode & 0xffc0) == 0xf200 && (opcode2 & 0xc700) == 0xc000)
@@ -3428,13 +3148,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FSGLMUL */
     else if ((opcode & 0xffc0) == 0xf200 && ((opcode2 & 0xa07f) == 0x0027))
@@ -3466,13 +3180,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FNEG */
     else if ((opcode & 0xffc0) == 0xf200 && ((opcode2 & 0xa07f) == 0x001a || (opcode2 & 0xa07b) == 0x005a))
@@ -3500,13 +3208,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FTST */
     else if ((opcode & 0xffc0) == 0xf200 && (opcode2 & 0xa07f) == 0x003a)
@@ -3522,6 +3224,8 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
+        FPU_ClearPendingFlags();
+
         if (FPSR_Update_Needed(m68k_ptr))
         {
             uint8_t fpsr = RA_ModifyFPSR(&ptr);
@@ -3804,13 +3508,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FSUB */
     else if ((opcode & 0xffc0) == 0xf200 && ((opcode2 & 0xa07f) == 0x0028 || (opcode2 & 0xa07b) == 0x0068))
@@ -3840,13 +3538,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
     }
     /* FSIN */
     else if ((opcode & 0xffc0) == 0xf200 && (opcode2 & 0xa07f) == 0x000e)
@@ -4089,13 +3781,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
     }
@@ -4324,13 +4010,7 @@ uint32_t *EMIT_FPU(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
         ptr = EMIT_AdvancePC(ptr, 2 * (ext_count + 1));
         (*m68k_ptr) += ext_count;
 
-        if (FPSR_Update_Needed(m68k_ptr))
-        {
-            uint8_t fpsr = RA_ModifyFPSR(&ptr);
-
-            *ptr++ = fcmpzd(fp_dst);
-            ptr = EMIT_GetFPUFlags(ptr, fpsr);
-        }
+        FPU_SetFlagsPending(fp_dst);
 
         *ptr++ = INSN_TO_LE(0xfffffff0);
 
@@ -4473,20 +4153,45 @@ uint32_t *EMIT_lineF(uint32_t *ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed
 
         /* Align memory pointer */
         mem &= 0xfffffff0;
-        *ptr++ = movw_immed_u16(aligned_mem, mem & 0xffff);
-        if (mem & 0xffff0000)
-            *ptr++ = movt_immed_u16(aligned_mem, mem >> 16);
 #ifdef __aarch64__
         *ptr++ = bic_immed(aligned_reg, reg, 4, 0);
-        if (opcode & 8) {
-            *ptr++ = ldp64(aligned_mem, buf1, buf2, 0);
-            *ptr++ = stp64(aligned_reg, buf1, buf2, 0);
+        /* Line in chip RAM - move it over the bus in one burst */
+        if (EA_IsChipBurst(mem, 16))
+        {
+            if (opcode & 8) {
+                ptr = EMIT_BusBlockEnter(ptr);
+                ptr = EMIT_BusBlockTransfer(ptr, mem, 16, 1);
+                ptr = EMIT_BusBlockLeave(ptr, 0);
+                *ptr++ = ldp64(31, buf1, buf2, BUS_BLOCK_BUFFER);
+                *ptr++ = add64_immed(31, 31, BUS_BLOCK_FRAME);
+                *ptr++ = stp64(aligned_reg, buf1, buf2, 0);
+            }
+            else {
+                *ptr++ = ldp64(aligned_reg, buf1, buf2, 0);
+                ptr = EMIT_BusBlockEnter(ptr);
+                *ptr++ = stp64(31, buf1, buf2, BUS_BLOCK_BUFFER);
+                ptr = EMIT_BusBlockTransfer(ptr, mem, 16, 0);
+                ptr = EMIT_BusBlockLeave(ptr, 1);
+            }
         }
-        else {
-            *ptr++ = ldp64(aligned_reg, buf1, buf2, 0);
-            *ptr++ = stp64(aligned_mem, buf1, buf2, 0);
+        else
+        {
+            *ptr++ = movw_immed_u16(aligned_mem, mem & 0xffff);
+            if (mem & 0xffff0000)
+                *ptr++ = movt_immed_u16(aligned_mem, mem >> 16);
+            if (opcode & 8) {
+                *ptr++ = ldp64(aligned_mem, buf1, buf2, 0);
+                *ptr++ = stp64(aligned_reg, buf1, buf2, 0);
+            }
+            else {
+                *ptr++ = ldp64(aligned_reg, buf1, buf2, 0);
+                *ptr++ = stp64(aligned_mem, buf1, buf2, 0);
+            }
         }
 #else
+        *ptr++ = movw_immed_u16(aligned_mem, mem & 0xffff);
+        if (mem & 0xffff0000)
+            *ptr++ = movt_immed_u16(aligned_mem, mem >> 16);
         *ptr++ = bic_immed(aligned_reg, reg, 0x0f);
         if (opcode & 8) {
             *ptr++ = ldm(aligned_mem, (1 << buf1) | (1 << buf2) | (1 << buf3) | (1 << buf4));
@@ -114,6 +114,72 @@ struct Result64 sldiv(int64_t n, int64_t d)
 }
 #endif
 
+#ifdef __aarch64__
+/*
+    Divide 32-bit value by a known, non-zero constant. The quotient is the upper half of the
+    64-bit product n * ceil(2^64 / d), which is exact for every 32-bit n and 1 < d < 2^32.
+    Signed division is done on absolute values and the sign of the quotient is fixed afterwards,
+    which gives the same round-towards-zero result as sdiv. Condition flags are clobbered.
+*/
+static uint32_t *EMIT_DivByConst(uint32_t *ptr, uint8_t reg_quot, uint8_t reg_n, uint32_t d, uint8_t sig)
+{
+    uint32_t abs_d = (sig && (int32_t)d < 0) ? -d : d;
+    uint8_t tmp = RA_AllocARMRegister(&ptr);
+    uint8_t reg_m = 0xff;
+
+    if (abs_d & (abs_d - 1))
+    {
+        uint64_t m = UINT64_MAX / abs_d + 1;
+        int first = 1;
+
+        reg_m = RA_AllocARMRegister(&ptr);
+
+        for (int i = 0; i < 4; i++)
+        {
+            uint16_t chunk = m >> (16 * i);
+
+            if (chunk)
+            {
+                if (first)
+                    *ptr++ = mov64_immed_u16(reg_m, chunk, i);
+                else
+                    *ptr++ = movk64_immed_u16(reg_m, chunk, i);
+                first = 0;
+            }
+        }
+    }
+
+    /* Get the dividend as 64-bit unsigned value, for signed division take its absolute value */
+    if (sig)
+    {
+        *ptr++ = cmp_immed(reg_n, 0);
+        *ptr++ = sxtw64(tmp, reg_n);
+        *ptr++ = cneg64(tmp, tmp, A64_CC_MI);
+    }
+    else
+    {
+        *ptr++ = mov_reg(tmp, reg_n);
+    }
+
+    if (abs_d == 1)
+        *ptr++ = mov_reg(reg_quot, tmp);
+    else if (reg_m == 0xff)
+        *ptr++ = lsr64(reg_quot, tmp, __builtin_ctz(abs_d));
+    else
+        *ptr++ = umulh(reg_quot, tmp, reg_m);
+
+    /* Quotient is negative if signs of dividend and divisor differ. Flags still reflect the dividend */
+    if (sig)
+        *ptr++ = cneg(reg_quot, reg_quot, (int32_t)d < 0 ? A64_CC_PL : A64_CC_MI);
+
+    if (reg_m != 0xff)
+        RA_FreeARMRegister(&ptr, reg_m);
+    RA_FreeARMRegister(&ptr, tmp);
+
+    return ptr;
+}
+#endif
+
 uint32_t *EMIT_MULS_W(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
 {
     uint8_t update_mask = M68K_GetSRMask(*m68k_ptr - 1);
@@ -328,58 +394,53 @@ uint32_t *EMIT_DIVS_W(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
     uint8_t reg_quot = RA_AllocARMRegister(&ptr);
     uint8_t reg_rem = RA_AllocARMRegister(&ptr);
     uint8_t ext_words = 0;
+    uint8_t const_div = 0;
+    int16_t divisor = 0;
+
+    /* Division by a non-zero immediate needs neither zero check nor divide instruction */
+    if ((opcode & 0x3f) == 0x3c)
+    {
+        divisor = BE16((*m68k_ptr)[0]);
+        const_div = divisor != 0;
+    }
 
     ptr = EMIT_LoadFromEffectiveAddress(ptr, 2, &reg_q, opcode & 0x3f, *m68k_ptr, &ext_words, 0, NULL);
     ptr = EMIT_FlushPC(ptr);
     RA_GetCC(&ptr);
 
 #ifdef __aarch64__
-    *ptr++ = ands_immed(31, reg_q, 16, 0);
-    uint32_t *tmp_ptr = ptr;
-    *ptr++ = b_cc(A64_CC_NE, 2);
-
-    if (1)
+    if (!const_div)
     {
-        /*
-            This is a point of no return. Issue division by zero exception here
-        */
-        *ptr++ = add_immed(REG_PC, REG_PC, 2 * (ext_words + 1));
+        *ptr++ = ands_immed(31, reg_q, 16, 0);
+        uint32_t *tmp_ptr = ptr;
+        *ptr++ = b_cc(A64_CC_NE, 2);
+
+        if (1)
+        {
+            /*
+                This is a point of no return. Issue division by zero exception here
+            */
+            *ptr++ = add_immed(REG_PC, REG_PC, 2 * (ext_words + 1));
 
-        ptr = EMIT_Exception(ptr, VECTOR_DIVIDE_BY_ZERO, 2, (uint32_t)(intptr_t)(*m68k_ptr - 1));
+            ptr = EMIT_Exception(ptr, VECTOR_DIVIDE_BY_ZERO, 2, (uint32_t)(intptr_t)(*m68k_ptr - 1));
 
-        RA_StoreDirtyFPURegs(&ptr);
-        RA_StoreDirtyM68kRegs(&ptr);
+            RA_StoreDirtyFPURegs(&ptr);
+            RA_StoreDirtyM68kRegs(&ptr);
 
-        RA_StoreCC(&ptr);
-        RA_StoreFPCR(&ptr);
-        RA_StoreFPSR(&ptr);
+            RA_StoreCC(&ptr);
+            RA_StoreFPCR(&ptr);
+            RA_StoreFPSR(&ptr);
         
 #if EMU68_INSN_COUNTER
-        extern uint32_t insn_count;
-        uint8_t ctx_free = 0;
-        uint8_t ctx = RA_TryCTX(&ptr);
-        uint8_t tmp = RA_AllocARMRegister(&ptr);
-        if (ctx == 0xff)
-        {
-            ctx = RA_AllocARMRegister(&ptr);
-            *ptr++ = mrs(ctx, 3, 3, 13, 0, 3);
-            ctx_free = 1;
-        }
-        *ptr++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-        *ptr++ = add64_immed(tmp, tmp, insn_count & 0xfff);
-        if (insn_count & 0xfff000)
-            *ptr++ = adds64_immed_lsl12(tmp, tmp, insn_count >> 12);
-        *ptr++ = str64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-
-        RA_FreeARMRegister(&ptr, tmp);
-        if (ctx_free)
-            RA_FreeARMRegister(&ptr, ctx);
+            extern uint32_t insn_count;
+            ptr = EMIT_UpdateInsnCount(ptr, insn_count);
 #endif
-        /* Return here */
-        *ptr++ = bx_lr();
+            /* Return here */
+            *ptr++ = bx_lr();
+        }
+        /* Update branch to the continuation */
+        *tmp_ptr = b_cc(A64_CC_NE, ptr - tmp_ptr);
     }
-    /* Update branch to the continuation */
-    *tmp_ptr = b_cc(A64_CC_NE, ptr - tmp_ptr);
 #else
     *ptr++ = cmp_immed(reg_q, 0);
     *ptr++ = b_cc(ARM_CC_NE, 0);
@@ -390,7 +451,10 @@ uint32_t *EMIT_DIVS_W(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
 
 #ifdef __aarch64__
     *ptr++ = sxth(reg_rem, reg_q);
-    *ptr++ = sdiv(reg_quot, reg_a, reg_rem);
+    if (const_div)
+        ptr = EMIT_DivByConst(ptr, reg_quot, reg_a, (int32_t)divisor, 1);
+    else
+        *ptr++ = sdiv(reg_quot, reg_a, reg_rem);
     *ptr++ = msub(reg_rem, reg_a, reg_quot, reg_rem);
 #else
     if (Features.ARM_SUPPORTS_DIV)
@@ -520,58 +584,53 @@ uint32_t *EMIT_DIVU_W(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
     uint8_t reg_quot = RA_AllocARMRegister(&ptr);
     uint8_t reg_rem = RA_AllocARMRegister(&ptr);
     uint8_t ext_words = 0;
+    uint8_t const_div = 0;
+    uint16_t divisor = 0;
+
+    /* Division by a non-zero immediate needs neither zero check nor divide instruction */
+    if ((opcode & 0x3f) == 0x3c)
+    {
+        divisor = BE16((*m68k_ptr)[0]);
+        const_div = divisor != 0;
+    }
 
     ptr = EMIT_LoadFromEffectiveAddress(ptr, 2, &reg_q, opcode & 0x3f, *m68k_ptr, &ext_words, 0, NULL);
     ptr = EMIT_FlushPC(ptr);
     RA_GetCC(&ptr);
 
 #ifdef __aarch64__
-    *ptr++ = ands_immed(31, reg_q, 16, 0);
-    uint32_t *tmp_ptr = ptr;
-    *ptr++ = b_cc(A64_CC_NE, 2);
-
-    if (1)
+    if (!const_div)
     {
-        /*
-            This is a point of no return. Issue division by zero exception here
-        */
-        *ptr++ = add_immed(REG_PC, REG_PC, 2 * (ext_words + 1));
+        *ptr++ = ands_immed(31, reg_q, 16, 0);
+        uint32_t *tmp_ptr = ptr;
+        *ptr++ = b_cc(A64_CC_NE, 2);
+
+        if (1)
+        {
+            /*
+                This is a point of no return. Issue division by zero exception here
+            */
+            *ptr++ = add_immed(REG_PC, REG_PC, 2 * (ext_words + 1));
 
-        ptr = EMIT_Exception(ptr, VECTOR_DIVIDE_BY_ZERO, 2, (uint32_t)(intptr_t)(*m68k_ptr - 1));
+            ptr = EMIT_Exception(ptr, VECTOR_DIVIDE_BY_ZERO, 2, (uint32_t)(intptr_t)(*m68k_ptr - 1));
 
-        RA_StoreDirtyFPURegs(&ptr);
-        RA_StoreDirtyM68kRegs(&ptr);
+            RA_StoreDirtyFPURegs(&ptr);
+            RA_StoreDirtyM68kRegs(&ptr);
 
-        RA_StoreCC(&ptr);
-        RA_StoreFPCR(&ptr);
-        RA_StoreFPSR(&ptr);
+            RA_StoreCC(&ptr);
+            RA_StoreFPCR(&ptr);
+            RA_StoreFPSR(&ptr);
         
 #if EMU68_INSN_COUNTER
-        extern uint32_t insn_count;
-        uint8_t ctx_free = 0;
-        uint8_t ctx = RA_TryCTX(&ptr);
-        uint8_t tmp = RA_AllocARMRegister(&ptr);
-        if (ctx == 0xff)
-        {
-            ctx = RA_AllocARMRegister(&ptr);
-            *ptr++ = mrs(ctx, 3, 3, 13, 0, 3);
-            ctx_free = 1;
-        }
-        *ptr++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-        *ptr++ = add64_immed(tmp, tmp, insn_count & 0xfff);
-        if (insn_count & 0xfff000)
-            *ptr++ = adds64_immed_lsl12(tmp, tmp, insn_count >> 12);
-        *ptr++ = str64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-
-        RA_FreeARMRegister(&ptr, tmp);
-        if (ctx_free)
-            RA_FreeARMRegister(&ptr, ctx);
+            extern uint32_t insn_count;
+            ptr = EMIT_UpdateInsnCount(ptr, insn_count);
 #endif
-        /* Return here */
-        *ptr++ = bx_lr();
+            /* Return here */
+            *ptr++ = bx_lr();
+        }
+        /* Update branch to the continuation */
+        *tmp_ptr = b_cc(A64_CC_NE, ptr - tmp_ptr);
     }
-    /* Update branch to the continuation */
-    *tmp_ptr = b_cc(A64_CC_NE, ptr - tmp_ptr);
 #else
     *ptr++ = cmp_immed(reg_q, 0);
     *ptr++ = b_cc(ARM_CC_NE, 0);
@@ -581,7 +640,10 @@ uint32_t *EMIT_DIVU_W(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
 
 #ifdef __aarch64__
     *ptr++ = uxth(reg_rem, reg_q);
-    *ptr++ = udiv(reg_quot, reg_a, reg_rem);
+    if (const_div)
+        ptr = EMIT_DivByConst(ptr, reg_quot, reg_a, divisor, 0);
+    else
+        *ptr++ = udiv(reg_quot, reg_a, reg_rem);
     *ptr++ = msub(reg_rem, reg_a, reg_quot, reg_rem);
 #else
     if (Features.ARM_SUPPORTS_DIV)
@@ -710,6 +772,15 @@ uint32_t *EMIT_DIVUS_L(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
     uint8_t reg_dq = RA_MapM68kRegister(&ptr, (opcode2 >> 12) & 7);
     uint8_t reg_dr = RA_MapM68kRegister(&ptr, opcode2 & 7);
     uint8_t ext_words = 1;
+    uint8_t const_div = 0;
+    uint32_t divisor = 0;
+
+    /* Division by a non-zero immediate needs neither zero check nor divide instruction */
+    if ((opcode & 0x3f) == 0x3c)
+    {
+        divisor = (BE16((*m68k_ptr)[1]) << 16) | BE16((*m68k_ptr)[2]);
+        const_div = divisor != 0;
+    }
 
     // Load divisor
     ptr = EMIT_LoadFromEffectiveAddress(ptr, 4, &reg_q, opcode & 0x3f, *m68k_ptr, &ext_words, 1, NULL);
@@ -718,51 +789,39 @@ uint32_t *EMIT_DIVUS_L(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
 
     // Check if division by 0
 #ifdef __aarch64__
-    uint32_t *tmp_ptr = ptr;
-    *ptr++ = cbnz(reg_q, 2);
+    uint32_t *tmp_ptr;
 
-    if (1)
+    if (!const_div)
     {
-        /*
-            This is a point of no return. Issue division by zero exception here
-        */
-        *ptr++ = add_immed(REG_PC, REG_PC, 2 * (ext_words + 1));
+        tmp_ptr = ptr;
+        *ptr++ = cbnz(reg_q, 2);
 
-        ptr = EMIT_Exception(ptr, VECTOR_DIVIDE_BY_ZERO, 2, (uint32_t)(intptr_t)(*m68k_ptr - 1));
+        if (1)
+        {
+            /*
+                This is a point of no return. Issue division by zero exception here
+            */
+            *ptr++ = add_immed(REG_PC, REG_PC, 2 * (ext_words + 1));
 
-        RA_StoreDirtyFPURegs(&ptr);
-        RA_StoreDirtyM68kRegs(&ptr);
+            ptr = EMIT_Exception(ptr, VECTOR_DIVIDE_BY_ZERO, 2, (uint32_t)(intptr_t)(*m68k_ptr - 1));
 
-        RA_StoreCC(&ptr);
-        RA_StoreFPCR(&ptr);
-        RA_StoreFPSR(&ptr);
+            RA_StoreDirtyFPURegs(&ptr);
+            RA_StoreDirtyM68kRegs(&ptr);
+
+            RA_StoreCC(&ptr);
+            RA_StoreFPCR(&ptr);
+            RA_StoreFPSR(&ptr);
         
 #if EMU68_INSN_COUNTER
-        extern uint32_t insn_count;
-        uint8_t ctx_free = 0;
-        uint8_t ctx = RA_TryCTX(&ptr);
-        uint8_t tmp = RA_AllocARMRegister(&ptr);
-        if (ctx == 0xff)
-        {
-            ctx = RA_AllocARMRegister(&ptr);
-            *ptr++ = mrs(ctx, 3, 3, 13, 0, 3);
-            ctx_free = 1;
-        }
-        *ptr++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-        *ptr++ = add64_immed(tmp, tmp, insn_count & 0xfff);
-        if (insn_count & 0xfff000)
-            *ptr++ = adds64_immed_lsl12(tmp, tmp, insn_count >> 12);
-        *ptr++ = str64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-
-        RA_FreeARMRegister(&ptr, tmp);
-        if (ctx_free)
-            RA_FreeARMRegister(&ptr, ctx);
+            extern uint32_t insn_count;
+            ptr = EMIT_UpdateInsnCount(ptr, insn_count);
 #endif
-        /* Return here */
-        *ptr++ = bx_lr();
+            /* Return here */
+            *ptr++ = bx_lr();
+        }
+        /* Update branch to the continuation */
+        *tmp_ptr = cbnz(reg_q, ptr - tmp_ptr);
     }
-    /* Update branch to the continuation */
-    *tmp_ptr = cbnz(reg_q, ptr - tmp_ptr);
 #else
     *ptr++ = cmp_immed(reg_q, 0);
     *ptr++ = b_cc(ARM_CC_NE, 0);
@@ -824,7 +883,9 @@ uint32_t *EMIT_DIVUS_L(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
     {
         if (reg_dr == reg_dq)
         {
-            if (sig)
+            if (const_div)
+                ptr = EMIT_DivByConst(ptr, reg_dq, reg_dq, divisor, sig);
+            else if (sig)
                 *ptr++ = sdiv(reg_dq, reg_dq, reg_q);
             else
                 *ptr++ = udiv(reg_dq, reg_dq, reg_q);
@@ -833,7 +894,9 @@ uint32_t *EMIT_DIVUS_L(uint32_t *ptr, uint16_t opcode, uint16_t **m68k_ptr)
         {
             uint8_t tmp = RA_AllocARMRegister(&ptr);
 
-            if (sig)
+            if (const_div)
+                ptr = EMIT_DivByConst(ptr, tmp, reg_dq, divisor, sig);
+            else if (sig)
                 *ptr++ = sdiv(tmp, reg_dq, reg_q);
             else
                 *ptr++ = udiv(tmp, reg_dq, reg_q);
@@ -0,0 +1,400 @@
+/*
+    Copyright © 2019 Michal Schulz <michal.schulz@gmx.de>
+    https://github.com/michalsc
+
+    This Source Code Form is subject to the terms of the
+    Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+    with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#ifndef _M68K_POLYKERNELS_H
+#define _M68K_POLYKERNELS_H
+
+/*
+    Constants of the FPU translator and the log/exp polynomial kernels which use them. Included by
+    M68k_LINEF.c and by the host accuracy check in tools/poly_ulp, so both run the same code.
+
+    The remaining transcendental functions still call musl from EMIT_FPU:
+    - FLOG10, FTENTOX: scaling the log/exp kernels by a constant loses the exact results for
+      powers of ten. They need their own reduction with log10(2) split into hi and lo parts.
+    - FLOGNP1, FETOXM1: log(1+x) and exp(x)-1 through the kernels cancel for small x. They need
+      the log1p/expm1 polynomials.
+    - FSINH, FTANH: cancel near zero the same way and are built on top of an expm1 kernel.
+      FCOSH needs split scaling between 709.78 and 710.48, where e**x overflows but cosh does not.
+    - FATAN, FASIN, FACOS: need an atan polynomial with its own breakpoint table. FASIN and FACOS
+      are derived from it.
+    - FTAN: the reduction by pi used by PolySine is not accurate enough close to the poles of tan.
+*/
+
+enum {
+    C_PI = 0,
+    C_PI_2,
+    C_PI_4,
+    C_1_PI,
+    C_2_PI,
+    C_2_SQRTPI,
+    C_1_2PI,
+    C_SQRT2,
+    C_SQRT1_2,
+    C_0_5,
+    C_1_5,
+    C_LOG10_2 = 0x0b,
+    C_E,
+    C_LOG2E,
+    C_LOG10E,
+    C_ZERO,
+    C_SIN_COEFF = 0x10,  /* 21-poly for sine approximation - error margin within double precision */
+    C_COS_COEFF = 0x20,  /* 20-poly for cosine approximation -error margin within double precision */
+
+    C_SIN_COEFF_SINGLE = 0x1a,
+    C_COS_COEFF_SINGLE = 0x2a,
+
+    C_LN2 = 0x30,
+    C_LN10,
+    C_10P0,
+    C_10P1,
+    C_10P2,
+    C_10P4,
+    C_10P8,
+    C_10P16,
+    C_10P32,
+    C_10P64,
+    C_10P128,
+    C_10P256,
+    C_10P512,
+    C_10P1024,
+    C_10P2048,
+    C_10P4096,
+
+    C_TWO54,
+    C_LN2HI,
+    C_LN2LO,
+    C_LG1,
+    C_LG2,
+    C_LG3,
+    C_LG4,
+    C_LG5,
+    C_LG6,
+    C_LG7,
+
+    C_EXP_P1,
+    C_EXP_P2,
+    C_EXP_P3,
+    C_EXP_P4,
+    C_EXP_P5,
+    C_EXP_LIMIT
+};
+
+static double const __attribute__((used)) constants[128] = {
+    [C_PI] =        3.14159265358979323846264338327950288, /* Official */
+    [C_PI_2] =      1.57079632679489661923132169163975144,
+    [C_PI_4] =      0.785398163397448309615660845819875721,
+    [C_1_PI] =      0.318309886183790671537767526745028724,
+    [C_2_PI] =      0.636619772367581343075535053490057448,
+    [C_2_SQRTPI] =  1.12837916709551257389615890312154517,
+    [C_1_2PI] =     0.1591549430918953357688837633725143620,
+    [C_SQRT2] =     1.41421356237309504880168872420969808,
+    [C_SQRT1_2] =   0.707106781186547524400844362104849039,
+    [C_0_5] =       0.5,
+    [C_1_5] =       1.5,
+    [C_LOG10_2] =   0.301029995663981195214, /* Official - Log10(2) */
+    [C_E] =         2.71828182845904523536028747135266250,                /* Official */
+    [C_LOG2E] =     1.44269504088896340735992468100189214,            /* Official */
+    [C_LOG10E] =    0.434294481903251827651128918916605082,           /* Official */
+    [C_ZERO] =      0.0,                /* Official */
+
+    /* Polynom coefficients for sin(x*Pi), x=0..0.5*/
+
+    [C_SIN_COEFF] = -2.11100178050346585936E-5,
+                    4.65963708473294521719E-4,
+                    -7.37035513524020578156E-3,
+                    8.21458769726032277098E-2,
+                    -5.99264528627362954518E-1,
+                    2.55016403985097679243,
+                    -5.16771278004952168888,
+                    3.14159265358979102647,
+
+    /* Reduced number of polynom coefficients for sin(x*Pi), x=0..0.5 */
+
+    [C_SIN_COEFF_SINGLE] =
+                    7.74455095806670556524E-2,
+                    -5.98160819620617657839E-1,
+                    2.55005088882843729408,
+                    -5.1677080762924026306,
+                    3.14159259939191476447,
+
+    /* Polynom coefficients for cos(x*Pi), x=0..0.5 */
+
+    [C_COS_COEFF] = 4.15383875943350535407E-6,
+                    -1.04570624685965272291E-4,
+                    1.92955784205552168426E-3,
+                    -2.58068890507489103003E-2,
+                    2.35330630164104256943E-1,
+                    -1.33526276884550367708,
+                    4.05871212641655666324,
+                    -4.93480220054467742126,
+                    9.99999999999999997244E-1,
+
+    /* Reduced number of polynom coefficients for cos(x*Pi), x=0..0.5 */
+    [C_COS_COEFF_SINGLE] =
+                    2.20485796302921884119E-1,
+                    -1.33223541188749370639,
+                    4.058461009872062766402,
+                    -4.93479497666537363458,
+                    9.99999967245121125386E-1,
+
+    [C_LN2] =       0.693147180559945309417232121458176568,              /* Official */
+    [C_LN10] =      2.30258509299404568401799145468436421,             /* Official */
+    [C_10P0] =      1.0,                /* Official */
+    [C_10P1] =      1E1,                /* Official */
+    [C_10P2] =      1E2,                /* Official */
+    [C_10P4] =      1E4,                /* Official */
+    [C_10P8] =      1E8,                /* Official */
+    [C_10P16] =     1E16,               /* Official */
+    [C_10P32] =     1E32,               /* Official */
+    [C_10P64] =     1E64,               /* Official */
+    [C_10P128] =    1E128,              /* Official */
+    [C_10P256] =    1E256,              /* Official */
+    [C_10P512] =    0x1.fffffep+127f,           /* Official 1E512 - too large for double! */
+    [C_10P1024] =   0x1.fffffep+127f,           /* Official 1E1024 - too large for double! */
+    [C_10P2048] =   0x1.fffffep+127f,           /* Official 1E2048 - too large for double! */
+    [C_10P4096] =   0x1.fffffep+127f,           /* Official 1E4096 - too large for double! */
+
+    [C_TWO54] =     1.80143985094819840000e+16,
+    [C_LN2HI] =     6.93147180369123816490e-01,
+    [C_LN2LO] =     1.90821492927058770002e-10,
+
+    [C_LG1] =       6.666666666666735130e-01,
+    [C_LG2] =       3.999999999940941908e-01,
+    [C_LG3] =       2.857142874366239149e-01,
+    [C_LG4] =       2.222219843214978396e-01,
+    [C_LG5] =       1.818357216161805012e-01,
+    [C_LG6] =       1.531383769920937332e-01,
+    [C_LG7] =       1.479819860511658591e-01,
+
+    /* Remez polynomial for exp(r), |r| <= ln2/2, error below 2**-59 (fdlibm e_exp.c) */
+    [C_EXP_P1] =    1.66666666666666019037e-01,
+    [C_EXP_P2] =    -2.77777777770155933842e-03,
+    [C_EXP_P3] =    6.61375632143793436117e-05,
+    [C_EXP_P4] =    -1.65339022054652515390e-06,
+    [C_EXP_P5] =    4.13813679705723846039e-08,
+    [C_EXP_LIMIT] = 1100.0,             /* |x| above this overflows or underflows anyway */
+};
+
+#ifdef __aarch64__
+
+/*
+    Natural and binary logarithm of d0, result in d0. All other registers are preserved, so the
+    caller does not need to spill anything but x0 and x30.
+
+    Argument reduction and polynomial follow fdlibm e_log.c: x = 2**k * (1+f) with sqrt(2)/2 < 1+f
+    < sqrt(2), log(1+f) = f - hfsq + s*(hfsq+R(s*s)). Error is below 1 ulp in double precision,
+    PolyLog2 adds one more rounding (below 2 ulp) but returns exact results for powers of two.
+    Both are good to the double precision result which 68881/68882 returns after rounding to D.
+*/
+void PolyLog(void);
+void PolyLog2(void);
+void  __attribute__((used)) stub_PolyLog(void)
+{
+    asm volatile(
+        "   .align 4                \n"
+        "   .globl PolyLog          \n"
+        "   .globl PolyLog2         \n"
+        "PolyLog2:                  \n"
+        "   stp x4, x5, [sp, #-96]! \n"
+        "   mov w5, #1              \n"
+        "   b 1f                    \n"
+        "PolyLog:                   \n"
+        "   stp x4, x5, [sp, #-96]! \n"
+        "   mov w5, #0              \n"
+        "1: stp x0, x1, [sp, #16]   \n"
+        "   stp x2, x3, [sp, #32]   \n"
+        "   stp d1, d2, [sp, #48]   \n"
+        "   stp d3, d4, [sp, #64]   \n"
+        "   stp d5, d6, [sp, #80]   \n"
+        "   ldr x0,=constants       \n"
+        "   mov w3, #0              \n"
+        "   fmov x1, d0             \n"
+        "   lsr x2, x1, #32         \n"
+        "   cmp w2, #0x100, lsl #12 \n"     /* Zero, negative, NaN with sign or denormal? */
+        "   b.ge 2f                 \n"
+        "   fcmp d0, #0.0           \n"
+        "   b.vs 7f                 \n"
+        "   b.eq 8f                 \n"
+        "   b.mi 9f                 \n"
+        "   ldr d1, [x0, %[two54]]  \n"     /* Normalize denormal */
+        "   fmul d0, d0, d1         \n"
+        "   mov w3, #-54            \n"
+        "   fmov x1, d0             \n"
+        "   lsr x2, x1, #32         \n"
+        "2: mov w4, #0x7ff00000     \n"     /* Inf or NaN */
+        "   cmp w2, w4              \n"
+        "   b.ge 7f                 \n"
+        "   mov w4, #0x5f62         \n"     /* Split into k and 1+f */
+        "   movk w4, #0x9, lsl #16  \n"
+        "   add w2, w2, w4          \n"
+        "   add w3, w3, w2, lsr #20 \n"
+        "   sub w3, w3, #0x3ff      \n"
+        "   and w2, w2, #0xfffff    \n"
+        "   mov w4, #0xa09e         \n"
+        "   movk w4, #0x3fe6, lsl #16 \n"
+        "   add w2, w2, w4          \n"
+        "   bfi x1, x2, #32, #32    \n"
+        "   fmov d0, x1             \n"
+        "   fmov d1, #1.0           \n"
+        "   fsub d0, d0, d1         \n"     /* d0 = f */
+        "   fmov d2, #2.0           \n"
+        "   fadd d2, d2, d0         \n"
+        "   fdiv d2, d0, d2         \n"     /* d2 = s = f / (2 + f) */
+        "   fmul d3, d0, d0         \n"
+        "   fmov d4, #0.5           \n"
+        "   fmul d3, d3, d4         \n"     /* d3 = hfsq = f*f/2 */
+        "   fmul d4, d2, d2         \n"     /* d4 = z = s*s */
+        "   ldr d1, [x0, %[lg]+48]  \n"
+        "   ldr d5, [x0, %[lg]+40]  \n"
+        "   fmadd d1, d1, d4, d5    \n"
+        "   ldr d5, [x0, %[lg]+32]  \n"
+        "   fmadd d1, d1, d4, d5    \n"
+        "   ldr d5, [x0, %[lg]+24]  \n"
+        "   fmadd d1, d1, d4, d5    \n"
+        "   ldr d5, [x0, %[lg]+16]  \n"
+        "   fmadd d1, d1, d4, d5    \n"
+        "   ldr d5, [x0, %[lg]+8]   \n"
+        "   fmadd d1, d1, d4, d5    \n"
+        "   ldr d5, [x0, %[lg]]     \n"
+        "   fmadd d1, d1, d4, d5    \n"
+        "   fmul d1, d1, d4         \n"     /* d1 = R(z) */
+        "   fadd d1, d3, d1         \n"
+        "   fmul d1, d2, d1         \n"     /* d1 = s*(hfsq+R) */
+        "   scvtf d5, w3            \n"     /* d5 = k */
+        "   cbnz w5, 3f             \n"
+        "   ldr d4, [x0, %[ln2hi]]  \n"
+        "   ldr d6, [x0, %[ln2hi]+8] \n"
+        "   fmadd d1, d5, d6, d1    \n"
+        "   fsub d1, d1, d3         \n"
+        "   fadd d1, d1, d0         \n"
+        "   fmadd d0, d5, d4, d1    \n"     /* k*ln2_hi + (f - hfsq + s*(hfsq+R) + k*ln2_lo) */
+        "   b 10f                   \n"
+        "3: fsub d1, d1, d3         \n"
+        "   fadd d1, d1, d0         \n"
+        "   ldr d4, [x0, %[log2e]]  \n"
+        "   fmadd d0, d1, d4, d5    \n"     /* k + log(1+f) * log2(e) */
+        "   b 10f                   \n"
+        "7: fadd d0, d0, d0         \n"     /* NaN or +Inf */
+        "   b 10f                   \n"
+        "8: fmov d1, #-1.0          \n"     /* log(+-0) = -Inf */
+        "   fmul d0, d0, d0         \n"
+        "   fdiv d0, d1, d0         \n"
+        "   b 10f                   \n"
+        "9: fsub d0, d0, d0         \n"     /* log(x<0) = NaN */
+        "   fdiv d0, d0, d0         \n"
+        "10:ldp x0, x1, [sp, #16]   \n"
+        "   ldp x2, x3, [sp, #32]   \n"
+        "   ldp d1, d2, [sp, #48]   \n"
+        "   ldp d3, d4, [sp, #64]   \n"
+        "   ldp d5, d6, [sp, #80]   \n"
+        "   ldp x4, x5, [sp], #96   \n"
+        "   ret                     \n"
+        "   .ltorg                  \n"
+        ::[two54]"i"(C_TWO54*8), [lg]"i"(C_LG1*8), [ln2hi]"i"(C_LN2HI*8), [log2e]"i"(C_LOG2E*8)
+    );
+}
+
+/*
+    e**d0 and 2**d0, result in d0. All other registers are preserved.
+
+    x = k*ln2 + r, |r| <= ln2/2, exp(r) = 1 + r + r*c/(2-c) with c = r - r*r*P(r*r) as in fdlibm
+    e_exp.c, error below 1 ulp. For 2**x the reduction x - k is exact, so integer arguments give
+    exact powers of two. Scaling by 2**k is done in two steps, results which overflow or
+    underflow double range become Inf or (denormal) zero.
+*/
+void PolyExp(void);
+void PolyTwoToX(void);
+void  __attribute__((used)) stub_PolyExp(void)
+{
+    asm volatile(
+        "   .align 4                \n"
+        "   .globl PolyExp          \n"
+        "   .globl PolyTwoToX       \n"
+        "PolyTwoToX:                \n"
+        "   stp x2, x3, [sp, #-96]! \n"
+        "   mov w3, #1              \n"
+        "   b 1f                    \n"
+        "PolyExp:                   \n"
+        "   stp x2, x3, [sp, #-96]! \n"
+        "   mov w3, #0              \n"
+        "1: stp x0, x1, [sp, #16]   \n"
+        "   stp d1, d2, [sp, #32]   \n"
+        "   stp d3, d4, [sp, #48]   \n"
+        "   stp d5, d6, [sp, #64]   \n"
+        "   str d7, [sp, #80]       \n"
+        "   ldr x0,=constants       \n"
+        "   fcmp d0, d0             \n"
+        "   b.vs 7f                 \n"
+        "   ldr d1, [x0, %[limit]]  \n"
+        "   fmin d0, d0, d1         \n"
+        "   fneg d1, d1             \n"
+        "   fmax d0, d0, d1         \n"
+        "   cbnz w3, 2f             \n"
+        "   ldr d1, [x0, %[log2e]]  \n"
+        "   fmul d1, d0, d1         \n"
+        "   frintn d1, d1           \n"     /* d1 = k = round(x / ln2) */
+        "   ldr d2, [x0, %[ln2hi]]  \n"
+        "   ldr d3, [x0, %[ln2hi]+8] \n"
+        "   fmsub d2, d1, d2, d0    \n"     /* d2 = hi = x - k*ln2_hi */
+        "   fmul d3, d1, d3         \n"     /* d3 = lo = k*ln2_lo */
+        "   b 3f                    \n"
+        "2: frintn d1, d0           \n"     /* d1 = k = round(x) */
+        "   fsub d2, d0, d1         \n"
+        "   ldr d3, [x0, %[ln2]]    \n"
+        "   fmul d2, d2, d3         \n"     /* d2 = hi = (x - k)*ln2 */
+        "   movi d3, #0             \n"     /* d3 = lo = 0 */
+        "3: fcvtzs x1, d1           \n"
+        "   fsub d4, d2, d3         \n"     /* d4 = r */
+        "   fmul d5, d4, d4         \n"     /* d5 = t = r*r */
+        "   ldr d6, [x0, %[p]+32]   \n"
+        "   ldr d7, [x0, %[p]+24]   \n"
+        "   fmadd d6, d6, d5, d7    \n"
+        "   ldr d7, [x0, %[p]+16]   \n"
+        "   fmadd d6, d6, d5, d7    \n"
+        "   ldr d7, [x0, %[p]+8]    \n"
+        "   fmadd d6, d6, d5, d7    \n"
+        "   ldr d7, [x0, %[p]]      \n"
+        "   fmadd d6, d6, d5, d7    \n"
+        "   fmsub d6, d5, d6, d4    \n"     /* d6 = c = r - t*P(t) */
+        "   fmul d7, d4, d6         \n"
+        "   fmov d1, #2.0           \n"
+        "   fsub d6, d1, d6         \n"
+        "   fdiv d7, d7, d6         \n"     /* r*c/(2-c) */
+        "   fsub d7, d7, d3         \n"
+        "   fadd d7, d7, d2         \n"
+        "   fmov d1, #1.0           \n"
+        "   fadd d0, d1, d7         \n"     /* d0 = exp(r) */
+        "   asr x2, x1, #1          \n"     /* Scale by 2**(k/2) and 2**(k-k/2) */
+        "   sub x1, x1, x2          \n"
+        "   add x2, x2, #0x3ff      \n"
+        "   lsl x2, x2, #52         \n"
+        "   fmov d1, x2             \n"
+        "   fmul d0, d0, d1         \n"
+        "   add x1, x1, #0x3ff      \n"
+        "   lsl x1, x1, #52         \n"
+        "   fmov d1, x1             \n"
+        "   fmul d0, d0, d1         \n"
+        "   b 8f                    \n"
+        "7: fadd d0, d0, d0         \n"     /* NaN */
+        "8: ldp x0, x1, [sp, #16]   \n"
+        "   ldp d1, d2, [sp, #32]   \n"
+        "   ldp d3, d4, [sp, #48]   \n"
+        "   ldp d5, d6, [sp, #64]   \n"
+        "   ldr d7, [sp, #80]       \n"
+        "   ldp x2, x3, [sp], #96   \n"
+        "   ret                     \n"
+        "   .ltorg                  \n"
+        ::[limit]"i"(C_EXP_LIMIT*8), [log2e]"i"(C_LOG2E*8), [ln2hi]"i"(C_LN2HI*8), [ln2]"i"(C_LN2*8),
+          [p]"i"(C_EXP_P1*8)
+    );
+}
+
+#endif /* __aarch64__ */
+
+#endif /* _M68K_POLYKERNELS_H */
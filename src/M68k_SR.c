@@ -125,6 +125,28 @@ int M68K_IsBranch(uint16_t *insn_stream)
         return 0;
 }
 
+/* Check if opcode may raise an exception which is not already covered by M68K_IsBranch */
+int M68K_MayTrap(uint16_t *insn_stream)
+{
+    uint16_t opcode = BE16(*insn_stream);
+
+    if (
+        (opcode & 0xf0c0) == 0x80c0 ||  /* DIVU.W, DIVS.W */
+        (opcode & 0xffc0) == 0x4c40 ||  /* DIVU.L, DIVS.L */
+        (opcode & 0xf1c0) == 0x4180 ||  /* CHK.W */
+        (opcode & 0xf1c0) == 0x4100 ||  /* CHK.L */
+        (opcode & 0xf9c0) == 0x00c0 ||  /* CHK2, CMP2 */
+        (opcode & 0xff00) == 0x0e00 ||  /* MOVES */
+        ((opcode & 0xf0f8) == 0x50f8 && (opcode & 7) >= 2 && (opcode & 7) <= 4) || /* TRAPcc */
+        (opcode & 0xf000) == 0xa000 ||  /* Line A */
+        (opcode & 0xff80) == 0xf300     /* FSAVE, FRESTORE */
+    )
+        return 1;
+
+    /* Opcodes the decoder does not know end in an illegal instruction or line F exception */
+    return M68K_GetINSNLength(insn_stream) == 0;
+}
+
 int M68K_GetMoveLength(uint16_t *insn_stream)
 {
     uint16_t opcode = BE16(*insn_stream);
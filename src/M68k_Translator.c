@@ -36,10 +36,30 @@ const int debug_cnt = 0;
 
 struct List *ICache;
 struct List LRU;
+/* Units which are still in LRU but must not be found anymore, see M68K_FPCRChanged */
+static struct List InvalidUnits;
 static uint32_t *temporary_arm_code;
 static struct M68KLocalState *local_state;
+static struct M68KPCMap *pc_map;
+static uint32_t pc_map_size;
+#if EMU68_PEEPHOLE && defined(__aarch64__)
+static uint32_t *peephole_map;
+#endif
+#ifdef __aarch64__
+/*
+    Units by the page of JIT memory their code starts in. Code may spill over into following pages,
+    arm_index_reach is the largest number of pages any unit has spilled over so far.
+*/
+#define ARM_INDEX_SHIFT     12
+#define ARM_INDEX_SIZE      ((KERNEL_JIT_PAGES << 21) >> ARM_INDEX_SHIFT)
+static struct List *ARMIndex;
+static uint32_t arm_index_reach;
+#endif
 
 int32_t _pc_rel = 0;
+int8_t translation_s = -1;
+int8_t translation_fpcr_rnd = -1;
+uint8_t translation_fpcr_used = 0;
 
 uint32_t *EMIT_GetOffsetPC(uint32_t *ptr, int8_t *offset)
 {
@@ -101,6 +121,49 @@ uint32_t *EMIT_ResetOffsetPC(uint32_t *ptr)
     return ptr;
 }
 
+#if EMU68_INSN_COUNTER_SAMPLED
+uint32_t insn_count_total = 0;
+uint32_t unit_count_total = 0;
+#endif
+
+/*
+    Account for count m68k instructions executed. With EMU68_INSN_COUNTER_REG the counter lives in
+    REG_INSN_COUNT and is written back to M68KState by the dispatcher, otherwise INSN_COUNT is updated
+    in memory. In sampled mode units do not count at all, the dispatcher counts unit entries instead.
+*/
+uint32_t *EMIT_UpdateInsnCount(uint32_t *ptr, uint32_t count)
+{
+#if EMU68_INSN_COUNTER && !EMU68_INSN_COUNTER_SAMPLED && defined(__aarch64__)
+#if EMU68_INSN_COUNTER_REG
+    *ptr++ = add64_immed(REG_INSN_COUNT, REG_INSN_COUNT, count & 0xfff);
+    if (count & 0xfff000)
+        *ptr++ = add64_immed_lsl12(REG_INSN_COUNT, REG_INSN_COUNT, count >> 12);
+#else
+    uint8_t ctx_free = 0;
+    uint8_t ctx = RA_TryCTX(&ptr);
+    uint8_t tmp = RA_AllocARMRegister(&ptr);
+    if (ctx == 0xff)
+    {
+        ctx = RA_AllocARMRegister(&ptr);
+        *ptr++ = mrs(ctx, 3, 3, 13, 0, 3);
+        ctx_free = 1;
+    }
+    *ptr++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
+    *ptr++ = add64_immed(tmp, tmp, count & 0xfff);
+    if (count & 0xfff000)
+        *ptr++ = add64_immed_lsl12(tmp, tmp, count >> 12);
+    *ptr++ = str64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
+
+    RA_FreeARMRegister(&ptr, tmp);
+    if (ctx_free)
+        RA_FreeARMRegister(&ptr, ctx);
+#endif
+#else
+    (void)count;
+#endif
+    return ptr;
+}
+
 uint32_t *EMIT_lineA(uint32_t *arm_ptr, uint16_t **m68k_ptr, uint16_t *insn_consumed)
 {
     uint16_t opcode = BE16((*m68k_ptr)[0]);
@@ -161,6 +224,9 @@ static inline uint32_t *EmitINSN(uint32_t *arm_ptr, uint16_t **m68k_ptr, uint16_
     }
 #endif
 
+    if (EMIT_Fusion(&ptr, m68k_ptr, insn_consumed))
+        return ptr;
+
     ptr = line_array[group](ptr, m68k_ptr, insn_consumed);
 
     return ptr;
@@ -220,16 +286,277 @@ uint32_t insn_count;
 uint32_t prologue_size = 0;
 uint32_t epilogue_size = 0;
 uint32_t conditionals_count = 0;
+uint32_t peephole_saved = 0;
 
 extern struct M68KState *__m68k_state;
 void M68K_PrintContext(void *);
 
+#if EMU68_KNOWN_VALUES && defined(__aarch64__)
+/*
+    Values of m68k registers known at translation time. A register gets a value from
+    instructions loading a constant (LEA abs/d16(PC)/d16(An), MOVEA.L #imm, MOVE.L #imm,
+    MOVEQ, ADDQ/SUBQ on a known An) and loses it as soon as any ARM instruction emitted
+    for the unit may write to the host register it is mapped to. Translation units are
+    straight-line code with side exits only, so the value holds until then.
+*/
+static uint32_t known_value[16];
+static uint16_t known_mask;
+
+/* Conservative mask of general purpose registers an A64 instruction may write to */
+static inline uint32_t written_mask(uint32_t insn)
+{
+    if ((insn & 0x0a000000) == 0x08000000)
+    {
+        return (1 << (insn & 31)) | (1 << ((insn >> 5) & 31)) |
+               (1 << ((insn >> 10) & 31)) | (1 << ((insn >> 16) & 31));
+    }
+
+    return 1 << (insn & 31);
+}
+
+/* Local RAM is accessed directly, everything else goes through the bus */
+static inline int is_local_ram(uint32_t address)
+{
+    return address >= EMU68_BULK_RAM_LOW && address < EMU68_BULK_RAM_HIGH;
+}
+
+static void M68K_UpdateKnownValues(uint16_t *m68k_ptr, uint16_t insn_consumed, uint32_t *arm_start, uint32_t *arm_end)
+{
+    uint16_t opcode = BE16(m68k_ptr[0]);
+    uint8_t reg = (opcode >> 9) & 7;
+    uint8_t seed_reg = 0xff;
+    uint32_t seed = 0;
+    uint32_t written = 0;
+
+    /* Compute new value first, it may depend on the old state of the register */
+    if (insn_consumed == 1)
+    {
+        if ((opcode & 0xf1ff) == 0x41f9 || (opcode & 0xf1ff) == 0x207c)         /* LEA abs.L, MOVEA.L #imm */
+        {
+            seed_reg = 8 + reg;
+            seed = ((uint32_t)BE16(m68k_ptr[1]) << 16) | BE16(m68k_ptr[2]);
+        }
+        else if ((opcode & 0xf1ff) == 0x203c)                                   /* MOVE.L #imm, Dn */
+        {
+            seed_reg = reg;
+            seed = ((uint32_t)BE16(m68k_ptr[1]) << 16) | BE16(m68k_ptr[2]);
+        }
+        else if ((opcode & 0xf1ff) == 0x41f8)                                   /* LEA abs.W */
+        {
+            seed_reg = 8 + reg;
+            seed = (int16_t)BE16(m68k_ptr[1]);
+        }
+        else if ((opcode & 0xf1ff) == 0x41fa)                                   /* LEA d16(PC) */
+        {
+            seed_reg = 8 + reg;
+            seed = (uint32_t)(uintptr_t)&m68k_ptr[1] + (int16_t)BE16(m68k_ptr[1]);
+        }
+        else if ((opcode & 0xf1f8) == 0x41e8 && (known_mask & (1 << (8 + (opcode & 7)))))  /* LEA d16(An) */
+        {
+            seed_reg = 8 + reg;
+            seed = known_value[8 + (opcode & 7)] + (int16_t)BE16(m68k_ptr[1]);
+        }
+        else if ((opcode & 0xf100) == 0x7000)                                   /* MOVEQ */
+        {
+            seed_reg = reg;
+            seed = (int8_t)(opcode & 0xff);
+        }
+        else if ((opcode & 0xf038) == 0x5008 && ((opcode >> 6) & 3) != 0 && ((opcode >> 6) & 3) != 3 &&
+                 (known_mask & (1 << (8 + (opcode & 7)))))                      /* ADDQ/SUBQ .W/.L An */
+        {
+            uint8_t data = reg ? reg : 8;
+            seed_reg = 8 + (opcode & 7);
+            seed = known_value[seed_reg] + ((opcode & 0x0100) ? -data : data);
+        }
+    }
+
+    for (uint32_t *p = arm_start; p < arm_end; p++)
+        written |= written_mask(INSN_TO_LE(*p));
+
+    for (int r=0; r < 16; r++)
+    {
+        if (written & (1 << RA_MapM68kRegister(&arm_end, r)))
+            known_mask &= ~(1 << r);
+    }
+
+    if (seed_reg != 0xff)
+    {
+        known_value[seed_reg] = seed;
+        known_mask |= 1 << seed_reg;
+    }
+}
+
+int M68K_GetKnownValue(uint8_t m68k_reg, uint32_t *value)
+{
+    m68k_reg &= 15;
+
+    if (known_mask & (1 << m68k_reg))
+    {
+        *value = known_value[m68k_reg];
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+    Find an address register with known value which can serve as base for a single
+    load/store of given size to the address. The base has to point to the same kind
+    of memory (local RAM or bus) as the address, so that the translated access takes
+    the same path as the one with the address materialized.
+*/
+int M68K_GetKnownBase(uint32_t address, uint8_t size, uint8_t *m68k_reg, int32_t *offset)
+{
+    if (size != 1 && size != 2 && size != 4)
+        return 0;
+
+    for (int r=8; r < 16; r++)
+    {
+        if (!(known_mask & (1 << r)) || is_local_ram(known_value[r]) != is_local_ram(address))
+            continue;
+
+        int32_t off = (int32_t)(address - known_value[r]);
+
+        if ((off > -256 && off < 256) || (off >= 0 && (off & (size - 1)) == 0 && off < 4096 * size))
+        {
+            *m68k_reg = r;
+            *offset = off;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+#else
+int M68K_GetKnownValue(uint8_t m68k_reg, uint32_t *value)
+{
+    (void)m68k_reg;
+    (void)value;
+    return 0;
+}
+
+int M68K_GetKnownBase(uint32_t address, uint8_t size, uint8_t *m68k_reg, int32_t *offset)
+{
+    (void)address;
+    (void)size;
+    (void)m68k_reg;
+    (void)offset;
+    return 0;
+}
+#endif
+
+#if EMU68_SHARED_EXITS && defined(__aarch64__)
+/*
+    Conditional exits do not carry their own epilogue. Every exit stores CC/FPCR/FPSR
+    inline (these depend on the register allocator state at that point) and branches
+    to a stub in the cold part of the unit, placed behind the final epilogue. The
+    stub applies the pending PC offset and the instruction count of that exit, then
+    continues with a tail shared by all exits of the unit. Exits with the same PC
+    offset and count share one stub.
+*/
+#define EXIT_COUNT      (EMU68_INSN_COUNTER && !EMU68_INSN_COUNTER_SAMPLED)
+#define EXIT_COUNT_MEM  (EXIT_COUNT && !EMU68_INSN_COUNTER_REG)
+
+struct ExitStub {
+    uint32_t *  es_Branch;
+    int32_t     es_PCRel;
+    uint32_t    es_Count;
+};
+
+static uint32_t *EMIT_ExitStubs(uint32_t *ptr, struct ExitStub *exits, uint32_t exit_cnt, uint32_t **pop_update_loc, uint32_t *pop_cnt)
+{
+    uint32_t *stub[EMU68_M68K_INSN_DEPTH];
+    uint32_t *tail_branch[EMU68_M68K_INSN_DEPTH];
+    uint32_t tail_cnt = 0;
+    uint8_t cnt = RA_AllocARMRegister(&ptr);
+
+    for (unsigned i=0; i < exit_cnt; i++)
+    {
+        unsigned j;
+
+        for (j=0; j < i; j++)
+        {
+            if (exits[j].es_PCRel == exits[i].es_PCRel && exits[j].es_Count == exits[i].es_Count)
+                break;
+        }
+
+        if (j < i)
+        {
+            stub[i] = stub[j];
+            continue;
+        }
+
+        /* Nothing to do per exit, go straight to the tail */
+        if (exits[i].es_PCRel == 0 && !EXIT_COUNT)
+        {
+            stub[i] = NULL;
+            continue;
+        }
+
+        stub[i] = ptr;
+
+        if (exits[i].es_PCRel > 0)
+            *ptr++ = add_immed(REG_PC, REG_PC, exits[i].es_PCRel);
+        else if (exits[i].es_PCRel < 0)
+            *ptr++ = sub_immed(REG_PC, REG_PC, -exits[i].es_PCRel);
+#if EXIT_COUNT_MEM
+        *ptr++ = mov_immed_u16(cnt, exits[i].es_Count, 0);
+#else
+        ptr = EMIT_UpdateInsnCount(ptr, exits[i].es_Count);
+#endif
+        tail_branch[tail_cnt++] = ptr;
+        *ptr++ = b(0);
+    }
+
+    /* Last stub falls through into the tail */
+    if (tail_cnt && tail_branch[tail_cnt - 1] == ptr - 1)
+    {
+        ptr--;
+        tail_cnt--;
+    }
+
+    uint32_t *tail = ptr;
+
+#if EXIT_COUNT_MEM
+    uint8_t ctx = RA_AllocARMRegister(&ptr);
+    uint8_t tmp = RA_AllocARMRegister(&ptr);
+
+    *ptr++ = mrs(ctx, 3, 3, 13, 0, 3);
+    *ptr++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
+    *ptr++ = add64_reg(tmp, tmp, cnt, LSL, 0);
+    *ptr++ = str64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
+
+    RA_FreeARMRegister(&ptr, tmp);
+    RA_FreeARMRegister(&ptr, ctx);
+#endif
+    pop_update_loc[(*pop_cnt)++] = ptr;
+    *ptr++ = bx_lr();
+
+    RA_FreeARMRegister(&ptr, cnt);
+
+    for (unsigned i=0; i < tail_cnt; i++)
+        *tail_branch[i] = b(tail - tail_branch[i]);
+
+    for (unsigned i=0; i < exit_cnt; i++)
+    {
+        uint32_t *target = stub[i] ? stub[i] : tail;
+        *exits[i].es_Branch = b(target - exits[i].es_Branch);
+    }
+
+    return ptr;
+}
+#endif
+
 static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
 {
     uint16_t *orig_m68kcodeptr = m68kcodeptr;
     uintptr_t hash = (uintptr_t)m68kcodeptr;
     uint32_t *pop_update_loc[EMU68_M68K_INSN_DEPTH];
     uint32_t pop_cnt=0;
+#if EMU68_SHARED_EXITS && defined(__aarch64__)
+    struct ExitStub exit_stubs[EMU68_M68K_INSN_DEPTH];
+    uint32_t exit_cnt = 0;
+#endif
 
     uint16_t *last_rev_jump = (uint16_t *)0xffffffff;
 
@@ -259,8 +586,12 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
     prologue_size = 0;
     epilogue_size = 0;
     conditionals_count = 0;
+    peephole_saved = 0;
+    translation_fpcr_used = 0;
+    FPU_ClearPendingFlags();
 
     insn_count = 0;
+    pc_map_size = 0;
     uint32_t *arm_code = temporary_arm_code;
     uint32_t *end = arm_code;
 
@@ -268,6 +599,10 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
     (void)lr_is_saved;
 
     RA_ClearChangedMask();
+#if EMU68_KNOWN_VALUES && defined(__aarch64__)
+    known_mask = 0;
+#endif
+    M68K_ResetExceptionCalls();
 
     uint32_t *tmpptr = end;
     pop_update_loc[pop_cnt++] = end;
@@ -335,12 +670,25 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
         local_state[insn_count].mls_ARMOffset = end - arm_code;
         local_state[insn_count].mls_M68kPtr = m68kcodeptr;
         local_state[insn_count].mls_PCRel = _pc_rel;
+        pc_map[pc_map_size].pm_M68kPC = (uint32_t)(uintptr_t)m68kcodeptr;
+        pc_map[pc_map_size].pm_ARMOffset = end - arm_code;
+        pc_map[pc_map_size++].pm_PCRel = _pc_rel;
 #ifndef __aarch64__
         for (int r=0; r < 16; r++)
             local_state[insn_count].mls_RegMap[r] = RA_GetMappedARMRegister(r);
 #endif
+        /*
+            Pending FPSR condition codes have to be in place before control leaves this path,
+            either through a branch or through an exception. The flush is not done inside
+            EMIT_Exception since that code is on the cold path only.
+        */
+        if (M68K_IsBranch(m68kcodeptr) || M68K_MayTrap(m68kcodeptr))
+            end = FPU_FlushFlags(end);
         end = EmitINSN(end, &m68kcodeptr, &insn_consumed);
         insn_count+=insn_consumed;
+#if EMU68_KNOWN_VALUES && defined(__aarch64__)
+        M68K_UpdateKnownValues(in_code, insn_consumed, out_code, end);
+#endif
         if (end[-1] == INSN_TO_LE(0xfffffff0))
         {
             lr_is_saved = 1;
@@ -383,7 +731,13 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
             {
                 RA_StoreDirtyFPURegs(&end);
                 RA_StoreDirtyM68kRegs(&end);
+#if EMU68_SHARED_EXITS && defined(__aarch64__)
+                /* PC update is done by the exit stub */
+                exit_stubs[exit_cnt].es_PCRel = _pc_rel;
+                end = EMIT_ResetOffsetPC(end);
+#else
                 end = EMIT_FlushPC(end);
+#endif
 #ifndef __aarch64__
                 RA_StoreCC(&end);
                 RA_StoreFPCR(&end);
@@ -404,28 +758,12 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
                 *end++ = pop((1 << REG_SR));// | (1 << REG_CTX));
                 if (!lr_is_saved)
                     *end++ = bx_lr();
+#elif EMU68_SHARED_EXITS
+                exit_stubs[exit_cnt].es_Count = insn_count;
+                exit_stubs[exit_cnt++].es_Branch = end;
+                *end++ = b(0);
 #else
-
-#if EMU68_INSN_COUNTER
-                uint8_t ctx_free = 0;
-                uint8_t ctx = RA_TryCTX(&end);
-                uint8_t tmp = RA_AllocARMRegister(&end);
-                if (ctx == 0xff)
-                {
-                    ctx = RA_AllocARMRegister(&end);
-                    *end++ = mrs(ctx, 3, 3, 13, 0, 3);
-                    ctx_free = 1;
-                }
-                *end++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-                *end++ = add64_immed(tmp, tmp, insn_count & 0xfff);
-                if (insn_count & 0xfff000)
-                    *end++ = adds64_immed_lsl12(tmp, tmp, insn_count >> 12);
-                *end++ = str64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-
-                RA_FreeARMRegister(&end, tmp);
-                if (ctx_free)
-                    RA_FreeARMRegister(&end, ctx);
-#endif
+                end = EMIT_UpdateInsnCount(end, insn_count);
                 pop_update_loc[pop_cnt++] = end;
                 *end++ = bx_lr();
 #endif
@@ -477,6 +815,7 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
         #endif
 
     }
+    end = FPU_FlushFlags(end);
     uint32_t *out_code = end;
     tmpptr = end;
     RA_FlushFPURegs(&end);
@@ -546,26 +885,28 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
     if (inner_loop)
     {
 #ifdef PISTORM
-        //*end++ = mov_immed_u16(tmp2, 0xf220, 1);
-        //*end++ = ldr_offset(tmp2, tmp2, 0x34);
-        *end++ = ldr_offset(ctx, tmp2, __builtin_offsetof(struct M68KState, IPL0));
+        *end++ = ldr_offset(ctx, tmp2, __builtin_offsetof(struct M68KState, IPL));
 #else
         *end++ = ldr_offset(ctx, tmp2, __builtin_offsetof(struct M68KState, PINT));
 #endif
     }
-#if EMU68_INSN_COUNTER
-    *end++ = ldr64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
-    *end++ = add64_immed(tmp, tmp, insn_count & 0xfff);
-    if (insn_count & 0xfff000)
-        *end++ = adds64_immed_lsl12(tmp, tmp, insn_count >> 12);
-    *end++ = str64_offset(ctx, tmp, __builtin_offsetof(struct M68KState, INSN_COUNT));
+    end = EMIT_UpdateInsnCount(end, insn_count);
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_SAMPLED
+    /* Every iteration of an inner loop is one more unit entry */
+    if (inner_loop)
+        *end++ = add64_immed(REG_INSN_COUNT, REG_INSN_COUNT, 1);
 #endif
     if (inner_loop)
     {
         uint32_t *tmpptr = end;
 #ifdef PISTORM
-        *end++ = cbnz(tmp2, arm_code - tmpptr);
-        //*end++ = tbnz(tmp2, 25, arm_code - tmpptr);
+        /* Stay in the loop as long as IRQ level is not above IPM */
+        *end++ = mrs(tmp, 3, 3, 13, 0, 2);
+        *end++ = ubfx(tmp, tmp, SRB_IPL, 3);
+        *end++ = and_immed(tmp2, tmp2, 4, 0);
+        *end++ = cmp_reg(tmp2, tmp, LSL, 0);
+        tmpptr = end;
+        *end++ = b_cc(A64_CC_LS, arm_code - tmpptr);
 #else
         *end++ = cbz(tmp2, arm_code - tmpptr);
 #endif
@@ -577,7 +918,11 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
     RA_FreeARMRegister(&end, tmp);
     RA_FlushCTX(&end);
     end = _tmpptr;
-    
+
+#if EMU68_SHARED_EXITS
+    if (exit_cnt)
+        end = EMIT_ExitStubs(end, exit_stubs, exit_cnt, pop_update_loc, &pop_cnt);
+#endif
 #endif
     epilogue_size += end - tmpptr;
 
@@ -586,12 +931,35 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
         disasm_close();
     }
 
+#if EMU68_PEEPHOLE && defined(__aarch64__)
+    {
+        uint32_t length = end - arm_code;
+        uint32_t new_length = A64_Peephole(arm_code, length, peephole_map);
+
+        if (new_length != length)
+        {
+            peephole_saved = length - new_length;
+            end = arm_code + new_length;
+
+            for (unsigned i=0; i < insn_count; i++)
+                local_state[i].mls_ARMOffset = peephole_map[local_state[i].mls_ARMOffset];
+            for (unsigned i=0; i < pop_cnt; i++)
+                pop_update_loc[i] = arm_code + peephole_map[pop_update_loc[i] - arm_code];
+            M68K_RemapExceptionCalls(arm_code, length, peephole_map);
+            for (unsigned i=0; i < pc_map_size; i++)
+                pc_map[i].pm_ARMOffset = peephole_map[pc_map[i].pm_ARMOffset];
+        }
+    }
+#endif
+
     // Put a marker at the end of translation unit
     *end++ = 0xffffffff;
 
     if (debug)
     {
         kprintf("[ICache]   Translated %d M68k instructions to %d ARM instructions\n", insn_count, (int)(end - arm_code));
+        if (peephole_saved)
+            kprintf("[ICache]   Peephole removed %d ARM instructions\n", peephole_saved);
         kprintf("[ICache]   Prologue size: %d, Epilogue size: %d, Conditionals: %d\n",
             prologue_size, epilogue_size, conditionals_count);
         kprintf("[ICache]   Mean epilogue size pro exit point: %d\n", epilogue_size / (1 + conditionals_count));
@@ -612,6 +980,9 @@ static inline uintptr_t M68K_Translate(uint16_t *m68kcodeptr)
 */
 void *M68K_TranslateNoCache(uint16_t *m68kcodeptr)
 {
+    translation_s = -1;
+    translation_fpcr_rnd = -1;
+
     uintptr_t line_length = M68K_Translate(m68kcodeptr);
     void *entry_point = (void*)temporary_arm_code;
 
@@ -625,6 +996,28 @@ void *M68K_TranslateNoCache(uint16_t *m68kcodeptr)
     return entry_point;
 } 
 
+/*
+    Release translation unit together with all bus access stubs which were patched into its code.
+    The unit has to be removed from LRU and hash lists already.
+*/
+void M68K_FreeUnit(struct M68KTranslationUnit *unit)
+{
+    struct BusStub *stub = unit->mt_BusStubs;
+
+#ifdef __aarch64__
+    REMOVE(&unit->mt_ARMIndexNode);
+#endif
+
+    while (stub)
+    {
+        struct BusStub *next = stub->bs_Next;
+        tlsf_free(jit_tlsf, stub);
+        stub = next;
+    }
+
+    tlsf_free(jit_tlsf, unit);
+}
+
 /*
     Verify if the translated code has changed since the unit was created. In order
     to do this MD5 sum of the block is compared with the previousy calculated one.
@@ -644,7 +1037,7 @@ struct M68KTranslationUnit *M68K_VerifyUnit(struct M68KTranslationUnit *unit)
         {
             REMOVE(&unit->mt_LRUNode);
             REMOVE(&unit->mt_HashNode);
-            tlsf_free(jit_tlsf, unit);
+            M68K_FreeUnit(unit);
 
             __m68k_state->JIT_UNIT_COUNT--;
             __m68k_state->JIT_CACHE_FREE = tlsf_get_free_size(jit_tlsf);
@@ -656,6 +1049,34 @@ struct M68KTranslationUnit *M68K_VerifyUnit(struct M68KTranslationUnit *unit)
     return unit;
 }
 
+/*
+    Called (through svc #0x103) when the m68k code has changed the rounding mode in FPCR. Units
+    translated for another mode are moved from their hash chain to InvalidUnits and get a key which
+    never matches, so no lookup finds them anymore and the LRU eventually releases them. The unit
+    which changed FPCR is still running, therefore nothing is freed here.
+*/
+void M68K_FPCRChanged(void)
+{
+    struct Node *n;
+    uint32_t rnd = (__m68k_state->FPCR >> 4) & 3;
+
+    ForeachNode(&LRU, n)
+    {
+        struct M68KTranslationUnit *u = (struct M68KTranslationUnit *)((intptr_t)n - __builtin_offsetof(struct M68KTranslationUnit, mt_LRUNode));
+
+        if (u->mt_FPCRMode != 0xffffffff && u->mt_FPCRMode != rnd && u->mt_Key != 0xffffffff)
+        {
+            u->mt_Key = 0xffffffff;
+            REMOVE(&u->mt_HashNode);
+            ADDHEAD(&InvalidUnits, &u->mt_HashNode);
+        }
+    }
+
+#ifdef __aarch64__
+    asm volatile("msr tpidr_el1, %0"::"r"(0xffffffff));
+#endif
+}
+
 /*
     Get M68K code unit from the instruction cache. Return NULL if code was not found and needs to be
     translated first.
@@ -667,6 +1088,30 @@ struct M68KTranslationUnit *M68K_GetTranslationUnit(uint16_t *m68kcodeptr)
     struct M68KTranslationUnit *unit = NULL, *n;
     uintptr_t hash = (uintptr_t)m68kcodeptr;
     uint16_t *orig_m68kcodeptr = m68kcodeptr;
+    uint32_t key = (uint32_t)(uintptr_t)m68kcodeptr;
+
+#if EMU68_MODE_SPECIALIZE && defined(__aarch64__)
+    /*
+        Units are translated for the current S bit. Every instruction which may change it
+        ends the unit, so checks for supervisor mode can be resolved at translation time.
+    */
+    uint64_t sr;
+    asm volatile("mrs %0, TPIDR_EL0":"=r"(sr));
+    translation_s = (sr >> SRB_S) & 1;
+    key |= translation_s;
+#else
+    translation_s = -1;
+#endif
+
+#if EMU68_FPCR_SPECIALIZE && defined(__aarch64__)
+    /*
+        FPU code is translated for the current rounding mode. Units which depend on it
+        are invalidated by M68K_FPCRChanged when the mode changes.
+    */
+    translation_fpcr_rnd = (__m68k_state->FPCR >> 4) & 3;
+#else
+    translation_fpcr_rnd = -1;
+#endif
     
     m68k_low = m68kcodeptr;
     m68k_high = m68kcodeptr;
@@ -680,7 +1125,7 @@ struct M68KTranslationUnit *M68K_GetTranslationUnit(uint16_t *m68kcodeptr)
     /* Find entry with correct address */
     ForeachNode(&ICache[hash], n)
     {
-        if (n->mt_M68kAddress == m68kcodeptr)
+        if (n->mt_Key == key)
         {
             /* Unit found? Move it to the front of LRU list */
             unit = n;
@@ -722,10 +1167,11 @@ struct M68KTranslationUnit *M68K_GetTranslationUnit(uint16_t *m68kcodeptr)
         uintptr_t line_length = M68K_Translate(m68kcodeptr);
         uintptr_t arm_insn_count = line_length/4 - 1;
 
+        uintptr_t map_length = pc_map_size * sizeof(struct M68KPCMap);
 #ifdef __aarch64__
-        uintptr_t unit_length = (line_length + 63 + sizeof(struct M68KTranslationUnit)) & ~63;
+        uintptr_t unit_length = (line_length + map_length + 63 + sizeof(struct M68KTranslationUnit)) & ~63;
 #else
-        uintptr_t unit_length = (line_length + 31 + sizeof(struct M68KTranslationUnit)) & ~31;
+        uintptr_t unit_length = (line_length + map_length + 31 + sizeof(struct M68KTranslationUnit)) & ~31;
 #endif
         do {
 #ifdef __aarch64__
@@ -745,7 +1191,7 @@ struct M68KTranslationUnit *M68K_GetTranslationUnit(uint16_t *m68kcodeptr)
                 REMOVE((struct Node *)ptr);
                 kprintf("[ICache] Requested block was %d\n", unit_length);
                 kprintf("[ICache] Run out of cache. Removing least recently used cache line node @ %p\n", ptr);
-                tlsf_free(jit_tlsf, ptr);
+                M68K_FreeUnit(ptr);
                 __m68k_state->JIT_CACHE_FREE = tlsf_get_free_size(jit_tlsf);
                 __m68k_state->JIT_UNIT_COUNT--;
                 #ifdef __aarch64__
@@ -761,20 +1207,43 @@ struct M68KTranslationUnit *M68K_GetTranslationUnit(uint16_t *m68kcodeptr)
         unit->mt_ARMEntryPoint = (void *)((uintptr_t)unit->mt_ARMEntryPoint | 0x0000001000000000);
 #endif
         unit->mt_M68kInsnCnt = insn_count;
+#if EMU68_INSN_COUNTER_SAMPLED
+        insn_count_total += insn_count;
+        unit_count_total++;
+#endif
         unit->mt_ARMInsnCnt = arm_insn_count;
         unit->mt_UseCount = 0;
         unit->mt_FetchCount = 0;
         unit->mt_M68kAddress = orig_m68kcodeptr;
+        unit->mt_Key = key;
         unit->mt_M68kLow = m68k_low;
         unit->mt_M68kHigh = m68k_high;
         unit->mt_CRC32 = CalcCRC32(m68k_low, m68k_high);
         unit->mt_PrologueSize = prologue_size;
         unit->mt_EpilogueSize = epilogue_size;
         unit->mt_Conditionals = conditionals_count;
+        unit->mt_PeepholeSaved = peephole_saved;
+        unit->mt_FPCRMode = translation_fpcr_used ? (uint32_t)translation_fpcr_rnd : 0xffffffff;
+        unit->mt_BusStubs = NULL;
         DuffCopy(&unit->mt_ARMCode[0], temporary_arm_code, line_length/4);
+        M68K_RelocateExceptionCalls(temporary_arm_code, &unit->mt_ARMCode[0], line_length/4);
+        unit->mt_PCMap = (struct M68KPCMap *)&unit->mt_ARMCode[line_length/4];
+        unit->mt_PCMapSize = pc_map_size;
+        for (unsigned i=0; i < pc_map_size; i++)
+            unit->mt_PCMap[i] = pc_map[i];
 
         ADDHEAD(&LRU, &unit->mt_LRUNode);
         ADDHEAD(&ICache[hash], &unit->mt_HashNode);
+#ifdef __aarch64__
+        {
+            uintptr_t code = (uintptr_t)&unit->mt_ARMCode[0] - (uintptr_t)jit_tlsf;
+            uint32_t reach = ((code + line_length - 1) >> ARM_INDEX_SHIFT) - (code >> ARM_INDEX_SHIFT);
+
+            ADDHEAD(&ARMIndex[code >> ARM_INDEX_SHIFT], &unit->mt_ARMIndexNode);
+            if (reach > arm_index_reach)
+                arm_index_reach = reach;
+        }
+#endif
 
         __m68k_state->JIT_UNIT_COUNT++;
         __m68k_state->JIT_CACHE_MISS++;
@@ -838,6 +1307,7 @@ void M68K_InitializeCache()
 
     kprintf("[ICache] Setting up LRU\n");
     NEWLIST(&LRU);
+    NEWLIST(&InvalidUnits);
 
     kprintf("[ICache] Setting up ICache\n");
     ICache = tlsf_malloc(tlsf, sizeof(struct List) * 65536);
@@ -845,9 +1315,100 @@ void M68K_InitializeCache()
     __m68k_state->JIT_CACHE_FREE = tlsf_get_free_size(jit_tlsf);
     kprintf("[ICache] Temporary code at %p\n", temporary_arm_code);
     local_state = tlsf_malloc(tlsf, sizeof(struct M68KLocalState)*EMU68_M68K_INSN_DEPTH*2);
+    pc_map = tlsf_malloc(tlsf, sizeof(struct M68KPCMap)*EMU68_M68K_INSN_DEPTH*2);
+#if EMU68_PEEPHOLE && defined(__aarch64__)
+    peephole_map = tlsf_malloc(tlsf, sizeof(uint32_t) * (EMU68_M68K_INSN_DEPTH * 16 * 16 + 1));
+#endif
+    M68K_InitExceptionStubs();
     kprintf("[ICache] ICache array at %p\n", ICache);
     for (int i=0; i < 65536; i++)
         NEWLIST(&ICache[i]);
+#ifdef __aarch64__
+    ARMIndex = tlsf_malloc(tlsf, sizeof(struct List) * ARM_INDEX_SIZE);
+    for (int i=0; i < ARM_INDEX_SIZE; i++)
+        NEWLIST(&ARMIndex[i]);
+#endif
+}
+
+/*
+    Find translation unit containing given ARM PC, NULL if the address is not part of any unit
+*/
+struct M68KTranslationUnit *M68K_GetUnitFromARM(uintptr_t arm_pc)
+{
+    struct Node *n;
+
+#ifdef __aarch64__
+    arm_pc &= ~0x0000001000000000;
+
+    uintptr_t offset = arm_pc - (uintptr_t)jit_tlsf;
+
+    if (offset >= (KERNEL_JIT_PAGES << 21))
+        return NULL;
+
+    uint32_t page = offset >> ARM_INDEX_SHIFT;
+    uint32_t first = page > arm_index_reach ? page - arm_index_reach : 0;
+
+    do
+    {
+        ForeachNode(&ARMIndex[page], n)
+        {
+            struct M68KTranslationUnit *unit = (struct M68KTranslationUnit *)((uintptr_t)n - __builtin_offsetof(struct M68KTranslationUnit, mt_ARMIndexNode));
+            uintptr_t code = (uintptr_t)&unit->mt_ARMCode[0];
+
+            if (arm_pc >= code && arm_pc < code + 4 * unit->mt_ARMInsnCnt)
+                return unit;
+        }
+    } while (page-- > first);
+#else
+    ForeachNode(&LRU, n)
+    {
+        struct M68KTranslationUnit *unit = (struct M68KTranslationUnit *)((uintptr_t)n - __builtin_offsetof(struct M68KTranslationUnit, mt_LRUNode));
+        uintptr_t code = (uintptr_t)&unit->mt_ARMCode[0];
+
+        if (arm_pc >= code && arm_pc < code + 4 * unit->mt_ARMInsnCnt)
+            return unit;
+    }
+#endif
+
+    return NULL;
+}
+
+/*
+    Find the m68k instruction which was being executed at given ARM PC. REG_PC is updated
+    lazily and lags behind by pm_PCRel, the map gives the exact address instead. Returns
+    1 if the ARM PC belongs to one of the translation units, 0 otherwise.
+*/
+int M68K_GetPCFromARM(uintptr_t arm_pc, uint32_t *m68k_pc)
+{
+    struct M68KTranslationUnit *unit = M68K_GetUnitFromARM(arm_pc);
+
+    if (unit == NULL)
+        return 0;
+
+#ifdef __aarch64__
+    arm_pc &= ~0x0000001000000000;
+#endif
+
+    uint32_t offset = (arm_pc - (uintptr_t)&unit->mt_ARMCode[0]) / 4;
+    int lo = 0;
+    int hi = unit->mt_PCMapSize - 1;
+
+    if (hi < 0)
+        return 0;
+
+    /* Last instruction starting at or before the offset */
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (unit->mt_PCMap[mid].pm_ARMOffset <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    *m68k_pc = unit->mt_PCMap[lo].pm_M68kPC;
+
+    return 1;
 }
 
 void M68K_DumpStats()
@@ -859,6 +1420,7 @@ void M68K_DumpStats()
     unsigned m68k_count = 0;
     unsigned arm_count = 0;
     unsigned total_arm_count = 0;
+    unsigned peephole_count = 0;
 
     if (debug)
         kprintf("[ICache] Listing translation units:\n");
@@ -867,17 +1429,20 @@ void M68K_DumpStats()
         cnt++;
         unit = (void *)((char *)n - __builtin_offsetof(struct M68KTranslationUnit, mt_LRUNode));
         if (debug)
-            kprintf("[ICache]   Unit %p, mt_UseCount=%lld, mt_FetchCount=%lld, M68K address %08x (range %08x-%08x)\n[ICache]      M68K insn count=%d, ARM insn count=%d\n", 
+            kprintf("[ICache]   Unit %p, mt_UseCount=%lld, mt_FetchCount=%lld, M68K address %08x (range %08x-%08x)\n[ICache]      M68K insn count=%d, ARM insn count=%d, peephole delta=-%d\n", 
                 (void*)unit, unit->mt_UseCount, unit->mt_FetchCount,
                 (void*)unit->mt_M68kAddress, (void*)unit->mt_M68kLow, (void*)unit->mt_M68kHigh, 
-                unit->mt_M68kInsnCnt, unit->mt_ARMInsnCnt);
+                unit->mt_M68kInsnCnt, unit->mt_ARMInsnCnt, unit->mt_PeepholeSaved);
 
         size = size + (uintptr_t)(&unit->mt_ARMCode[unit->mt_ARMInsnCnt]) - (uintptr_t)unit;
         m68k_count += unit->mt_M68kInsnCnt;
         total_arm_count += unit->mt_ARMInsnCnt;
-        arm_count += unit->mt_ARMInsnCnt - (unit->mt_PrologueSize + unit->mt_EpilogueSize);
+        peephole_count += unit->mt_PeepholeSaved;
+        if (unit->mt_ARMInsnCnt > unit->mt_PrologueSize + unit->mt_EpilogueSize)
+            arm_count += unit->mt_ARMInsnCnt - (unit->mt_PrologueSize + unit->mt_EpilogueSize);
     }
     kprintf("[ICache] In total %d units (%d bytes) in cache\n", cnt, size);
+    kprintf("[ICache] Peephole removed %d ARM instructions (%d before optimization)\n", peephole_count, total_arm_count + peephole_count);
 
     uint32_t mean = 100 * (arm_count);
     mean = mean / m68k_count;
@@ -0,0 +1,461 @@
+/*
+    Copyright © 2019 Michal Schulz <michal.schulz@gmx.de>
+    https://github.com/michalsc
+
+    This Source Code Form is subject to the terms of the
+    Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+    with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+#include "support.h"
+#include "A64.h"
+#include "M68k.h"
+
+/*
+    Post-emission peephole optimizer for a translation unit.
+
+    It is called by M68K_Translate once the unit is complete, including the
+    epilogue and the shared exit stubs, and before it is copied into the cache.
+    The disassembly printed with disasm enabled is produced while the unit is
+    being emitted, so it shows the code as it was before this pass.
+
+    The emitters produce code one instruction at a time, so the buffer contains
+    patterns which are easy to clean up once the whole unit is known:
+
+    - back-to-back add/sub immediates on the same register (e.g. REG_PC),
+    - ldr/str of adjacent offsets from the same base, merged into ldp/stp,
+    - mov into a temporary which is immediately overwritten by an ALU op,
+    - reloads of CC (TPIDR_EL0) or CTX (TPIDRRO_EL0) into a register which
+      still holds the value.
+
+    The code is split into runs at every branch and branch target. No pattern
+    crosses a run boundary, an instruction which is a branch target is never
+    the one which gets removed and all branch offsets are re-encoded after
+    compaction. Literal words are recognised when a forward pc-relative load
+    points into the gap an unconditional b jumps over (ldr; b; .quad as emitted
+    for calls of C helpers). The whole gap is kept as data, never decoded and
+    never a branch target, and the loads are re-encoded like branches. Units
+    with any other literal (adr, backward or unmatched loads) are left alone.
+    A bl always leaves the unit (shared stubs) and is only moved along with its
+    position.
+
+    The map array (length + 1 entries) returns old -> new instruction index,
+    which the caller uses to update its own offsets.
+*/
+
+#define PH_TARGET   0x80000000
+#define PH_DELETED  0x40000000
+#define PH_DATA     0x20000000
+#define PH_FLAGS    (PH_TARGET | PH_DELETED | PH_DATA)
+
+#define MRS_CC      0xd53bd040  /* mrs xN, TPIDR_EL0 */
+#define MRS_CTX     0xd53bd060  /* mrs xN, TPIDRRO_EL0 */
+#define MSR_CC      0xd51bd040  /* msr TPIDR_EL0, xN */
+#define MSR_CTX     0xd51bd060  /* msr TPIDRRO_EL0, xN */
+
+static inline int32_t sext(uint32_t value, int bits)
+{
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+/* bl into code outside of the unit */
+static inline int is_call(uint32_t insn)
+{
+    return (insn & 0xfc000000) == 0x94000000;
+}
+
+/* Returns 1 if insn is a pc-relative branch within the unit, offset stored in *offset */
+static int get_branch(uint32_t insn, int32_t *offset)
+{
+    if ((insn & 0xfc000000) == 0x14000000)          /* B */
+        *offset = sext(insn, 26);
+    else if ((insn & 0xff000010) == 0x54000000)     /* B.cond */
+        *offset = sext(insn >> 5, 19);
+    else if ((insn & 0x7e000000) == 0x34000000)     /* CBZ, CBNZ */
+        *offset = sext(insn >> 5, 19);
+    else if ((insn & 0x7e000000) == 0x36000000)     /* TBZ, TBNZ */
+        *offset = sext(insn >> 5, 14);
+    else
+        return 0;
+
+    return 1;
+}
+
+static uint32_t set_branch(uint32_t insn, int32_t offset)
+{
+    if ((insn & 0x7c000000) == 0x14000000)          /* B, BL */
+        return (insn & 0xfc000000) | (offset & 0x3ffffff);
+    else if ((insn & 0x7e000000) == 0x36000000)
+        return (insn & 0xfff8001f) | ((offset & 0x3fff) << 5);
+    else
+        return (insn & 0xff00001f) | ((offset & 0x7ffff) << 5);
+}
+
+/* Instructions after which nothing is known about register contents */
+static inline int is_barrier(uint32_t insn)
+{
+    return (insn & 0xfe000000) == 0xd6000000 ||     /* BR, BLR, RET */
+           is_call(insn) ||                         /* BL */
+           (insn & 0xff000000) == 0xd4000000 ||     /* SVC, HVC, BRK, HLT */
+           (insn & 0xffff0000) == 0x00000000;       /* UDF */
+}
+
+/* adr/adrp and literal loads mean there is data embedded in the stream */
+static inline int is_literal(uint32_t insn)
+{
+    return (insn & 0x1f000000) == 0x10000000 ||
+           (insn & 0x3b000000) == 0x18000000;
+}
+
+/* Returns size of the data in words if insn is a literal load, offset stored in *offset */
+static int get_literal(uint32_t insn, int32_t *offset)
+{
+    static const uint8_t gpr_size[4] = { 1, 2, 1, 1 };
+    static const uint8_t simd_size[4] = { 1, 2, 4, 0 };
+
+    if ((insn & 0x3b000000) != 0x18000000)
+        return 0;
+
+    *offset = sext(insn >> 5, 19);
+
+    return (insn & 0x04000000) ? simd_size[insn >> 30] : gpr_size[insn >> 30];
+}
+
+/* Branches and literal loads, both have their offset re-encoded after compaction */
+static inline int get_pcrel(uint32_t insn, int32_t *offset)
+{
+    return get_branch(insn, offset) || get_literal(insn, offset);
+}
+
+/* Conservative test whether insn may write to general purpose register reg */
+static inline int may_write(uint32_t insn, uint8_t reg)
+{
+    if ((insn & 0x0a000000) == 0x08000000)
+    {
+        return (insn & 31) == reg || ((insn >> 5) & 31) == reg ||
+               ((insn >> 10) & 31) == reg || ((insn >> 16) & 31) == reg;
+    }
+
+    return (insn & 31) == reg;
+}
+
+/* add/sub (immediate), no flags, no shift, Rd == Rn */
+static inline int is_addsub_self(uint32_t insn)
+{
+    return (insn & 0x3fc00000) == 0x11000000 && (insn & 31) == ((insn >> 5) & 31) && (insn & 31) != 31;
+}
+
+static int merge_addsub(uint32_t *insn, uint32_t next)
+{
+    if (!is_addsub_self(*insn) || !is_addsub_self(next))
+        return 0;
+
+    if (((*insn ^ next) & 0x80000000) || ((*insn ^ next) & 31))
+        return 0;
+
+    int32_t a = (*insn >> 10) & 0xfff;
+    int32_t b = (next >> 10) & 0xfff;
+    if (*insn & 0x40000000) a = -a;
+    if (next & 0x40000000) b = -b;
+    a += b;
+
+    if (a == 0 || a >= 4096 || a <= -4096)
+        return 0;
+
+    *insn &= ~0x403ffc00;
+    if (a < 0) {
+        *insn |= 0x40000000;
+        a = -a;
+    }
+    *insn |= a << 10;
+
+    return 1;
+}
+
+/* ldr/str (unsigned offset), 32 or 64 bit, into ldp/stp */
+static int merge_ldst(uint32_t *insn, uint32_t next)
+{
+    uint32_t op = *insn & 0xffc00000;
+
+    if ((op & 0xbf800000) != 0xb9000000 || (next & 0xffc00000) != op)
+        return 0;
+
+    uint8_t rt1 = *insn & 31;
+    uint8_t rt2 = next & 31;
+    uint8_t rn = (*insn >> 5) & 31;
+    uint32_t off1 = (*insn >> 10) & 0xfff;
+    uint32_t off2 = (next >> 10) & 0xfff;
+
+    if (((next >> 5) & 31) != rn || off2 != off1 + 1 || off1 > 63)
+        return 0;
+
+    if (op & 0x00400000)
+    {
+        /* Load: first one must not overwrite base, targets must differ */
+        if (rt1 == rn || rt1 == rt2)
+            return 0;
+        *insn = 0x29400000;
+    }
+    else
+        *insn = 0x29000000;
+
+    if (op & 0x40000000)
+        *insn |= 0x80000000;
+
+    *insn |= rt1 | (rn << 5) | (rt2 << 10) | (off1 << 15);
+
+    return 1;
+}
+
+/* mov T, S ; op T, T, ... --> op T, S, ... */
+static int fold_mov(uint32_t mov, uint32_t *next)
+{
+    uint32_t n = *next;
+    uint8_t t = mov & 31;
+    uint8_t s = (mov >> 16) & 31;
+
+    if ((mov & 0x7fe0ffe0) != 0x2a0003e0 || t == 31 || s == 31 || t == s)
+        return 0;
+
+    /* 32-bit mov zero-extends, so only 32-bit consumers see the same value */
+    if (!(mov & 0x80000000) && (n & 0x80000000))
+        return 0;
+
+    if ((n & 31) != t || ((n >> 5) & 31) != t)
+        return 0;
+
+    if ((n & 0x1f000000) == 0x11000000 ||                           /* add/sub (immediate) */
+        (n & 0x1f800000) == 0x12000000 ||                           /* logical (immediate) */
+        ((n & 0x1f800000) == 0x13000000 && ((n >> 29) & 3) != 1))  /* sbfm/ubfm */
+    {
+    }
+    else if ((n & 0x1f200000) == 0x0b000000 ||                      /* add/sub (shifted register) */
+             (n & 0x1f000000) == 0x0a000000)                        /* logical (shifted register) */
+    {
+        if (((n >> 16) & 31) == t)
+            return 0;
+    }
+    else
+        return 0;
+
+    *next = (n & ~(31 << 5)) | (s << 5);
+
+    return 1;
+}
+
+uint32_t A64_Peephole(uint32_t *code, uint32_t length, uint32_t *map)
+{
+    uint32_t removed = 0;
+    int32_t offset;
+
+    for (uint32_t i=0; i <= length; i++)
+        map[i] = 0;
+    map[length] = PH_TARGET;
+
+    /* Find literal pools, give up on any literal which does not sit in a gap skipped by b */
+    for (uint32_t i=0; i < length; i++)
+    {
+        if (map[i] & PH_DATA)
+            continue;
+
+        uint32_t insn = INSN_TO_LE(code[i]);
+
+        if (!is_literal(insn))
+            continue;
+
+        int size = get_literal(insn, &offset);
+        int32_t target = (int32_t)i + offset;
+        int32_t gap = -1;
+
+        if (size == 0 || offset <= 1 || target + size > (int32_t)length)
+            goto identity;
+
+        for (int32_t g = target - 1; g > (int32_t)i; g--)
+        {
+            uint32_t b_insn = INSN_TO_LE(code[g]);
+
+            if ((b_insn & 0xfc000000) == 0x14000000 && g + sext(b_insn, 26) >= target + size)
+            {
+                gap = g;
+                break;
+            }
+        }
+
+        if (gap < 0)
+            goto identity;
+
+        for (int32_t j = gap + 1; j < gap + sext(INSN_TO_LE(code[gap]), 26); j++)
+            map[j] |= PH_DATA;
+    }
+
+    /* Find branch targets, give up if there is anything we cannot follow */
+    for (uint32_t i=0; i < length; i++)
+    {
+        if (map[i] & PH_DATA)
+            continue;
+
+        uint32_t insn = INSN_TO_LE(code[i]);
+
+        if (get_branch(insn, &offset))
+        {
+            int32_t target = (int32_t)i + offset;
+            if (target < 0 || target > (int32_t)length || (map[target] & PH_DATA))
+                goto identity;
+            map[target] |= PH_TARGET;
+        }
+    }
+
+    int cc_reg = -1;
+    int ctx_reg = -1;
+
+    for (uint32_t i=0; i < length; i++)
+    {
+        if (map[i] & PH_DELETED)
+            continue;
+
+        if (map[i] & (PH_TARGET | PH_DATA))
+            cc_reg = ctx_reg = -1;
+
+        if (map[i] & PH_DATA)
+            continue;
+
+        uint32_t insn = INSN_TO_LE(code[i]);
+
+        if (get_branch(insn, &offset) || is_barrier(insn))
+        {
+            cc_reg = ctx_reg = -1;
+            continue;
+        }
+
+        if ((insn & ~31) == MRS_CC || (insn & ~31) == MRS_CTX)
+        {
+            int *known = (insn & ~31) == MRS_CC ? &cc_reg : &ctx_reg;
+            int *other = (insn & ~31) == MRS_CC ? &ctx_reg : &cc_reg;
+
+            if (*known == (int)(insn & 31))
+            {
+                map[i] |= PH_DELETED;
+                removed++;
+                continue;
+            }
+            if (*other == (int)(insn & 31))
+                *other = -1;
+            *known = insn & 31;
+            continue;
+        }
+        else if ((insn & ~31) == MSR_CC)
+        {
+            cc_reg = insn & 31;
+            continue;
+        }
+        else if ((insn & ~31) == MSR_CTX)
+        {
+            ctx_reg = insn & 31;
+            continue;
+        }
+
+        if (cc_reg != -1 && may_write(insn, cc_reg))
+            cc_reg = -1;
+        if (ctx_reg != -1 && may_write(insn, ctx_reg))
+            ctx_reg = -1;
+
+        /* Pairwise patterns: next instruction must be in the same run */
+        while (i + 1 < length && !(map[i] & PH_DELETED))
+        {
+            uint32_t j = i + 1;
+            while (j < length && (map[j] & PH_DELETED))
+                j++;
+
+            if (map[j] & (PH_TARGET | PH_DATA))
+                break;
+
+            uint32_t next = INSN_TO_LE(code[j]);
+
+            if (merge_addsub(&insn, next) || merge_ldst(&insn, next))
+            {
+                code[i] = INSN_TO_LE(insn);
+                map[j] |= PH_DELETED;
+                removed++;
+
+                /* Merged instruction may write registers the first one did not */
+                if (cc_reg != -1 && may_write(insn, cc_reg))
+                    cc_reg = -1;
+                if (ctx_reg != -1 && may_write(insn, ctx_reg))
+                    ctx_reg = -1;
+            }
+            else if (fold_mov(insn, &next))
+            {
+                code[j] = INSN_TO_LE(next);
+                map[i] |= PH_DELETED;
+                removed++;
+            }
+            else
+                break;
+        }
+    }
+
+    if (removed == 0)
+        goto identity;
+
+    /* Replace branch and literal offsets with absolute old indices */
+    for (uint32_t i=0; i < length; i++)
+    {
+        uint32_t insn = INSN_TO_LE(code[i]);
+
+        if (!(map[i] & (PH_DELETED | PH_DATA)) && get_pcrel(insn, &offset))
+            code[i] = INSN_TO_LE(set_branch(insn, (int32_t)i + offset));
+    }
+
+    /* Compact the buffer and build old -> new index map, flags are kept until re-encoding */
+    uint32_t out = 0;
+    for (uint32_t i=0; i < length; i++)
+    {
+        uint32_t flags = map[i] & (PH_DELETED | PH_DATA);
+        map[i] = out | flags;
+        if (!(flags & PH_DELETED))
+        {
+            uint32_t insn = INSN_TO_LE(code[i]);
+
+            /* Calls keep their absolute target */
+            if (!flags && is_call(insn))
+                code[i] = INSN_TO_LE(set_branch(insn, sext(insn, 26) + (int32_t)(i - out)));
+
+            code[out++] = code[i];
+        }
+    }
+    map[length] = out;
+
+    /* Re-encode branches and literal loads relative to their new position */
+    for (uint32_t i=0; i < length; i++)
+    {
+        if (map[i] & (PH_DELETED | PH_DATA))
+            continue;
+
+        uint32_t pos = map[i];
+        uint32_t insn = INSN_TO_LE(code[pos]);
+
+        if (get_pcrel(insn, &offset))
+        {
+            uint32_t target;
+            if ((insn & 0xfc000000) == 0x14000000)
+                target = insn & 0x3ffffff;
+            else if ((insn & 0x7e000000) == 0x36000000)
+                target = (insn >> 5) & 0x3fff;
+            else
+                target = (insn >> 5) & 0x7ffff;
+
+            code[pos] = INSN_TO_LE(set_branch(insn, (int32_t)(map[target] & ~PH_FLAGS) - (int32_t)pos));
+        }
+    }
+
+    for (uint32_t i=0; i < length; i++)
+        map[i] &= ~PH_FLAGS;
+
+    return out;
+
+identity:
+    for (uint32_t i=0; i <= length; i++)
+        map[i] = i;
+
+    return length;
+}
@@ -295,9 +295,13 @@ void __vectors_start(void);
 extern int debug_cnt;
 int enable_cache = 0;
 int limit_2g = 0;
+uint32_t bulk_ram_low = 0;
+uint32_t bulk_ram_high = 0;
 
 #ifdef PISTORM
 #include "ps_protocol.h"
+#include "ps_profile.h"
+#include "ps_model.h"
 #endif
 
 void _secondary_start();
@@ -429,8 +433,12 @@ void secondary_boot(void)
 #ifdef PISTORM
     if (cpu_id == 1)
     {
+#ifdef RASPI
         if (async_log)
             serial_writer();
+#else
+        (void)async_log;
+#endif
     }
     else if (cpu_id == 2)
     {
@@ -610,6 +618,20 @@ void boot(void *dtree)
                 {
                     top_of_ram = sys_memory[block].mb_Base + size;
                 }
+
+                uintptr_t bulk_low = sys_memory[block].mb_Base;
+                uintptr_t bulk_high = sys_memory[block].mb_Base + size;
+
+                if (bulk_low < EMU68_BULK_RAM_LOW)
+                    bulk_low = EMU68_BULK_RAM_LOW;
+                if (bulk_high > EMU68_BULK_RAM_HIGH)
+                    bulk_high = EMU68_BULK_RAM_HIGH;
+
+                if (bulk_high > bulk_low && bulk_high - bulk_low > bulk_ram_high - bulk_ram_low)
+                {
+                    bulk_ram_low = bulk_low;
+                    bulk_ram_high = bulk_high;
+                }
             }
         }
 
@@ -629,6 +651,7 @@ void boot(void *dtree)
 
         kprintf("[BOOT] Moving kernel from %p to %p\n", (void*)kernel_old_loc, (void*)kernel_new_loc);
         kprintf("[BOOT] Top of RAM (32bit): %08x\n", top_of_ram);
+        kprintf("[BOOT] Plain RAM for bulk transfers: %08x-%08x\n", bulk_ram_low, bulk_ram_high - 1);
 
         /*
             Copy the kernel memory block from origin to new destination, use the top of
@@ -1159,11 +1182,22 @@ struct M68KTranslationUnit *_FindUnit(uint16_t *ptr)
     return M68K_FindTranslationUnit(ptr);
 }
 
+/*
+    Look up the unit for current m68k PC without translating it, NULL if there is none. Units are
+    matched on mt_Key, with EMU68_MODE_SPECIALIZE the S bit of SR is part of it.
+*/
 void  __attribute__((used)) stub_FindUnit()
 {
     asm volatile(
 "       .align  5                           \n"
 "FindUnit:                                  \n"
+#if EMU68_MODE_SPECIALIZE
+"       mrs     x3, TPIDR_EL0               \n"
+"       ubfx    w3, w3, #%[srb_s], #1       \n" // S bit of SR
+"       orr     w3, w3, w%[reg_pc]          \n" // Unit key
+#else
+"       mov     w3, w%[reg_pc]              \n"
+#endif
 "       adrp    x4, ICache                  \n"
 "       add     x4, x4, :lo12:ICache        \n"
 "       eor     w0, w%[reg_pc], w%[reg_pc], lsr #16 \n"
@@ -1172,8 +1206,8 @@ void  __attribute__((used)) stub_FindUnit()
 "       add     x0, x0, x0, lsl #1          \n"
 "       ldr     x0, [x4, x0, lsl #3]        \n"
 "       b       1f                          \n"
-"3:     ldr     x5, [x0, #32]               \n" // 2 -> 5
-"       cmp     w5, w%[reg_pc]              \n"
+"3:     ldr     w5, [x0, #%[key]]           \n" // 2 -> 5
+"       cmp     w5, w3                      \n"
 "       b.eq    2f                          \n"
 "       mov     x0, x4                      \n"
 "1:     ldr     x4, [x0]                    \n"
@@ -1191,15 +1225,34 @@ void  __attribute__((used)) stub_FindUnit()
 "       str     x4, [x6, #8]                \n"
 "       ret                                 \n"
 
-::[reg_pc]"i"(REG_PC));
+::[reg_pc]"i"(REG_PC),
+  [key]"i"(__builtin_offsetof(struct M68KTranslationUnit, mt_Key)),
+  [srb_s]"i"(SRB_S));
 }
 
 uint32_t last_pc;
 
 //uint64_t arm_cnt;
 
-#ifdef PISTORM
-extern volatile unsigned char bus_lock;
+/*
+    With EMU68_INSN_COUNTER_REG the m68k instruction counter lives in x12 (reserved
+    with -ffixed-x12), so the entry point of the last unit is cached in M68KState
+    and loaded into x6 instead. The counter is written back on every dispatch.
+*/
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+#define UNIT_REG "x6"
+#else
+#define UNIT_REG "x12"
+#endif
+
+/*
+    With EMU68_MODE_SPECIALIZE units are looked up by m68k PC with the S bit in bit 0.
+    The key is computed into w3 once interrupts are handled.
+*/
+#if EMU68_MODE_SPECIALIZE
+#define UNIT_KEY "3"
+#else
+#define UNIT_KEY "%[reg_pc]"
 #endif
 
 void  __attribute__((used)) stub_ExecutionLoop()
@@ -1213,9 +1266,19 @@ void  __attribute__((used)) stub_ExecutionLoop()
 "       stp     x21, x22, [sp, #4*16]       \n"
 "       stp     x19, x20, [sp, #5*16]       \n"
 "       bl      M68K_LoadContext            \n"
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+"       mrs     x0, TPIDRRO_EL0             \n"
+"       ldr     x12, [x0, #%[insn_count]]   \n"
+#endif
 "       .align 6                            \n"
 "1:                                         \n"
 "       mrs     x0, TPIDRRO_EL0             \n"
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+#if EMU68_INSN_COUNTER_SAMPLED
+"       add     x12, x12, #1                \n" // Count unit entries only
+#endif
+"       str     x12, [x0, #%[insn_count]]   \n" // Publish instruction counter
+#endif
 "       mrs     x2, TPIDR_EL1               \n"
 #ifndef PISTORM
 "       cbz     w%[reg_pc], 4f              \n"
@@ -1235,23 +1298,32 @@ void  __attribute__((used)) stub_ExecutionLoop()
 #endif
 
 #ifdef PISTORM
-"       ldr     w1, [x0, #%[ipl0]]          \n" // Load ipl0 flag from context
-"       cbz     w1, 9f                      \n"
+"       ldr     w1, [x0, #%[ipl]]           \n" // Load IRQ level published by housekeeper
+"       tst     w1, #15                     \n"
+"       b.ne    9f                          \n"
 #else
 "       ldr     w1, [x0, #%[pint]]          \n" // Load pending interrupt flag
 "       cbnz    w1, 9f                      \n" // Change context if interrupt was pending
 #endif
 "99:    ldr     w1, [x0, #%[cacr]]          \n"
 "       tbz     w1, #%[cacr_ie_bit], 2f     \n"
-"       cmp     w2, w%[reg_pc]              \n"
+#if EMU68_MODE_SPECIALIZE
+"       mrs     x3, TPIDR_EL0               \n"
+"       ubfx    w3, w3, #%[srb_s], #1       \n" // S bit of SR
+"       orr     w3, w3, w%[reg_pc]          \n" // Unit key
+#endif
+"       cmp     w2, w" UNIT_KEY "                \n"
 "       b.ne    13f                         \n"
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+"       ldr     x6, [x0, #%[last_entry]]    \n"
+#endif
 #if EMU68_LOG_USES
-"       bic     x0, x12, #0x0000001000000000\n"
+"       bic     x0, " UNIT_REG ", #0x0000001000000000\n"
 "       ldr     x1, [x0, #-%[diff]]         \n"
 "       add     x1, x1, #1                  \n"
 "       str     x1, [x0, #-%[diff]]         \n"
 #endif
-"       blr     x12                         \n"
+"       blr     " UNIT_REG "                         \n"
 "       b       1b                          \n"
 
 "13:                                        \n"
@@ -1263,8 +1335,8 @@ void  __attribute__((used)) stub_ExecutionLoop()
 "       add     x0, x0, x0, lsl #1          \n"
 "       ldr     x0, [x4, x0, lsl #3]        \n"
 "       b       51f                         \n"
-"53:    ldr     x5, [x0, #32]               \n" // 2 -> 5
-"       cmp     w5, w%[reg_pc]              \n"
+"53:    ldr     w5, [x0, #%[key]]           \n" // 2 -> 5
+"       cmp     w5, w" UNIT_KEY "                \n"
 "       b.eq    52f                         \n"
 "       mov     x0, x4                      \n"
 "51:    ldr     x4, [x0]                    \n"
@@ -1281,42 +1353,53 @@ void  __attribute__((used)) stub_ExecutionLoop()
 "       str     x4, [x6, #8]                \n"
 
 "55:                                        \n"
-"       ldr     x12, [x0, #%[offset]]       \n"
+"       ldr     " UNIT_REG ", [x0, #%[offset]]       \n"
 #if EMU68_LOG_FETCHES
 "       ldr     x1, [x0, #%[fcount]]        \n"
 "       add     x1, x1, #1                  \n"
 "       str     x1, [x0, #%[fcount]]        \n"
 #endif
-"       msr     TPIDR_EL1, x%[reg_pc]       \n"
+"       msr     TPIDR_EL1, x" UNIT_KEY "         \n"
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+"       mrs     x1, TPIDRRO_EL0             \n"
+"       str     x6, [x1, #%[last_entry]]    \n"
+#endif
 #if EMU68_LOG_USES
-"       bic     x0, x12, #0x0000001000000000\n"
+"       bic     x0, " UNIT_REG ", #0x0000001000000000\n"
 "       ldr     x1, [x0, #-%[diff]]         \n"
 "       add     x1, x1, #1                  \n"
 "       str     x1, [x0, #-%[diff]]         \n"
 #endif
-"       blr     x12                         \n"
+"       blr     " UNIT_REG "                         \n"
 "       b       1b                          \n"
 
-"5:     mrs     x0, TPIDRRO_EL0             \n"
+"5:     msr     TPIDR_EL1, x" UNIT_KEY "         \n"
+"       mrs     x0, TPIDRRO_EL0             \n"
 "       bl      M68K_SaveContext            \n"
 "       mov     w0, w%[reg_pc]              \n"
-"       msr     TPIDR_EL1, x%[reg_pc]       \n"
 "       bl      M68K_GetTranslationUnit     \n"
-"       ldr     x12, [x0, #%[offset]]       \n"
+"       ldr     " UNIT_REG ", [x0, #%[offset]]       \n"
 #if EMU68_LOG_FETCHES
 "       ldr     x1, [x0, #%[fcount]]        \n"
 "       add     x1, x1, #1                  \n"
 "       str     x1, [x0, #%[fcount]]        \n"
 #endif
 "       mrs     x0, TPIDRRO_EL0             \n"
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+"       str     x6, [x0, #%[last_entry]]    \n"
+#endif
 "       bl      M68K_LoadContext            \n"
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+"       mrs     x0, TPIDRRO_EL0             \n"
+"       ldr     x6, [x0, #%[last_entry]]    \n"
+#endif
 #if EMU68_LOG_USES
-"       bic     x0, x12, #0x0000001000000000\n"
+"       bic     x0, " UNIT_REG ", #0x0000001000000000\n"
 "       ldr     x1, [x0, #-%[diff]]         \n"
 "       add     x1, x1, #1                  \n"
 "       str     x1, [x0, #-%[diff]]         \n"
 #endif
-"       blr     x12                         \n"
+"       blr     " UNIT_REG "                         \n"
 "       b       1b                          \n"
 
 
@@ -1330,21 +1413,28 @@ void  __attribute__((used)) stub_ExecutionLoop()
 "       cbnz    x0, 223f                    \n"
 "       mov     w0, w20                     \n"
 "       bl      M68K_GetTranslationUnit     \n"
-"223:   ldr     x12, [x0, #%[offset]]       \n"
+"223:   ldr     " UNIT_REG ", [x0, #%[offset]]       \n"
 #if EMU68_LOG_FETCHES
 "       ldr     x1, [x0, #%[fcount]]        \n"
 "       add     x1, x1, #1                  \n"
 "       str     x1, [x0, #%[fcount]]        \n"
 #endif
 "       mrs     x0, TPIDRRO_EL0             \n"
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+"       str     x6, [x0, #%[last_entry]]    \n"
+#endif
 "       bl      M68K_LoadContext            \n"
+#if EMU68_INSN_COUNTER && EMU68_INSN_COUNTER_REG
+"       mrs     x0, TPIDRRO_EL0             \n"
+"       ldr     x6, [x0, #%[last_entry]]    \n"
+#endif
 #if EMU68_LOG_USES
-"       bic     x0, x12, #0x0000001000000000\n"
+"       bic     x0, " UNIT_REG ", #0x0000001000000000\n"
 "       ldr     x1, [x0, #-%[diff]]         \n"
 "       add     x1, x1, #1                  \n"
 "       str     x1, [x0, #-%[diff]]         \n"
 #endif
-"       blr     x12                         \n"
+"       blr     " UNIT_REG "                         \n"
 "       b       1b                          \n"
 
 "4:     mrs     x0, TPIDRRO_EL0             \n"
@@ -1358,54 +1448,39 @@ void  __attribute__((used)) stub_ExecutionLoop()
 "       ret                                 \n"
 
 #ifdef PISTORM
-"9:                                         \n"
-#if 0
-"       adrp    x5, bus_lock                \n"
-"       add     x5, x5, :lo12:bus_lock      \n"
-"       mov     w1, 1                       \n"
-".lock: ldaxrb	w2, [x5]                    \n" // Obtain exclusive lock to the PiStorm bus
-"       stxrb	w3, w1, [x5]                \n"
-"       cbnz	w3, .lock                   \n"
-"       cbz     w2, .lock_acquired          \n"
-"       yield                               \n"
-"       b       .lock                       \n"
-".lock_acquired:                            \n"
-#endif
-"       mov     x2, #0xf2200000             \n" // GPIO base address
-
-"       mov     w1, #0x0c000000             \n"
-"       mov     w3, #0x40000000             \n"
-
-"       str     w1, [x2, #28]               \n" // Read status register
-"       str     w3, [x2, #28]               \n"
-"       str     w3, [x2, #28]               \n"
-"       str     w3, [x2, #28]               \n"
-"       str     w3, [x2, #28]               \n"
-
-"       ldr     w3, [x2, 4*13]              \n" // Get status register into w3 - note! value read was little endian
-
-"       mov     w1, #0xff00                 \n"
-"       movk    w1, #0xecff, lsl #16        \n"
-"       str     w1, [x2, 4*10]              \n"
-#if 0
-"       stlrb   wzr, [x5]                   \n" // Release exclusive lock to PiStorm bus
-#endif
-"       rev     w3, w3                      \n"
-"       ubfx    w1, w3, #21, #3             \n" // Extract IPL to w1
-
+"9:     ldr     w3, [x0, #%[ipl_taken]]     \n" // Interrupt already taken for this sample?
+"       cmp     w1, w3                      \n"
+"       b.eq    92f                         \n"
 "       mrs     x2, TPIDR_EL0               \n" // Get SR
 "       ubfx    w3, w2, %[srb_ipm], 3       \n" // Extract IPM
-"       cmp     w1, #7                      \n" // Was it level 7 interrpt?
-
-"       b.eq    91f                         \n" // Yes - process immediately
-"       cmp     w1, w3                      \n" // Check highest masked level
-"       b.gt    91f                         \n" // IPL higher than IPM? Make an interrupt
+"       and     w4, w1, #15                 \n" // Level, 15 for NMI
+"       cmp     w4, w3                      \n" // Check highest masked level
+"       b.hi    90f                         \n" // IPL higher than IPM? Make an interrupt
 
 "92:    mrs     x2, TPIDR_EL1               \n" // Only masked interrupts. Restore old contents of x2 and
 "       b       99b                         \n" // branch back
 
 // Process the interrupt here
-"91:    tbnz    w2, #%[srb_s], 93f          \n" // Check if m68k was in supervisor mode already
+"90:    str     w1, [x0, #%[ipl_taken]]     \n" // Remember the sample
+#if EMU68_IPL_LATENCY
+"       mrs     x3, CNTPCT_EL0              \n" // Ticks since IPL assertion
+"       ldr     x4, [x0, #%[ipl_stamp]]     \n"
+"       sub     x3, x3, x4                  \n"
+"       orr     x3, x3, #1                  \n"
+"       clz     x3, x3                      \n"
+"       mov     w4, #63                     \n"
+"       sub     w3, w4, w3                  \n" // Bucket is log2 of latency, at most 31
+"       mov     w4, #31                     \n"
+"       cmp     w3, w4                      \n"
+"       csel    w3, w3, w4, ls              \n"
+"       adrp    x4, ipl_latency             \n"
+"       add     x4, x4, :lo12:ipl_latency   \n"
+"       ldr     w5, [x4, x3, lsl #2]        \n"
+"       add     w5, w5, #1                  \n"
+"       str     w5, [x4, x3, lsl #2]        \n"
+#endif
+"       and     w1, w1, #7                  \n" // Extract IPL to w1
+"       tbnz    w2, #%[srb_s], 93f          \n" // Check if m68k was in supervisor mode already
 "       str     w%[reg_sp], [x0, #%[usp]]   \n" // Store USP
 "       tbnz    w2, #%[srb_m], 94f          \n" // Check if MSP is active
 "       ldr     w%[reg_sp], [x0, #%[isp]]   \n" // Load ISP
@@ -1484,11 +1559,18 @@ void  __attribute__((used)) stub_ExecutionLoop()
  [srb_s]"i"(SRB_S),
  [fcount]"i"(__builtin_offsetof(struct M68KTranslationUnit, mt_FetchCount)),
  [cacr]"i"(__builtin_offsetof(struct M68KState, CACR)),
+ [insn_count]"i"(__builtin_offsetof(struct M68KState, INSN_COUNT)),
+ [last_entry]"i"(__builtin_offsetof(struct M68KState, JIT_LAST_ENTRY)),
  [offset]"i"(__builtin_offsetof(struct M68KTranslationUnit, mt_ARMEntryPoint)),
+ [key]"i"(__builtin_offsetof(struct M68KTranslationUnit, mt_Key) -
+        __builtin_offsetof(struct M68KTranslationUnit, mt_HashNode)),
  [diff]"i"(__builtin_offsetof(struct M68KTranslationUnit, mt_ARMCode) - 
         __builtin_offsetof(struct M68KTranslationUnit, mt_UseCount)),
  [pint]"i"(__builtin_offsetof(struct M68KState, PINT)),
  [ipl0]"i"(__builtin_offsetof(struct M68KState, IPL0)),
+ [ipl]"i"(__builtin_offsetof(struct M68KState, IPL)),
+ [ipl_taken]"i"(__builtin_offsetof(struct M68KState, IPL_TAKEN)),
+ [ipl_stamp]"i"(__builtin_offsetof(struct M68KState, IPL_STAMP)),
  [sr]"i"(__builtin_offsetof(struct M68KState, SR)),
  [usp]"i"(__builtin_offsetof(struct M68KState, USP)),
  [isp]"i"(__builtin_offsetof(struct M68KState, ISP)),
@@ -1653,6 +1735,16 @@ asm volatile(
 
     M68K_DumpStats();
 
+#if defined(PISTORM) && EMU68_BUS_PROFILE
+    bp_dump();
+#endif
+#if defined(PISTORM) && EMU68_IPL_LATENCY
+    ps_dump_ipl_latency();
+#endif
+#if defined(PISTORM) && EMU68_PS_MODEL
+    ps_model_dump();
+#endif
+
     kprintf("[JIT] Number of m68k instructions executed (rough): %lld\n", __m68k.INSN_COUNT);
     kprintf("[JIT] Number of ARM cpu cycles consumed: %lld\n", cnt2 - cnt1);
 
@@ -124,14 +124,27 @@ void  __attribute__((used)) __stub_vectors()
 "                                       \n"
 "       .balign 0x80                    \n"
 "curr_el_spx_sync:                      \n" // The exception handler for a synchrous 
-        SAVE_CONTEXT                        // exception from the current EL using the
-"       mov x0, #0x200                  \n" // current SP.
+#if EMU68_FAST_ABORT                        // exception from the current EL using the
+"       stp x0, x1, [sp, -256]!         \n" // current SP. Data aborts take the short
+"       mrs x0, ESR_EL1                 \n" // path first.
+"       lsr w0, w0, #27                 \n"
+"       cmp w0, #0x12                   \n" // EC 0x24/0x25: Data abort
+"       b.eq DataAbortFast              \n"
+"       ldp x0, x1, [sp], #256          \n"
+#endif
+        SAVE_CONTEXT
+"       mov x0, #0x200                  \n"
 "       mov x1, sp                      \n"
 "       bl SYSHandler                   \n"
 "       b ExceptionExit                 \n"
 "                                       \n"
 "       .balign 0x80                    \n"
 "curr_el_spx_irq:                       \n" // The exception handler for an IRQ exception from 
+#if defined(PISTORM) && EMU68_HOUSEKEEPER_IRQ       // the current EL using the current SP. On PiStorm
+        SAVE_CONTEXT                        // only the housekeeper core takes IRQs.
+"       bl ps_housekeeper_irq           \n"
+"       b ExceptionExit                 \n"
+#else
 "       stp x0, x1, [sp, -16]!          \n" // the current EL using the current SP.
 "       mrs x0, SPSR_EL1                \n" // Get SPSR
 "       orr x0, x0, #0x080              \n" // Disable IRQ interrupt so that we are not disturbed on return
@@ -142,6 +155,7 @@ void  __attribute__((used)) __stub_vectors()
 "       str w0, [x1, #%[pint]]          \n"
 "       ldp x0, x1, [sp], #16           \n" // Restore scratch registers
 "       eret                            \n"
+#endif
 "                                       \n"
 "       .balign 0x80                    \n"
 "curr_el_spx_fiq:                       \n" // The exception handler for an FIQ from 
@@ -237,6 +251,52 @@ void  __attribute__((used)) __stub_vectors()
         LOAD_CONTEXT
 "       eret                            \n"
 "                                       \n"
+#if EMU68_FAST_ABORT
+"DataAbortFast:                         \n" // Save general purpose registers only, in
+"       stp x2, x3, [sp, #1*16]         \n" // the same layout as the full context.
+"       stp x4, x5, [sp, #2*16]         \n" // x19-x29 hold m68k registers and are
+"       stp x6, x7, [sp, #3*16]         \n" // targets of most accesses
+"       stp x8, x9, [sp, #4*16]         \n"
+"       stp x10, x11, [sp, #5*16]       \n"
+"       stp x12, x13, [sp, #6*16]       \n"
+"       stp x14, x15, [sp, #7*16]       \n"
+"       stp x16, x17, [sp, #8*16]       \n"
+"       stp x18, x19, [sp, #9*16]       \n"
+"       stp x20, x21, [sp, #10*16]      \n"
+"       stp x22, x23, [sp, #11*16]      \n"
+"       stp x24, x25, [sp, #12*16]      \n"
+"       stp x26, x27, [sp, #13*16]      \n"
+"       stp x28, x29, [sp, #14*16]      \n"
+"       str x30, [sp, #15*16]           \n"
+"       mov x0, sp                      \n"
+"       bl SYSFastDataAbort             \n"
+"       cbz w0, 1f                      \n"
+"       ldp x2, x3, [sp, #1*16]         \n"
+"       ldp x4, x5, [sp, #2*16]         \n"
+"       ldp x6, x7, [sp, #3*16]         \n"
+"       ldp x8, x9, [sp, #4*16]         \n"
+"       ldp x10, x11, [sp, #5*16]       \n"
+"       ldp x12, x13, [sp, #6*16]       \n"
+"       ldp x14, x15, [sp, #7*16]       \n"
+"       ldp x16, x17, [sp, #8*16]       \n"
+"       ldp x18, x19, [sp, #9*16]       \n"
+"       ldp x20, x21, [sp, #10*16]      \n"
+"       ldp x22, x23, [sp, #11*16]      \n"
+"       ldp x24, x25, [sp, #12*16]      \n"
+"       ldp x26, x27, [sp, #13*16]      \n"
+"       ldp x28, x29, [sp, #14*16]      \n"
+"       ldr x30, [sp, #15*16]           \n"
+"       ldp x0, x1, [sp], #256          \n"
+"       eret                            \n"
+"1:                                     \n" // Not handled, frame is unchanged. Complete
+"       mov x0, sp                      \n" // the context and take the full path
+"       str x0, [sp, #15*16+8]          \n"
+"       mov x0, #0x200                  \n"
+"       mov x1, sp                      \n"
+"       bl SYSHandler                   \n"
+"       b ExceptionExit                 \n"
+"                                       \n"
+#endif
 "       .section .text                  \n"
 :
 :[pint]"i"(__builtin_offsetof(struct M68KState, PINT))
@@ -269,6 +329,7 @@ static int getOPsize(uint32_t opcode)
 #ifdef PISTORM
 
 #include "ps_protocol.h"
+#include "ps_profile.h"
 
 #include <boards.h>
 
@@ -280,7 +341,17 @@ uint32_t overlay = 1;
 uint32_t z2_ram_autoconf = 1;
 uint64_t z2_ram_base = 0;
 
-int SYSWriteValToAddr(uint64_t value, int size, uint64_t far)
+/* Check if a transfer of length bytes stays in chip RAM and can be done as one bus burst */
+int SYSIsChipBurst(uint64_t far, int length)
+{
+    if ((far >> 32) == 1 || (far >> 32) == 0xffffffff) {
+        far &= 0xffffffff;
+    }
+
+    return far + length <= 0x200000;
+}
+
+static int SYSWriteValToAddrInt(uint64_t value, int size, uint64_t far)
 {
     D(kprintf("[JIT:SYS] SYSWriteValToAddr(0x%x, %d, %p)\n", value, size, far));
 
@@ -346,14 +417,20 @@ int SYSWriteValToAddr(uint64_t value, int size, uint64_t far)
             ps_write_32(far, value);
             break;
         case 8:
-            ps_write_32(far, value >> 32);
-            ps_write_32(far + 4, value & 0xffffffff);
+            if (SYSIsChipBurst(far, 8)) {
+                value = BE64(value);
+                ps_write_block(far, &value, 8);
+            }
+            else {
+                ps_write_32(far, value >> 32);
+                ps_write_32(far + 4, value & 0xffffffff);
+            }
             break;
     }
     return 1;
 }
 
-int SYSReadValFromAddr(uint64_t *value, int size, uint64_t far)
+static int SYSReadValFromAddrInt(uint64_t *value, int size, uint64_t far)
 {  
     D(kprintf("[JIT:SYS] SYSReadValFromAddr(%d, %p)\n", size, far));
 
@@ -424,15 +501,83 @@ int SYSReadValFromAddr(uint64_t *value, int size, uint64_t far)
             *value = ps_read_32(far);
             break;
         case 8:
-            a = ps_read_32(far);
-            b = ps_read_32(far + 4);
-            *value = (a << 32) | b;
+            if (SYSIsChipBurst(far, 8)) {
+                ps_read_block(far, value, 8);
+                *value = BE64(*value);
+            }
+            else {
+                a = ps_read_32(far);
+                b = ps_read_32(far + 4);
+                *value = (a << 32) | b;
+            }
             break;
     }
 
     return 1;
 }
 
+int SYSWriteValToAddr(uint64_t value, int size, uint64_t far)
+{
+    struct BusProfileStamp t0 = bp_start();
+    int handled = SYSWriteValToAddrInt(value, size, far);
+
+    bp_account(BPL_FAULT, far, size, 1, t0);
+
+    return handled;
+}
+
+int SYSReadValFromAddr(uint64_t *value, int size, uint64_t far)
+{
+    struct BusProfileStamp t0 = bp_start();
+    int handled = SYSReadValFromAddrInt(value, size, far);
+
+    bp_account(BPL_FAULT, far, size, 0, t0);
+
+    return handled;
+}
+
+/*
+    Bus accessors called directly from translated code for absolute addresses in chip RAM
+    and autoconfig space, see EMIT_BusAccess. They keep the special cases of the fault path
+    (overlay, autoconfig, OVL bit) but skip the exception and opcode decoding.
+*/
+uint32_t SYSBusRead(uint32_t address, uint32_t size)
+{
+    uint64_t value = 0;
+
+    SYSReadValFromAddr(&value, size, address);
+
+    return value;
+}
+
+void SYSBusWrite(uint32_t address, uint32_t value, uint32_t size)
+{
+    SYSWriteValToAddr(value, size, address);
+}
+
+/*
+    Burst transfers for ranges which lie completely in chip RAM, see SYSIsChipBurst. The buffer
+    holds the data in m68k byte order. Reads below 0x80000 are served from ROM while the overlay
+    is active.
+*/
+void SYSBusReadBlock(uint32_t address, void *buffer, uint32_t length)
+{
+    uint8_t *buf = buffer;
+
+    while (length && rom_mapped && overlay && address < 0x80000) {
+        *buf++ = *(uint8_t*)(0xffffff9000f80000 + address++);
+        length--;
+    }
+
+    if (length)
+        ps_read_block(address, buf, length);
+}
+
+void SYSBusWriteBlock(uint32_t address, const void *buffer, uint32_t length)
+{
+    ps_write_block(address, buffer, length);
+}
+
 #else
 
 int SYSWriteValToAddr(uint64_t value, int size, uint64_t far)
@@ -533,19 +678,84 @@ int SYSValidateUnit(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t spsr,
     return 0;
 }
 
-int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t spsr, uint64_t esr, uint64_t far)
+/*
+    Load/store both registers of a pair. If the range is in chip RAM the pair goes over the bus
+    as one burst, otherwise each register is transferred through read_val/write_val.
+*/
+static int SYSReadPair(uint64_t *v1, uint64_t *v2, int size, uint64_t far,
+    int (*read_val)(uint64_t *, int, uint64_t))
 {
-    int writeFault = (esr & (1 << 6)) != 0;
-    int handled = 0;
-    int size = 0;
-    uint64_t value = 0;
-    uint32_t opcode = LE32(*(uint32_t *)elr);
-    (void)vector;
-    (void)spsr;
+#ifdef PISTORM
+    if (SYSIsChipBurst(far, 2 * size))
+    {
+        union {
+            uint64_t u64[2];
+            uint32_t u32[4];
+        } buf;
 
-    size = getOPsize(opcode);
+        SYSBusReadBlock(far, &buf, 2 * size);
 
-    D(kprintf("[JIT:SYS] Fage fault: opcode %08x, %s %p\n", opcode, writeFault ? "write to" : "read from", far));
+        if (size == 8) {
+            *v1 = BE64(buf.u64[0]);
+            *v2 = BE64(buf.u64[1]);
+        }
+        else {
+            *v1 = BE32(buf.u32[0]);
+            *v2 = BE32(buf.u32[1]);
+        }
+
+        return 1;
+    }
+#endif
+
+    int handled = read_val(v1, size, far);
+    handled &= read_val(v2, size, far + size);
+
+    return handled;
+}
+
+static int SYSWritePair(uint64_t v1, uint64_t v2, int size, uint64_t far,
+    int (*write_val)(uint64_t, int, uint64_t))
+{
+#ifdef PISTORM
+    if (SYSIsChipBurst(far, 2 * size))
+    {
+        union {
+            uint64_t u64[2];
+            uint32_t u32[4];
+        } buf;
+
+        if (size == 8) {
+            buf.u64[0] = BE64(v1);
+            buf.u64[1] = BE64(v2);
+        }
+        else {
+            buf.u32[0] = BE32(v1);
+            buf.u32[1] = BE32(v2);
+        }
+
+        SYSBusWriteBlock(far, &buf, 2 * size);
+
+        return 1;
+    }
+#endif
+
+    int handled = write_val(v1, size, far);
+    handled &= write_val(v2, size, far + size);
+
+    return handled;
+}
+
+/*
+    Emulate a load/store instruction accessing given address. Register context is updated
+    the same way the instruction would do it, memory is accessed through read_val/write_val.
+*/
+static int SYSEmulateAccess(uint64_t *ctx, uint32_t opcode, int writeFault, uint64_t far,
+    int (*read_val)(uint64_t *, int, uint64_t), int (*write_val)(uint64_t, int, uint64_t))
+{
+    int handled = 0;
+    int size = getOPsize(opcode);
+    uint64_t value = 0;
 
     if (writeFault)
     {
@@ -562,7 +772,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (ptr + offset != far)
                 kprintf("address mismatch in STUR!\n");
 
-            handled = SYSWriteValToAddr(value, size, far);
+            handled = write_val(value, size, far);
         }
         /* STR immediate post index */
         else if ((opcode & 0x3fe00c00) == 0x38000400)
@@ -578,7 +788,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (ptr != far)
                 kprintf("address mismatch in STR immediate post index far = %08x, reg = %08x, off = %d!\n", far, ptr, offset);
 
-            handled = SYSWriteValToAddr(value, size, far);
+            handled = write_val(value, size, far);
             
             ctx[(opcode >> 5) & 31] += offset;
         }
@@ -598,7 +808,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
 
             ctx[(opcode >> 5) & 31] += offset;
 
-            handled = SYSWriteValToAddr(value, size, far);
+            handled = write_val(value, size, far);
         }
         /* STR unsigned offset */
         else if ((opcode & 0x3fc00000) == 0x39000000)
@@ -613,7 +823,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (ptr + offset != far)
                 kprintf("address mismatch in STR unsigned offset far = %08x, reg = %08x, off = %d!\n", far, ptr, offset);
 
-            handled = SYSWriteValToAddr(value, size, far);
+            handled = write_val(value, size, far);
         }
         /* STR register */
         else if ((opcode & 0x3fe00c00) == 0x38200800)
@@ -623,7 +833,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             else
                 value = ctx[opcode & 31];
 
-            handled = SYSWriteValToAddr(value, size, far);
+            handled = write_val(value, size, far);
         }
         /* ST(L)XR register - no exclusive in this case!!! But m68k bus does not support it anyway */
         else if ((opcode & 0x3fe07c00) == 0x08007c00)
@@ -636,7 +846,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             // Mark the store as successful
             ctx[(opcode >> 16) & 31] = 0;
 
-            handled = SYSWriteValToAddr(value, size, far);
+            handled = write_val(value, size, far);
         }
         /* STP */
         else if ((opcode & 0x7fc00000) == 0x29000000)
@@ -651,19 +861,19 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (ptr + offset != far)
                 kprintf("address mismatch in STP offset far = %08x, reg = %08x, off = %d!\n", far, ptr, offset);
 
+            uint64_t value2;
+
             if ((opcode & 31) == 31)
                 value = 0;
             else
                 value = ctx[opcode & 31];
 
-            handled = SYSWriteValToAddr(value, size, far);
-
             if (((opcode >> 10) & 31) == 31)
-                value = 0;
+                value2 = 0;
             else
-                value = ctx[(opcode >> 10) & 31];
-            
-            handled &= SYSWriteValToAddr(value, size, far + size);
+                value2 = ctx[(opcode >> 10) & 31];
+
+            handled = SYSWritePair(value, value2, size, far, write_val);
         }
         /* STP post index */
         else if ((opcode & 0x7fc00000) == 0x28800000)
@@ -682,19 +892,19 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
 
             ctx[(opcode >> 5) & 31] += offset;
 
+            uint64_t value2;
+
             if ((opcode & 31) == 31)
                 value = 0;
             else
                 value = ctx[opcode & 31];
 
-            handled = SYSWriteValToAddr(value, size, far);
-
             if (((opcode >> 10) & 31) == 31)
-                value = 0;
+                value2 = 0;
             else
-                value = ctx[(opcode >> 10) & 31];
-            
-            handled &= SYSWriteValToAddr(value, size, far + size);
+                value2 = ctx[(opcode >> 10) & 31];
+
+            handled = SYSWritePair(value, value2, size, far, write_val);
         }
         /* STP pre index */
         else if ((opcode & 0x7fc00000) == 0x29800000)
@@ -713,19 +923,19 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
 
             ctx[(opcode >> 5) & 31] += offset;
             
+            uint64_t value2;
+
             if ((opcode & 31) == 31)
                 value = 0;
             else
                 value = ctx[opcode & 31];
 
-            handled = SYSWriteValToAddr(value, size, far);
-
             if (((opcode >> 10) & 31) == 31)
-                value = 0;
+                value2 = 0;
             else
-                value = ctx[(opcode >> 10) & 31];
-            
-            handled &= SYSWriteValToAddr(value, size, far + size);
+                value2 = ctx[(opcode >> 10) & 31];
+
+            handled = SYSWritePair(value, value2, size, far, write_val);
         }
     }
     else
@@ -743,8 +953,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (ptr + offset != far)
                 kprintf("address mismatch in LDP offset far = %08x, reg = %08x, off = %d!\n", far, ptr, offset);
             
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
-            handled &= SYSReadValFromAddr(&ctx[(opcode >> 10) & 31], size, far + size);    
+            handled = SYSReadPair(&ctx[opcode & 31], &ctx[(opcode >> 10) & 31], size, far, read_val);
         }
         /* LDP post- and pre-index */
         else if ((opcode & 0x7ec00000) == 0x28c00000)
@@ -769,8 +978,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
                     kprintf("address mismatch in LDP post index far = %08x, reg = %08x, off = %d!\n", far, ptr, offset);
             }
 
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
-            handled &= SYSReadValFromAddr(&ctx[(opcode >> 10) & 31], size, far + size);
+            handled = SYSReadPair(&ctx[opcode & 31], &ctx[(opcode >> 10) & 31], size, far, read_val);
                 
             ctx[(opcode >> 5) & 31] += offset;
         }
@@ -784,12 +992,12 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (ptr + offset != far)
                 kprintf("address mismatch in LDPSW offset far = %08x, reg = %08x, off = %d!\n", far, ptr, offset);
 
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled) {
                 if (ctx[opcode & 31] & 0x80000000)
                     ctx[opcode & 31] |= 0xffffffff00000000ULL;
             }
-            handled &= SYSReadValFromAddr(&ctx[(opcode >> 10) & 31], size, far + size);
+            handled &= read_val(&ctx[(opcode >> 10) & 31], size, far + size);
             if (handled) {
                 if (ctx[(opcode >> 10) & 31] & 0x80000000)
                     ctx[(opcode >> 10) & 31] |= 0xffffffff00000000ULL;
@@ -806,12 +1014,12 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (ptr != far)
                 kprintf("address mismatch in LDPSW post index far = %08x, reg = %08x, off = %d!\n", far, ptr, offset);
 
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled) {
                 if (ctx[opcode & 31] & 0x80000000)
                     ctx[opcode & 31] |= 0xffffffff00000000ULL;
             }
-            handled &= SYSReadValFromAddr(&ctx[(opcode >> 10) & 31], size, far + size);
+            handled &= read_val(&ctx[(opcode >> 10) & 31], size, far + size);
             if (handled) {
                 if (ctx[(opcode >> 10) & 31] & 0x80000000)
                     ctx[(opcode >> 10) & 31] |= 0xffffffff00000000ULL;
@@ -829,12 +1037,12 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (ptr + offset != far)
                 kprintf("address mismatch in LDPSW pre index far = %08x, reg = %08x, off = %d!\n", far, ptr, offset);
 
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled) {
                 if (ctx[opcode & 31] & 0x80000000)
                     ctx[opcode & 31] |= 0xffffffff00000000ULL;
             }
-            handled &= SYSReadValFromAddr(&ctx[(opcode >> 10) & 31], size, far + size);
+            handled &= read_val(&ctx[(opcode >> 10) & 31], size, far + size);
             if (handled) {
                 if (ctx[(opcode >> 10) & 31] & 0x80000000)
                     ctx[(opcode >> 10) & 31] |= 0xffffffff00000000ULL;
@@ -852,7 +1060,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (opcode & 0x80000000)
                 sext = 1;
             
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled & sext) {
                 if (ctx[opcode & 31] & 0x80000000)
                     ctx[opcode & 31] |= 0xffffffff00000000ULL;
@@ -861,29 +1069,29 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
         /* LDR register */
         else if ((opcode & 0x3fe00c00) == 0x38600800)
         {
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
         }
         /* LDXR register - no exclusive in this case!!! But m68k bus does not support it anyway */
         else if ((opcode & 0x3ffffc00) == 0x085f7c00)
         {
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
         }
         /* LDR immediate */
         else if ((opcode & 0x3fc00000) == 0x39400000)
         {
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
         }
         /* LDUR(B/W) */
         else if ((opcode & 0x3fe00c00) == 0x38400000)
         {
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
         }
         /* LDR immediate, post- and pre-index */
         else if ((opcode & 0x3fe00400) == 0x38400400)
         {
             int16_t offset = ((int16_t)(opcode >> 5)) >> 7;
             
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled)
                 ctx[(opcode >> 5) & 31] += offset;
         }
@@ -894,7 +1102,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (opcode & (1 << 22))
                 sext64 = 0;
             
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled) {
                 int sext = 0;
                 switch (size)
@@ -924,7 +1132,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (opcode & (1 << 22))
                 sext64 = 0;
             
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled) {
                 int sext = 0;
                 switch (size)
@@ -954,7 +1162,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (opcode & (1 << 22))
                 sext64 = 0;
             
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled) {
                 int sext = 0;
                 switch (size)
@@ -985,7 +1193,7 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
             if (opcode & (1 << 22))
                 sext64 = 0;
             
-            handled = SYSReadValFromAddr(&ctx[opcode & 31], size, far);
+            handled = read_val(&ctx[opcode & 31], size, far);
             if (handled) {
                 int sext = 0;
                 switch (size)
@@ -1012,9 +1220,338 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
         }
     }
 
+    return handled;
+}
+
+#if EMU68_BUS_PATCHING
+
+/*
+    Fetch the address accessed by a load/store from the register context. Returns 0 if the
+    instruction form is not redirected to bus access stubs, 1 otherwise.
+*/
+static int SYSDecodeAccess(uint32_t opcode, uint64_t *ctx, uint64_t *addr, int *is_write)
+{
+    uint8_t rt = opcode & 31;
+    uint8_t rn = (opcode >> 5) & 31;
+    int size = getOPsize(opcode);
+    uint64_t base;
+
+    /* SIMD/FP accesses and SP based addressing never go to the bus */
+    if ((opcode & 0x04000000) || rn == 31)
+        return 0;
+
+    base = ctx[rn];
+
+    /* LDR/STR (unsigned offset), including sign extending loads */
+    if ((opcode & 0x3f000000) == 0x39000000)
+    {
+        *is_write = ((opcode >> 22) & 3) == 0;
+        *addr = base + ((opcode >> 10) & 0xfff) * size;
+    }
+    /* LDR/STR register */
+    else if ((opcode & 0x3f200c00) == 0x38200800)
+    {
+        uint8_t rm = (opcode >> 16) & 31;
+        uint64_t index = rm == 31 ? 0 : ctx[rm];
+
+        switch ((opcode >> 13) & 7)
+        {
+            case 2: /* UXTW */
+                index = (uint32_t)index;
+                break;
+            case 3: /* LSL */
+            case 7: /* SXTX */
+                break;
+            case 6: /* SXTW */
+                index = (int64_t)(int32_t)index;
+                break;
+            default:
+                return 0;
+        }
+
+        if (opcode & (1 << 12))
+            index <<= __builtin_ctz(size);
+
+        *is_write = ((opcode >> 22) & 3) == 0;
+        *addr = base + index;
+    }
+    /* LDUR/STUR and LDR/STR immediate, post- and pre-index */
+    else if ((opcode & 0x3f200000) == 0x38000000 && ((opcode >> 10) & 3) != 2)
+    {
+        int16_t offset = ((int16_t)(opcode >> 5)) >> 7;
+
+        *is_write = ((opcode >> 22) & 3) == 0;
+        *addr = ((opcode >> 10) & 3) == 1 ? base : base + offset;
+    }
+    /* LDP/STP/LDPSW signed offset, post- and pre-index */
+    else if ((opcode & 0x3e000000) == 0x28000000 && (opcode & 0x01800000) != 0)
+    {
+        int16_t offset = ((int16_t)(opcode >> 6)) >> 9;
+
+        size = (opcode & 0x80000000) ? 8 : 4;
+        offset *= size;
+
+        /* Second register of a load pair must not be XZR either */
+        if ((opcode & (1 << 22)) && ((opcode >> 10) & 31) == 31)
+            return 0;
+
+        *is_write = !(opcode & (1 << 22));
+        *addr = (opcode & 0x01800000) == 0x00800000 ? base : base + offset;
+    }
+    else
+        return 0;
+
+    /* Loads to XZR would overwrite the saved flags in the stub context */
+    if (!*is_write && rt == 31)
+        return 0;
+
+    return 1;
+}
+
+/*
+    A patched instruction can be reached later with an address backed by plain RAM, e.g. when
+    the same (An) access touches chip RAM first and fast RAM afterwards. Such accesses are done
+    directly, everything else is forwarded to the bus.
+*/
+static int SYSIsMapped(uint64_t addr, int write)
+{
+    uint64_t par;
+
+    if (write)
+        asm volatile("at s1e1w, %1; isb; mrs %0, PAR_EL1":"=r"(par):"r"(addr));
+    else
+        asm volatile("at s1e1r, %1; isb; mrs %0, PAR_EL1":"=r"(par):"r"(addr));
+
+    return (par & 1) == 0;
+}
+
+static int SYSPatchedRead(uint64_t *value, int size, uint64_t far)
+{
+    if (!SYSIsMapped(far, 0) || !SYSIsMapped(far + size - 1, 0))
+        return SYSReadValFromAddr(value, size, far);
+
+    switch (size)
+    {
+        case 1:
+            *value = *(volatile uint8_t *)far;
+            break;
+        case 2:
+            *value = *(volatile uint16_t *)far;
+            break;
+        case 4:
+            *value = *(volatile uint32_t *)far;
+            break;
+        case 8:
+            *value = *(volatile uint64_t *)far;
+            break;
+    }
+
+    return 1;
+}
+
+static int SYSPatchedWrite(uint64_t value, int size, uint64_t far)
+{
+    if (!SYSIsMapped(far, 1) || !SYSIsMapped(far + size - 1, 1))
+        return SYSWriteValToAddr(value, size, far);
+
+    switch (size)
+    {
+        case 1:
+            *(volatile uint8_t *)far = value;
+            break;
+        case 2:
+            *(volatile uint16_t *)far = value;
+            break;
+        case 4:
+            *(volatile uint32_t *)far = value;
+            break;
+        case 8:
+            *(volatile uint64_t *)far = value;
+            break;
+    }
+
+    return 1;
+}
+
+/* After that many accesses in a row to plain RAM the original instruction is put back */
+#define BUS_STUB_MAX_MISSES 16
+
+/*
+    Called from SYSBusTrampoline with the register context of translated code. Performs
+    the access of the instruction which was replaced by a branch to the stub. A site which
+    keeps hitting plain RAM is restored, its accesses are faster without the detour.
+*/
+int __attribute__((used)) SYSBusAccess(uint32_t *code, uint64_t *ctx)
+{
+    struct BusStub *stub = (struct BusStub *)(((uintptr_t)code & ~0x0000001000000000) - __builtin_offsetof(struct BusStub, bs_Code));
+    uint32_t opcode = stub->bs_Code[6];
+    uint64_t far;
+    int is_write;
+
+    if (!SYSDecodeAccess(opcode, ctx, &far, &is_write))
+        return 0;
+
+    if (!SYSIsMapped(far, is_write))
+        stub->bs_Misses = 0;
+    else if (++stub->bs_Misses == BUS_STUB_MAX_MISSES)
+    {
+        *stub->bs_Site = LE32(opcode);
+
+        arm_flush_cache((uintptr_t)stub->bs_Site, 4);
+        arm_icache_invalidate((uintptr_t)stub->bs_Site | 0x0000001000000000, 4);
+    }
+
+    return SYSEmulateAccess(ctx, opcode, is_write, far, SYSPatchedRead, SYSPatchedWrite);
+}
+
+/*
+    Common part of all bus access stubs. On entry x0 holds the address of the stub code
+    instruction, original x0 and x30 are on the stack. The context is built in the same
+    layout as the exception frame, with NZCV kept in slot 31. x0 and x30 are written back
+    to the stub frame, the stub restores them itself.
+*/
+void  __attribute__((used)) __stub_bus_trampoline()
+{ asm volatile(
+"       .globl SYSBusTrampoline         \n"
+"SYSBusTrampoline:                      \n"
+"       str x30, [sp, #-16]!            \n"
+"       sub sp, sp, #256                \n"
+"       str x1, [sp, #8]                \n"
+"       stp x2, x3, [sp, #1*16]         \n"
+"       stp x4, x5, [sp, #2*16]         \n"
+"       stp x6, x7, [sp, #3*16]         \n"
+"       stp x8, x9, [sp, #4*16]         \n"
+"       stp x10, x11, [sp, #5*16]       \n"
+"       stp x12, x13, [sp, #6*16]       \n"
+"       stp x14, x15, [sp, #7*16]       \n"
+"       stp x16, x17, [sp, #8*16]       \n"
+"       stp x18, x19, [sp, #9*16]       \n"
+"       stp x20, x21, [sp, #10*16]      \n"
+"       stp x22, x23, [sp, #11*16]      \n"
+"       stp x24, x25, [sp, #12*16]      \n"
+"       stp x26, x27, [sp, #13*16]      \n"
+"       stp x28, x29, [sp, #14*16]      \n"
+"       ldp x2, x3, [sp, #272]          \n" // Original x0 and x30 saved by the stub
+"       str x2, [sp, #0]                \n"
+"       mrs x4, nzcv                    \n"
+"       stp x3, x4, [sp, #15*16]        \n"
+"       mov x1, sp                      \n"
+"       bl SYSBusAccess                 \n"
+"       ldp x3, x4, [sp, #15*16]        \n"
+"       msr nzcv, x4                    \n"
+"       ldr x2, [sp, #0]                \n"
+"       stp x2, x3, [sp, #272]          \n" // Stub reloads x0 and x30 from there
+"       ldr x1, [sp, #8]                \n"
+"       ldp x2, x3, [sp, #1*16]         \n"
+"       ldp x4, x5, [sp, #2*16]         \n"
+"       ldp x6, x7, [sp, #3*16]         \n"
+"       ldp x8, x9, [sp, #4*16]         \n"
+"       ldp x10, x11, [sp, #5*16]       \n"
+"       ldp x12, x13, [sp, #6*16]       \n"
+"       ldp x14, x15, [sp, #7*16]       \n"
+"       ldp x16, x17, [sp, #8*16]       \n"
+"       ldp x18, x19, [sp, #9*16]       \n"
+"       ldp x20, x21, [sp, #10*16]      \n"
+"       ldp x22, x23, [sp, #11*16]      \n"
+"       ldp x24, x25, [sp, #12*16]      \n"
+"       ldp x26, x27, [sp, #13*16]      \n"
+"       ldp x28, x29, [sp, #14*16]      \n"
+"       add sp, sp, #256                \n"
+"       ldr x30, [sp], #16              \n"
+"       ret                             \n"
+);}
+
+/*
+    Replace the load/store at elr with a branch to an out-of-line stub calling SYSBusTrampoline.
+    The stub is owned by the translation unit and released together with it. A site restored
+    by SYSBusAccess keeps its stub and is not patched again.
+*/
+static void SYSPatchBusAccess(uint64_t elr, uint32_t opcode)
+{
+    extern void *jit_tlsf;
+    extern void SYSBusTrampoline();
+    struct M68KTranslationUnit *unit = M68K_GetUnitFromARM(elr);
+    uintptr_t site = elr & ~0x0000001000000000;
+    uint64_t trampoline = (uintptr_t)SYSBusTrampoline;
+    uintptr_t stub_exec;
+    struct BusStub *stub;
+
+    /* Code outside of translation units (e.g. M68K_TranslateNoCache) is never patched */
+    if (unit == NULL)
+        return;
+
+    for (stub = unit->mt_BusStubs; stub; stub = stub->bs_Next)
+    {
+        if (stub->bs_Site == (uint32_t *)site)
+            return;
+    }
+
+    stub = tlsf_malloc_aligned(jit_tlsf, sizeof(struct BusStub), 16);
+    if (stub == NULL)
+        return;
+
+    stub_exec = (uintptr_t)&stub->bs_Code[0] | 0x0000001000000000;
+
+    stub->bs_Code[0] = stp64_preindex(31, 0, 30, -16);
+    stub->bs_Code[1] = adr(0, -4);
+    stub->bs_Code[2] = ldr64_pcrel(30, 6);
+    stub->bs_Code[3] = blr(30);
+    stub->bs_Code[4] = ldp64_postindex(31, 0, 30, 16);
+    stub->bs_Code[5] = b((int64_t)(elr + 4 - (stub_exec + 20)) >> 2);
+    stub->bs_Code[6] = opcode;
+    stub->bs_Code[7] = 0;
+    memcpy(&stub->bs_Code[8], &trampoline, sizeof(trampoline));
+
+    stub->bs_Site = (uint32_t *)site;
+    stub->bs_Misses = 0;
+    stub->bs_Next = unit->mt_BusStubs;
+    unit->mt_BusStubs = stub;
+
+    arm_flush_cache((uintptr_t)stub, sizeof(struct BusStub));
+    arm_icache_invalidate(stub_exec, sizeof(stub->bs_Code));
+
+    *(uint32_t *)site = b((int64_t)(stub_exec - elr) >> 2);
+
+    arm_flush_cache(site, 4);
+    arm_icache_invalidate(elr, 4);
+}
+
+#endif
+
+int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t spsr, uint64_t esr, uint64_t far)
+{
+    int writeFault = (esr & (1 << 6)) != 0;
+    int handled = 0;
+    uint32_t opcode = LE32(*(uint32_t *)elr);
+    (void)vector;
+    (void)spsr;
+
+    D(kprintf("[JIT:SYS] Fage fault: opcode %08x, %s %p\n", opcode, writeFault ? "write to" : "read from", far));
+
+#if EMU68_BUS_PATCHING
+    /* Decode before the access, it may update the base register */
+    uint64_t addr = 0;
+    int is_write = 0;
+    int patch = SYSDecodeAccess(opcode, ctx, &addr, &is_write) && addr == far && is_write == writeFault;
+#endif
+
+#ifdef PISTORM
+    bp_record_pc(elr);
+#endif
+
+    handled = SYSEmulateAccess(ctx, opcode, writeFault, far, SYSReadValFromAddr, SYSWriteValToAddr);
+
+#if EMU68_BUS_PATCHING
+    if (handled && patch)
+        SYSPatchBusAccess(elr, opcode);
+#endif
+
     if (!handled)
     {    
+        uint32_t m68k_pc = 0;
         kprintf("[JIT:SYS] Unhandled page fault: opcode %08x, %s %p\n", opcode, writeFault ? "write to" : "read from", far);
+        if (M68K_GetPCFromARM(elr, &m68k_pc))
+            kprintf("[JIT:SYS] Faulting m68k instruction at %08x\n", m68k_pc);
     }
 
     elr += 4;
@@ -1023,6 +1560,199 @@ int SYSPageFaultHandler(uint32_t vector, uint64_t *ctx, uint64_t elr, uint64_t s
     return handled;
 }
 
+#if EMU68_FAST_ABORT
+
+#define DA_CACHE_SIZE   64
+
+#define DA_STORE        1   /* Store, otherwise load */
+#define DA_PAIR         2   /* Second register at far + size */
+#define DA_SEXT         4   /* Sign extend loaded value to 32 bits */
+#define DA_SEXT64       8   /* Sign extend loaded value to 64 bits */
+
+/* Decoded form of a faulting load/store, keyed by its address and opcode */
+struct DecodedAccess {
+    uint64_t    da_ELR;
+    uint32_t    da_Opcode;
+    int16_t     da_Writeback;   /* Added to base register after the access */
+    uint8_t     da_Size;
+    uint8_t     da_Flags;
+    uint8_t     da_Rt;
+    uint8_t     da_Rt2;
+    uint8_t     da_Rn;
+};
+
+static struct DecodedAccess da_cache[DA_CACHE_SIZE];
+
+/*
+    Decode the load/store forms used by translated code. Returns 0 for anything else, such
+    accesses are left to SYSPageFaultHandler.
+*/
+static int SYSDecodeForCache(uint32_t opcode, struct DecodedAccess *da)
+{
+    uint8_t opc = (opcode >> 22) & 3;
+
+    da->da_Size = getOPsize(opcode);
+    da->da_Flags = 0;
+    da->da_Writeback = 0;
+    da->da_Rt = opcode & 31;
+    da->da_Rt2 = 0xff;
+    da->da_Rn = (opcode >> 5) & 31;
+
+    if ((opcode & 0x04000000) || da->da_Rn == 31)
+        return 0;
+
+    /* Single register forms: unsigned offset, register offset, unscaled, post- and pre-index */
+    if ((opcode & 0x3f000000) == 0x39000000 ||
+        (opcode & 0x3f200c00) == 0x38200800 ||
+        ((opcode & 0x3f200000) == 0x38000000 && ((opcode >> 10) & 3) != 2))
+    {
+        switch (opc)
+        {
+            case 0:
+                da->da_Flags = DA_STORE;
+                break;
+            case 1:
+                break;
+            case 2:
+                if (da->da_Size == 8)
+                    return 0;
+                da->da_Flags = DA_SEXT | DA_SEXT64;
+                break;
+            case 3:
+                if (da->da_Size >= 4)
+                    return 0;
+                da->da_Flags = DA_SEXT;
+                break;
+        }
+
+        if ((opcode & 0x3f200000) == 0x38000000 && (opcode & 0x400))
+            da->da_Writeback = ((int16_t)(opcode >> 5)) >> 7;
+    }
+    /* LDP/STP/LDPSW signed offset, post- and pre-index */
+    else if ((opcode & 0x3e000000) == 0x28000000 && (opcode & 0x01800000) != 0)
+    {
+        if ((opcode & 0xc0000000) == 0xc0000000)
+            return 0;
+
+        da->da_Size = (opcode & 0x80000000) ? 8 : 4;
+        da->da_Flags = DA_PAIR;
+        da->da_Rt2 = (opcode >> 10) & 31;
+
+        /* There is no store form of LDPSW */
+        if ((opcode & 0x40000000) && !(opcode & (1 << 22)))
+            return 0;
+
+        if (!(opcode & (1 << 22)))
+            da->da_Flags |= DA_STORE;
+        else if (opcode & 0x40000000)
+            da->da_Flags |= DA_SEXT | DA_SEXT64;
+
+        if ((opcode & 0x01800000) != 0x01000000)
+            da->da_Writeback = da->da_Size * (((int16_t)(opcode >> 6)) >> 9);
+    }
+    else
+        return 0;
+
+    return 1;
+}
+
+/*
+    Called from the fast data abort entry with x0-x30 saved in a frame of the exception context
+    layout. Returns 0 if the abort needs the full path, the frame and ELR are left untouched then.
+*/
+int __attribute__((used)) SYSFastDataAbort(uint64_t *ctx)
+{
+    uint64_t elr, far;
+    struct DecodedAccess *da;
+    uint64_t value;
+    int handled;
+
+    asm volatile("mrs %0, ELR_EL1; mrs %1, FAR_EL1":"=r"(elr),"=r"(far));
+
+    uint32_t opcode = LE32(*(uint32_t *)elr);
+    da = &da_cache[(elr >> 2) & (DA_CACHE_SIZE - 1)];
+
+    if (da->da_ELR != elr || da->da_Opcode != opcode)
+    {
+#if EMU68_BUS_PATCHING
+        uint64_t addr;
+        int is_write;
+
+        /* Let the full path patch the instruction if it can */
+        if (SYSDecodeAccess(opcode, ctx, &addr, &is_write) && addr == far)
+            return 0;
+#endif
+        if (!SYSDecodeForCache(opcode, da))
+        {
+            da->da_ELR = 0;
+            return 0;
+        }
+        da->da_ELR = elr;
+        da->da_Opcode = opcode;
+    }
+
+#ifdef PISTORM
+    bp_record_pc(elr);
+#endif
+
+    if (da->da_Flags & DA_STORE)
+    {
+        value = da->da_Rt == 31 ? 0 : ctx[da->da_Rt];
+
+        if (da->da_Flags & DA_PAIR)
+        {
+            uint64_t value2 = da->da_Rt2 == 31 ? 0 : ctx[da->da_Rt2];
+            handled = SYSWritePair(value, value2, da->da_Size, far, SYSWriteValToAddr);
+        }
+        else
+            handled = SYSWriteValToAddr(value, da->da_Size, far);
+    }
+    else
+    {
+        uint64_t values[2] = { 0, 0 };
+
+        if (da->da_Flags & DA_PAIR)
+            handled = SYSReadPair(&values[0], &values[1], da->da_Size, far, SYSReadValFromAddr);
+        else
+            handled = SYSReadValFromAddr(&values[0], da->da_Size, far);
+
+        if (!handled)
+            return 0;
+
+        for (int i=0; i < ((da->da_Flags & DA_PAIR) ? 2 : 1); i++)
+        {
+            uint8_t rt = i ? da->da_Rt2 : da->da_Rt;
+
+            value = values[i];
+
+            if (da->da_Flags & DA_SEXT)
+            {
+                int shift = 64 - 8 * da->da_Size;
+                value = (uint64_t)(((int64_t)(value << shift)) >> shift);
+                if (!(da->da_Flags & DA_SEXT64))
+                    value &= 0xffffffff;
+            }
+
+            /* Slot 31 holds SP, loads to XZR are discarded */
+            if (rt != 31)
+                ctx[rt] = value;
+        }
+    }
+
+    /* Registers and ELR only change once the access went through */
+    if (!handled)
+        return 0;
+
+    ctx[da->da_Rn] += da->da_Writeback;
+
+    elr += 4;
+    asm volatile("msr ELR_EL1, %0"::"r"(elr));
+
+    return 1;
+}
+
+#endif
+
 #undef D
 #define D(x)  x 
 
@@ -1086,7 +1816,9 @@ void SYSHandler(uint32_t vector, uint64_t *ctx)
             }
             kprintf("\n[JIT] ");
 
-            kprintf("    PC = 0x%08x    SR = ", BE32(ctx[REG_PC]));
+            uint32_t m68k_pc = ctx[REG_PC];
+            M68K_GetPCFromARM(elr, &m68k_pc);
+            kprintf("    PC = 0x%08x    SR = ", BE32(m68k_pc));
 
             kprintf("T%d|", sr >> 14);
     
@@ -1149,12 +1881,21 @@ void SYSHandler(uint32_t vector, uint64_t *ctx)
             elr += 8;
             asm volatile("msr ELR_EL1, %0"::"r"(elr));
         }
+
+        if ((esr & 0xffff) == 0x103)
+        {
+            M68K_FPCRChanged();
+        }
     }
 
     if (!handled)
     {
         kprintf("[JIT:SYS] Exception with vector %04x. ELR=%p, SPSR=%08x, ESR=%p, FAR=%p\n", vector, elr, spsr, esr, far);
 
+        uint32_t m68k_pc;
+        if (M68K_GetPCFromARM(elr, &m68k_pc))
+            kprintf("[JIT:SYS] Translated m68k instruction at %08x\n", m68k_pc);
+
         for (int i=0; i < 16; i++)
         {
             kprintf("[JIT:SYS]  X%02d=%p   X%02d=%p\n", 2*i, ctx[2*i], 2*i+1, ctx[2*i+1]);
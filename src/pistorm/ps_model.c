@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: MIT
+
+#define PS_PROTOCOL_IMPL
+
+#include <stdint.h>
+
+#include "config.h"
+#include "support.h"
+#include "ps_protocol.h"
+#include "ps_model.h"
+
+#if EMU68_PS_MODEL
+
+#define GPFSEL2         2
+#define GPSET0          7
+#define GPCLR0          10
+#define GPLEV0          13
+
+/* Flags of the address phase, upper byte of REG_ADDR_HI */
+#define ADDR_HI_BYTE    0x0100
+#define ADDR_HI_READ    0x0200
+
+#define CHIP_SIZE       0x200000
+
+/* Paula interrupt registers */
+#define INTENAR         0xdff01c
+#define INTREQR         0xdff01e
+#define INTENA          0xdff09a
+#define INTREQ          0xdff09c
+#define INTF_SETCLR     0x8000
+#define INTF_INTEN      0x4000
+#define INTF_VERTB      0x0020
+
+/* One PAL frame, 313 lines of 227 colour clocks of 280 cycles */
+#define FRAME_CYCLES    (313 * 227 * 280)
+
+static const struct PSModelCosts default_costs = {
+    .mc_GPIOWrite = 15,
+    .mc_GPIORead = 40,
+    .mc_BusCycle = 560,         /* Four clocks of 7.09 MHz */
+    .mc_CIACycle = 1400,        /* Average wait for E clock */
+};
+
+static struct {
+    struct PSModelCosts costs;
+    struct PSModelStats stats;
+
+    /* GPIO side */
+    uint32_t gpfsel[3];
+    uint32_t pins;              /* Levels driven by the Pi, GPSET/GPCLR */
+    uint32_t eds;
+    uint32_t aren;
+    uint32_t afen;
+
+    /* CPLD side */
+    uint16_t data;
+    uint16_t read_data;
+    uint16_t status;
+    uint32_t address;
+    uint64_t txn_end;
+    volatile uint8_t ipl;
+
+    /* Paula */
+    uint16_t intena;
+    uint16_t intreq;
+    uint64_t frame;
+} m;
+
+static uint16_t chip_ram[CHIP_SIZE / 2];
+static uint16_t custom_regs[0x100];         /* dff000 - dff1ff */
+static uint8_t cia_regs[2][16];             /* CIA-A, CIA-B */
+
+/* Beam position follows model time, 227 colour clocks of 280 cycles per line, 313 lines */
+static uint32_t model_beam()
+{
+    uint64_t clocks = m.stats.ms_Cycles / 280;
+    uint32_t vpos = (clocks / 227) % 313;
+    uint32_t hpos = clocks % 227;
+
+    return (vpos << 8) | hpos;
+}
+
+static uint16_t *model_word(uint32_t address)
+{
+    if (address < CHIP_SIZE)
+        return &chip_ram[address >> 1];
+    if (address >= 0xdff000 && address < 0xdff200)
+        return &custom_regs[(address & 0x1ff) >> 1];
+
+    return NULL;
+}
+
+/* Interrupt level of the highest pending and enabled Paula interrupt */
+static void model_update_ipl()
+{
+    static const uint8_t level[14] = { 1, 1, 1, 2, 3, 3, 3, 4, 4, 4, 4, 5, 5, 6 };
+    uint16_t pending = m.intena & m.intreq & 0x3fff;
+    unsigned int ipl = 0;
+
+    if (m.intena & INTF_INTEN)
+    {
+        for (int i=13; i >= 0; i--)
+        {
+            if (pending & (1 << i))
+            {
+                ipl = level[i];
+                break;
+            }
+        }
+    }
+
+    if (ipl != m.ipl)
+        ps_model_set_ipl(ipl);
+}
+
+/* Vertical blank at the start of every frame of model time raises VERTB */
+static void model_advance(uint32_t cycles)
+{
+    uint64_t frame;
+
+    m.stats.ms_Cycles += cycles;
+    frame = m.stats.ms_Cycles / FRAME_CYCLES;
+
+    if (frame != m.frame)
+    {
+        m.frame = frame;
+        m.intreq |= INTF_VERTB;
+        model_update_ipl();
+    }
+}
+
+static uint16_t model_setclr(uint16_t reg, uint16_t value)
+{
+    if (value & INTF_SETCLR)
+        return reg | (value & 0x7fff);
+    else
+        return reg & ~value;
+}
+
+/* CIA-A is selected with A12 low and sits on the low byte, CIA-B with A13 low on the high byte */
+static uint16_t model_bus_read(uint32_t address)
+{
+    uint16_t *p;
+
+    if ((address & 0xff0000) == 0xbf0000)
+    {
+        int reg = (address >> 8) & 15;
+        uint16_t value = 0xffff;
+
+        if (!(address & 0x1000))
+            value = (value & 0xff00) | cia_regs[0][reg];
+        if (!(address & 0x2000))
+            value = (value & 0x00ff) | (cia_regs[1][reg] << 8);
+
+        return value;
+    }
+
+    if ((address & ~1) == INTENAR)
+        return m.intena;
+    if ((address & ~1) == INTREQR)
+        return m.intreq;
+    if ((address & ~1) == 0xdff004)
+        return model_beam() >> 16;
+    if ((address & ~1) == 0xdff006)
+        return model_beam();
+
+    p = model_word(address);
+
+    return p ? *p : 0xffff;
+}
+
+static void model_bus_write(uint32_t address, uint16_t value, int is_byte)
+{
+    uint16_t *p;
+
+    if ((address & 0xff0000) == 0xbf0000)
+    {
+        int reg = (address >> 8) & 15;
+
+        if (!(address & 0x1000) && (!is_byte || (address & 1)))
+            cia_regs[0][reg] = value & 0xff;
+        if (!(address & 0x2000) && (!is_byte || !(address & 1)))
+            cia_regs[1][reg] = value >> 8;
+
+        return;
+    }
+
+    if (!is_byte && (address == INTENA || address == INTREQ))
+    {
+        if (address == INTENA)
+            m.intena = model_setclr(m.intena, value);
+        else
+            m.intreq = model_setclr(m.intreq, value);
+
+        model_update_ipl();
+        return;
+    }
+
+    p = model_word(address);
+
+    if (p == NULL)
+        return;
+
+    if (!is_byte)
+        *p = value;
+    else if (address & 1)
+        *p = (*p & 0xff00) | (value & 0x00ff);
+    else
+        *p = (*p & 0x00ff) | (value & 0xff00);
+}
+
+/*
+    Writing REG_ADDR_HI starts the bus transaction. It is carried out at once, but the CPLD
+    reports it in progress until its cost has passed, counted from the end of the previous one.
+*/
+static void model_transaction(uint16_t addr_hi)
+{
+    uint32_t cost = (m.address & 0xff0000) == 0xbf0000 ? m.costs.mc_CIACycle : m.costs.mc_BusCycle;
+    uint64_t start = m.txn_end > m.stats.ms_Cycles ? m.txn_end : m.stats.ms_Cycles;
+
+    m.txn_end = start + cost;
+
+    if (addr_hi & ADDR_HI_READ)
+    {
+        m.read_data = model_bus_read(m.address);
+        m.stats.ms_BusReads++;
+    }
+    else
+    {
+        model_bus_write(m.address, m.data, addr_hi & ADDR_HI_BYTE);
+        m.stats.ms_BusWrites++;
+    }
+}
+
+/* Rising edge of WR latches the data pins into the register selected by A0/A1 */
+static void model_strobe_write()
+{
+    uint16_t value = (m.pins >> PIN_D(0)) & 0xffff;
+
+    switch ((m.pins >> PIN_A0) & 3)
+    {
+        case REG_DATA:
+            m.data = value;
+            break;
+        case REG_ADDR_LO:
+            m.address = (m.address & 0xff0000) | value;
+            break;
+        case REG_ADDR_HI:
+            m.address = (m.address & 0xffff) | ((value & 0xff) << 16);
+            model_transaction(value);
+            break;
+        case REG_STATUS:
+            m.status = value;
+            m.stats.ms_StatusAccesses++;
+            if (value & STATUS_BIT_INIT)
+                m.txn_end = m.stats.ms_Cycles;
+            break;
+    }
+}
+
+void ps_model_write(unsigned int reg, uint32_t value)
+{
+    value = LE32(value);
+
+    model_advance(m.costs.mc_GPIOWrite);
+    m.stats.ms_GPIOWrites++;
+
+    switch (reg)
+    {
+        case 0 ... GPFSEL2:
+            m.gpfsel[reg] = value;
+            break;
+        case GPSET0:
+        {
+            uint32_t rising = value & ~m.pins;
+
+            m.pins |= value;
+            if (rising & (1 << PIN_WR))
+                model_strobe_write();
+            break;
+        }
+        case GPCLR0:
+            m.pins &= ~value;
+            break;
+        case GPEDS0:
+            m.eds &= ~value;
+            break;
+        case GPAREN0:
+            m.aren = value;
+            break;
+        case GPAFEN0:
+            m.afen = value;
+            break;
+    }
+}
+
+static uint32_t model_read(unsigned int reg, int account)
+{
+    uint32_t value = 0;
+
+    if (account)
+    {
+        model_advance(m.costs.mc_GPIORead);
+        m.stats.ms_GPIOReads++;
+    }
+
+    switch (reg)
+    {
+        case 0 ... GPFSEL2:
+            value = m.gpfsel[reg];
+            break;
+        case GPLEV0:
+            value = m.pins & ~((1 << PIN_TXN_IN_PROGRESS) | (1 << PIN_IPL_ZERO));
+            value |= 1 << PIN_RESET;
+
+            if (m.ipl == 0)
+                value |= 1 << PIN_IPL_ZERO;
+
+            if (m.stats.ms_Cycles < m.txn_end)
+            {
+                value |= 1 << PIN_TXN_IN_PROGRESS;
+                if (account)
+                    m.stats.ms_WaitCycles += m.costs.mc_GPIORead;
+            }
+
+            /* With RD asserted the CPLD drives the data pins */
+            if (m.pins & (1 << PIN_RD))
+            {
+                uint16_t data = m.read_data;
+
+                if (((m.pins >> PIN_A0) & 3) == REG_STATUS)
+                {
+                    data = m.status | (m.ipl << STATUS_SHIFT_IPL);
+                    if (account)
+                        m.stats.ms_StatusAccesses++;
+                }
+
+                value = (value & ~(0xffff << PIN_D(0))) | ((uint32_t)data << PIN_D(0));
+            }
+            break;
+        case GPEDS0:
+            value = m.eds;
+            break;
+        case GPAREN0:
+            value = m.aren;
+            break;
+        case GPAFEN0:
+            value = m.afen;
+            break;
+    }
+
+    return LE32(value);
+}
+
+uint32_t ps_model_read(unsigned int reg)
+{
+    return model_read(reg, 1);
+}
+
+/* Sample pins without side effects, for the housekeeper which does not hold the bus lock */
+uint32_t ps_model_peek(unsigned int reg)
+{
+    return model_read(reg, 0);
+}
+
+void ps_model_set_ipl(unsigned int level)
+{
+    level &= 7;
+
+    if (m.ipl == 0 && level != 0)
+        m.eds |= m.afen & (1 << PIN_IPL_ZERO);
+    else if (m.ipl != 0 && level == 0)
+        m.eds |= m.aren & (1 << PIN_IPL_ZERO);
+
+    m.ipl = level;
+}
+
+void ps_model_set_costs(const struct PSModelCosts *costs)
+{
+    m.costs = *costs;
+}
+
+void ps_model_get_stats(struct PSModelStats *stats)
+{
+    *stats = m.stats;
+}
+
+/* Model time keeps running, only the counters start over */
+void ps_model_reset_stats()
+{
+    uint64_t cycles = m.stats.ms_Cycles;
+
+    bzero(&m.stats, sizeof(m.stats));
+    m.stats.ms_Cycles = cycles;
+}
+
+void ps_model_dump()
+{
+    struct PSModelStats *s = &m.stats;
+
+    kprintf("[PSMOD] Model time %lld cycles, %lld of them waiting for the CPLD\n", s->ms_Cycles, s->ms_WaitCycles);
+    kprintf("[PSMOD] GPIO writes %lld, reads %lld\n", s->ms_GPIOWrites, s->ms_GPIOReads);
+    kprintf("[PSMOD] Bus reads %lld, writes %lld, status register accesses %lld\n",
+        s->ms_BusReads, s->ms_BusWrites, s->ms_StatusAccesses);
+}
+
+void ps_model_init()
+{
+    bzero(&m, sizeof(m));
+    m.costs = default_costs;
+
+    kprintf("[PSMOD] Using software model of PiStorm GPIO and CPLD\n");
+}
+
+#endif
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: MIT
+
+/*
+    Software model of the PiStorm GPIO interface and CPLD protocol. It stands in for the GPIO
+    registers used by ps_protocol.c (GPFSEL, GPSET, GPCLR, GPLEV, GPEDS and edge enables) and for
+    the CPLD behind them: register selection with A0/A1, address and data phases strobed by WR,
+    reads strobed by RD, TXN_IN_PROGRESS, status register and IPL. The Amiga side is chip RAM
+    plus a register file for CIAs and custom chips. Paula's INTENA/INTREQ drive IPL, and a
+    vertical blank raises VERTB (level 3) once per PAL frame of model time.
+
+    Time is counted in model cycles, advanced by every GPIO access and bus transaction according
+    to configurable costs, so that transfer paths can be compared deterministically. With the
+    default costs one model cycle corresponds to one nanosecond.
+*/
+
+#ifndef _PS_MODEL_H
+#define _PS_MODEL_H
+
+#include <stdint.h>
+#include "config.h"
+
+struct PSModelCosts {
+    uint32_t mc_GPIOWrite;          /* Per GPIO register write */
+    uint32_t mc_GPIORead;           /* Per GPIO register read */
+    uint32_t mc_BusCycle;           /* Per bus transaction to RAM and custom chips */
+    uint32_t mc_CIACycle;           /* Per bus transaction to CIAs (E clock synchronised) */
+};
+
+struct PSModelStats {
+    uint64_t ms_Cycles;             /* Model time */
+    uint64_t ms_GPIOWrites;
+    uint64_t ms_GPIOReads;
+    uint64_t ms_BusReads;
+    uint64_t ms_BusWrites;
+    uint64_t ms_StatusAccesses;
+    uint64_t ms_WaitCycles;         /* Time spent polling TXN_IN_PROGRESS */
+};
+
+#if EMU68_PS_MODEL
+
+void ps_model_init();
+void ps_model_set_costs(const struct PSModelCosts *costs);
+void ps_model_get_stats(struct PSModelStats *stats);
+void ps_model_reset_stats();
+void ps_model_dump();
+void ps_model_set_ipl(unsigned int level);      /* Test hook, Paula sets IPL on its next change */
+
+/* GPIO register access, reg is the word offset from GPIO base and value little endian */
+void ps_model_write(unsigned int reg, uint32_t value);
+uint32_t ps_model_read(unsigned int reg);
+uint32_t ps_model_peek(unsigned int reg);
+
+#endif
+
+#endif /* _PS_MODEL_H */
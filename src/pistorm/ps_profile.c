@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: MIT
+
+#include <stdint.h>
+
+#include "config.h"
+#include "support.h"
+#include "M68k.h"
+#include "ps_profile.h"
+
+#if EMU68_BUS_PROFILE
+
+static struct BusProfile profile;
+
+static const char *region_names[BPR_COUNT] = {
+    "chip", "z2", "cia-a", "cia-b", "slow", "custom", "autoconf", "z3", "other"
+};
+
+static const char *size_names[BP_SIZES] = { "b", "w", "l", "8/blk" };
+
+static enum BusProfileRegion bp_region(uint64_t address)
+{
+    /* Same single wrap around as in the fault path */
+    if ((address >> 32) == 1 || (address >> 32) == 0xffffffff)
+        address &= 0xffffffff;
+
+    if (address < 0x200000)
+        return BPR_CHIP;
+    if (address < 0xa00000)
+        return BPR_Z2;
+    if (address >= 0xbf0000 && address < 0xc00000)
+        return (address & 0x2000) ? BPR_CIAA : BPR_CIAB;
+    if (address >= 0xc00000 && address < 0xd80000)
+        return BPR_SLOW;
+    if (address >= 0xd80000 && address < 0xe00000)
+        return BPR_CUSTOM;
+    if (address >= 0xe80000 && address < 0xe90000)
+        return BPR_AUTOCONF;
+    if (address >= 0xe90000 && address < 0xf00000)
+        return BPR_Z2;
+    if (address >= 0x1000000)
+        return BPR_Z3;
+
+    return BPR_OTHER;
+}
+
+void bp_account(enum BusProfileLayer layer, uint64_t address, uint32_t size, int is_write, struct BusProfileStamp start)
+{
+    struct BusProfileStamp end = bp_start();
+    int slot = size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3;
+    struct BusProfileCounter *c = &profile.bp_Counters[layer][bp_region(address)][is_write ? 1 : 0][slot];
+
+    c->bc_Count++;
+    c->bc_Bytes += size;
+    c->bc_Ticks += end.bs_Ticks - start.bs_Ticks;
+    c->bc_Cycles += end.bs_Cycles - start.bs_Cycles;
+}
+
+/*
+    Keep the most frequent faulting ARM PCs with the space saving algorithm: a PC not in the
+    table replaces the entry with the lowest count and inherits that count. The m68k PC is
+    resolved once, when the entry is created.
+*/
+void bp_record_pc(uint64_t arm_pc)
+{
+    struct BusProfilePC *min = &profile.bp_TopPC[0];
+
+    for (int i=0; i < BP_TOP_PCS; i++)
+    {
+        struct BusProfilePC *e = &profile.bp_TopPC[i];
+
+        if (e->bpc_ARM == arm_pc && e->bpc_Count) {
+            e->bpc_Count++;
+            return;
+        }
+
+        if (e->bpc_Count < min->bpc_Count)
+            min = e;
+    }
+
+    min->bpc_ARM = arm_pc;
+    min->bpc_Count++;
+    if (!M68K_GetPCFromARM(arm_pc, &min->bpc_M68k))
+        min->bpc_M68k = 0xffffffff;
+}
+
+void bp_dump()
+{
+    uint64_t frq;
+
+    asm volatile("mrs %0, CNTFRQ_EL0":"=r"(frq));
+    frq = frq & 0xffffffff;
+
+    kprintf("[BPROF] Bus profile, time in us, cycles per access\n");
+
+    for (int l=0; l < BPL_COUNT; l++)
+    {
+        for (int r=0; r < BPR_COUNT; r++)
+        {
+            for (int w=0; w < 2; w++)
+            {
+                for (int s=0; s < BP_SIZES; s++)
+                {
+                    struct BusProfileCounter *c = &profile.bp_Counters[l][r][w][s];
+
+                    if (c->bc_Count == 0)
+                        continue;
+
+                    kprintf("[BPROF] %s %-8s %s.%-5s count=%lld bytes=%lld time=%lld cyc/acc=%lld\n",
+                        l == BPL_BUS ? "bus  " : "fault", region_names[r], w ? "W" : "R", size_names[s],
+                        c->bc_Count, c->bc_Bytes, 1000000 * c->bc_Ticks / frq, c->bc_Cycles / c->bc_Count);
+                }
+            }
+        }
+    }
+
+    kprintf("[BPROF] Top faulting PCs\n");
+
+    for (int i=0; i < BP_TOP_PCS; i++)
+    {
+        struct BusProfilePC *e = &profile.bp_TopPC[i];
+
+        if (e->bpc_Count)
+            kprintf("[BPROF]   ARM %p m68k %08x count=%d\n", (void *)e->bpc_ARM, e->bpc_M68k, e->bpc_Count);
+    }
+}
+
+static void bp_export(uint32_t address)
+{
+    struct BusProfile *out = (struct BusProfile *)(uintptr_t)address;
+    uint64_t frq;
+
+    asm volatile("mrs %0, CNTFRQ_EL0":"=r"(frq));
+
+    out->bp_Magic = BE32(BP_MAGIC);
+    out->bp_Version = BE32(BP_VERSION);
+    out->bp_Regions = BE32(BPR_COUNT);
+    out->bp_Frequency = BE32(frq & 0xffffffff);
+
+    for (int l=0; l < BPL_COUNT; l++)
+        for (int r=0; r < BPR_COUNT; r++)
+            for (int w=0; w < 2; w++)
+                for (int s=0; s < BP_SIZES; s++)
+                {
+                    struct BusProfileCounter *c = &profile.bp_Counters[l][r][w][s];
+                    struct BusProfileCounter *o = &out->bp_Counters[l][r][w][s];
+
+                    o->bc_Count = BE64(c->bc_Count);
+                    o->bc_Ticks = BE64(c->bc_Ticks);
+                    o->bc_Cycles = BE64(c->bc_Cycles);
+                    o->bc_Bytes = BE64(c->bc_Bytes);
+                }
+
+    for (int i=0; i < BP_TOP_PCS; i++)
+    {
+        out->bp_TopPC[i].bpc_ARM = BE64(profile.bp_TopPC[i].bpc_ARM);
+        out->bp_TopPC[i].bpc_M68k = BE32(profile.bp_TopPC[i].bpc_M68k);
+        out->bp_TopPC[i].bpc_Count = BE32(profile.bp_TopPC[i].bpc_Count);
+    }
+}
+
+/* Called from translated code on MOVEC Rn, BUSPROF */
+void bp_control(uint32_t value)
+{
+    switch (value)
+    {
+        case BP_CTRL_RESET:
+            bzero(&profile, sizeof(profile));
+            break;
+        case BP_CTRL_DUMP:
+            bp_dump();
+            break;
+        default:
+            bp_export(value);
+            break;
+    }
+}
+
+#endif
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+
+/*
+    PiStorm bus access profiler. Counts accesses and the time spent in them per address region,
+    direction and size, for the raw bus functions (ps_read_*, ps_write_*) and for the emulated
+    accesses of the fault path (SYSReadValFromAddr, SYSWriteValToAddr). Additionally keeps the
+    most frequent faulting ARM PCs together with the m68k PC they belong to.
+*/
+
+#ifndef _PS_PROFILE_H
+#define _PS_PROFILE_H
+
+#include <stdint.h>
+#include "config.h"
+
+enum BusProfileRegion {
+    BPR_CHIP,           /* 000000 - 1fffff */
+    BPR_Z2,             /* 200000 - 9fffff, e90000 - efffff */
+    BPR_CIAA,           /* bfe001 and mirrors */
+    BPR_CIAB,           /* bfd000 and mirrors */
+    BPR_SLOW,           /* c00000 - d7ffff */
+    BPR_CUSTOM,         /* d80000 - dfffff */
+    BPR_AUTOCONF,       /* e80000 - e8ffff */
+    BPR_Z3,             /* Above the 24-bit address space */
+    BPR_OTHER,
+    BPR_COUNT
+};
+
+enum BusProfileLayer {
+    BPL_BUS,            /* ps_read_*, ps_write_*, block transfers */
+    BPL_FAULT,          /* SYSReadValFromAddr, SYSWriteValToAddr */
+    BPL_COUNT
+};
+
+/* Size slots are 1, 2, 4 bytes and 8 bytes or burst, bursts count all their bytes */
+#define BP_SIZES        4
+#define BP_TOP_PCS      16
+
+#define BP_MAGIC        0x42505246  /* 'BPRF' */
+#define BP_VERSION      2
+
+struct BusProfileCounter {
+    uint64_t bc_Count;
+    uint64_t bc_Ticks;          /* CNTPCT ticks */
+    uint64_t bc_Cycles;         /* PMCCNTR cycles */
+    uint64_t bc_Bytes;
+};
+
+struct BusProfilePC {
+    uint64_t bpc_ARM;
+    uint32_t bpc_M68k;
+    uint32_t bpc_Count;
+};
+
+/*
+    Layout of the snapshot copied to m68k memory with MOVEC Rn, BUSPROF. All fields are big
+    endian, as seen by the m68k.
+*/
+struct BusProfile {
+    uint32_t bp_Magic;
+    uint32_t bp_Version;
+    uint32_t bp_Regions;
+    uint32_t bp_Frequency;      /* CNTPCT frequency in Hz */
+    struct BusProfileCounter bp_Counters[BPL_COUNT][BPR_COUNT][2][BP_SIZES];
+    struct BusProfilePC bp_TopPC[BP_TOP_PCS];
+};
+
+/* Values written to BUSPROF control register, anything else is address of a snapshot buffer */
+#define BP_CTRL_RESET   0
+#define BP_CTRL_DUMP    1
+
+struct BusProfileStamp {
+    uint64_t bs_Ticks;
+    uint64_t bs_Cycles;
+};
+
+#if EMU68_BUS_PROFILE
+
+static inline struct BusProfileStamp bp_start()
+{
+    struct BusProfileStamp s;
+
+    asm volatile("mrs %0, CNTPCT_EL0":"=r"(s.bs_Ticks));
+    asm volatile("mrs %0, PMCCNTR_EL0":"=r"(s.bs_Cycles));
+
+    return s;
+}
+
+void bp_account(enum BusProfileLayer layer, uint64_t address, uint32_t size, int is_write, struct BusProfileStamp start);
+void bp_record_pc(uint64_t arm_pc);
+void bp_control(uint32_t value);
+void bp_dump();
+
+#else
+
+static inline struct BusProfileStamp bp_start() { struct BusProfileStamp s = { 0, 0 }; return s; }
+static inline void bp_account(enum BusProfileLayer layer, uint64_t address, uint32_t size, int is_write, struct BusProfileStamp start)
+{
+    (void)layer; (void)address; (void)size; (void)is_write; (void)start;
+}
+static inline void bp_record_pc(uint64_t arm_pc) { (void)arm_pc; }
+
+#endif
+
+#endif /* _PS_PROFILE_H */
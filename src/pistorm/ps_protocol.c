@@ -10,14 +10,34 @@
 
 #include <stdint.h>
 
+#include "config.h"
 #include "support.h"
 #include "tlsf.h"
+#include "devicetree.h"
 #include "ps_protocol.h"
+#include "ps_profile.h"
+#include "ps_model.h"
 #include "M68k.h"
 
 volatile unsigned int *gpio;
 volatile unsigned int *gpclk;
 
+/*
+  All GPIO register accesses go through these, so that the bus code can run against the software
+  model of GPIO and CPLD (ps_model.c) instead of real hardware. Values are as seen on the register,
+  little endian. GPIO_PEEK is for pin sampling outside of the bus lock, it does not advance model
+  time.
+*/
+#if EMU68_PS_MODEL
+#define GPIO_WRITE(reg, value)  ps_model_write((reg), (value))
+#define GPIO_READ(reg)          ps_model_read(reg)
+#define GPIO_PEEK(reg)          ps_model_peek(reg)
+#else
+#define GPIO_WRITE(reg, value)  (*(gpio + (reg)) = (value))
+#define GPIO_READ(reg)          (*(gpio + (reg)))
+#define GPIO_PEEK(reg)          (*(gpio + (reg)))
+#endif
+
 unsigned int gpfsel0;
 unsigned int gpfsel1;
 unsigned int gpfsel2;
@@ -33,6 +53,23 @@ unsigned int gpfsel2_o;
 
 volatile uint8_t gpio_lock;
 
+/*
+  Owner lock of the PiStorm bus. The bus is driven by CPU0 (reads, ordered writes), by the
+  housekeeper on CPU2 (status register reads for the IRQ level) and, with posted writes enabled,
+  by the write buffer task on CPU3.
+*/
+volatile unsigned char bus_lock = 0;
+
+static inline void bus_acquire()
+{
+  while(__atomic_test_and_set(&bus_lock, __ATOMIC_ACQUIRE)) { asm volatile("yield"); }
+}
+
+static inline void bus_release()
+{
+  __atomic_clear(&bus_lock, __ATOMIC_RELEASE);
+}
+
 static void usleep(uint64_t delta)
 {
     uint64_t hi = LE32(*(volatile uint32_t*)0xf2003008);
@@ -92,7 +129,7 @@ void bitbang_putByte(uint8_t byte)
   uint64_t t0 = 0, t1 = 0;
   asm volatile("mrs %0, CNTPCT_EL0":"=r"(t0));
 
-  *(gpio + 10) = LE32(TXD_BIT); // Start bit - 0
+  GPIO_WRITE(10, LE32(TXD_BIT)); // Start bit - 0
   
   do {
     asm volatile("mrs %0, CNTPCT_EL0":"=r"(t1));
@@ -102,9 +139,9 @@ void bitbang_putByte(uint8_t byte)
     asm volatile("mrs %0, CNTPCT_EL0":"=r"(t0));
 
     if (byte & 1)
-      *(gpio + 7) = LE32(TXD_BIT);
+      GPIO_WRITE(7, LE32(TXD_BIT));
     else
-      *(gpio + 10) = LE32(TXD_BIT);
+      GPIO_WRITE(10, LE32(TXD_BIT));
     byte = byte >> 1;
 
     do {
@@ -113,7 +150,7 @@ void bitbang_putByte(uint8_t byte)
   }
   asm volatile("mrs %0, CNTPCT_EL0":"=r"(t0));
 
-  *(gpio + 7) = LE32(TXD_BIT);  // Stop bit - 1
+  GPIO_WRITE(7, LE32(TXD_BIT));  // Stop bit - 1
 
   do {
     asm volatile("mrs %0, CNTPCT_EL0":"=r"(t1));
@@ -130,15 +167,15 @@ void fastSerial_init()
     gpio = ((volatile unsigned *)BCM2708_PERI_BASE) + GPIO_ADDR / 4;
   
   /* Leave FS_CLK and FS_DO high */
-  *(gpio + 7) = LE32(FS_CLK);
-  *(gpio + 7) = LE32(FS_DO);
+  GPIO_WRITE(7, LE32(FS_CLK));
+  GPIO_WRITE(7, LE32(FS_DO));
 
   for (int i=0; i < 16; i++) {
     /* Clock down */
-    *(gpio + 10) = LE32(FS_CLK);
+    GPIO_WRITE(10, LE32(FS_CLK));
     //*(gpio + 10) = LE32(FS_CLK);
     /* Clock up */
-    *(gpio + 7) = LE32(FS_CLK);
+    GPIO_WRITE(7, LE32(FS_CLK));
     //*(gpio + 7) = LE32(FS_CLK);
   }
 }
@@ -152,47 +189,49 @@ void fastSerial_putByte(uint8_t byte)
   //while (0 == (*(gpio + 13) & LE32(FS_CTS))) {}
 
   /* Start bit */
-  *(gpio + 10) = LE32(FS_DO);
+  GPIO_WRITE(10, LE32(FS_DO));
 
   /* Clock down */
-  *(gpio + 10) = LE32(FS_CLK);
+  GPIO_WRITE(10, LE32(FS_CLK));
   //*(gpio + 10) = LE32(FS_CLK);
   /* Clock up */
-  *(gpio + 7) = LE32(FS_CLK);
+  GPIO_WRITE(7, LE32(FS_CLK));
   //*(gpio + 7) = LE32(FS_CLK);
 
 
   for (int i=0; i < 8; i++) {
     if (byte & 1)
-      *(gpio + 7) = LE32(FS_DO);
+      GPIO_WRITE(7, LE32(FS_DO));
     else
-      *(gpio + 10) = LE32(FS_DO);
+      GPIO_WRITE(10, LE32(FS_DO));
 
     /* Clock down */
-    *(gpio + 10) = LE32(FS_CLK);
+    GPIO_WRITE(10, LE32(FS_CLK));
     //*(gpio + 10) = LE32(FS_CLK);
     /* Clock up */
-    *(gpio + 7) = LE32(FS_CLK);
+    GPIO_WRITE(7, LE32(FS_CLK));
     //*(gpio + 7) = LE32(FS_CLK);
     
     byte = byte >> 1;
   }
 
   /* DEST bit (0) */
-  *(gpio + 10) = LE32(FS_DO);
+  GPIO_WRITE(10, LE32(FS_DO));
 
   /* Clock down */
-  *(gpio + 10) = LE32(FS_CLK);
+  GPIO_WRITE(10, LE32(FS_CLK));
   //*(gpio + 10) = LE32(FS_CLK);
   /* Clock up */
-  *(gpio + 7) = LE32(FS_CLK);
-  *(gpio + 7) = LE32(FS_CLK);
+  GPIO_WRITE(7, LE32(FS_CLK));
+  GPIO_WRITE(7, LE32(FS_CLK));
 
   /* Leave FS_CLK and FS_DO high */
-  *(gpio + 7) = LE32(FS_CLK);
-  *(gpio + 7) = LE32(FS_DO);
+  GPIO_WRITE(7, LE32(FS_CLK));
+  GPIO_WRITE(7, LE32(FS_DO));
 }
 
+#if !EMU68_PS_MODEL
+
 static void pistorm_setup_io() {
   gpio = ((volatile unsigned *)BCM2708_PERI_BASE) + GPIO_ADDR / 4;
   gpclk = ((volatile unsigned *)BCM2708_PERI_BASE) + GPCLK_ADDR / 4;
@@ -219,17 +258,23 @@ static void setup_gpclk() {
   SET_GPIO_ALT(PIN_CLK, 0);  // gpclk0
 }
 
+#endif
+
 void ps_setup_protocol() {
+#if EMU68_PS_MODEL
+  ps_model_init();
+#else
   pistorm_setup_io();
   setup_gpclk();
+#endif
 
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(10, LE32(0xffffec));
 
-  *(gpio + 0) = LE32(GPFSEL0_INPUT);
-  *(gpio + 1) = LE32(GPFSEL1_INPUT);
-  *(gpio + 2) = LE32(GPFSEL2_INPUT);
+  GPIO_WRITE(0, LE32(GPFSEL0_INPUT));
+  GPIO_WRITE(1, LE32(GPFSEL1_INPUT));
+  GPIO_WRITE(2, LE32(GPFSEL2_INPUT));
 
-  *(gpio + 7) = LE32(TXD_BIT);
+  GPIO_WRITE(7, LE32(TXD_BIT));
 }
 
 static void ps_write_8_int(unsigned int address, unsigned int data);
@@ -245,30 +290,30 @@ static void ps_write_16_int(unsigned int address, unsigned int data) {
   }
   else
   {
-    *(gpio + 0) = LE32(GPFSEL0_OUTPUT);
-    *(gpio + 1) = LE32(GPFSEL1_OUTPUT);
-    *(gpio + 2) = LE32(GPFSEL2_OUTPUT);
+    GPIO_WRITE(0, LE32(GPFSEL0_OUTPUT));
+    GPIO_WRITE(1, LE32(GPFSEL1_OUTPUT));
+    GPIO_WRITE(2, LE32(GPFSEL2_OUTPUT));
 
-    *(gpio + 7) = LE32(((data & 0xffff) << 8) | (REG_DATA << PIN_A0));
-    *(gpio + 7) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(0xffffec);
+    GPIO_WRITE(7, LE32(((data & 0xffff) << 8) | (REG_DATA << PIN_A0)));
+    GPIO_WRITE(7, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(0xffffec));
 
-    *(gpio + 7) = LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0));
-    *(gpio + 7) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(0xffffec);
+    GPIO_WRITE(7, LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0)));
+    GPIO_WRITE(7, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(0xffffec));
 
-    *(gpio + 7) = LE32(((0x0000 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0));
-    *(gpio + 7) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(0xffffec);
+    GPIO_WRITE(7, LE32(((0x0000 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0)));
+    GPIO_WRITE(7, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(0xffffec));
 
-    *(gpio + 0) = LE32(GPFSEL0_INPUT);
-    *(gpio + 1) = LE32(GPFSEL1_INPUT);
-    *(gpio + 2) = LE32(GPFSEL2_INPUT);
+    GPIO_WRITE(0, LE32(GPFSEL0_INPUT));
+    GPIO_WRITE(1, LE32(GPFSEL1_INPUT));
+    GPIO_WRITE(2, LE32(GPFSEL2_INPUT));
 
-    while (*(gpio + 13) & LE32((1 << PIN_TXN_IN_PROGRESS))) {}
+    while (GPIO_READ(13) & LE32((1 << PIN_TXN_IN_PROGRESS))) {}
 
     if (address >= 0xbf0000 && address <= 0xbfffff) {
       ticksleep(CIA_DELAY);
@@ -288,30 +333,30 @@ static void ps_write_8_int(unsigned int address, unsigned int data) {
   else
     data = data & 0xff;  // ODD , A0=1,LDS
 
-  *(gpio + 0) = LE32(GPFSEL0_OUTPUT);
-  *(gpio + 1) = LE32(GPFSEL1_OUTPUT);
-  *(gpio + 2) = LE32(GPFSEL2_OUTPUT);
+  GPIO_WRITE(0, LE32(GPFSEL0_OUTPUT));
+  GPIO_WRITE(1, LE32(GPFSEL1_OUTPUT));
+  GPIO_WRITE(2, LE32(GPFSEL2_OUTPUT));
 
-  *(gpio + 7) = LE32(((data & 0xffff) << 8) | (REG_DATA << PIN_A0));
-  *(gpio + 7) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(7, LE32(((data & 0xffff) << 8) | (REG_DATA << PIN_A0)));
+  GPIO_WRITE(7, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(0xffffec));
 
-  *(gpio + 7) = LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0));
-  *(gpio + 7) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(7, LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0)));
+  GPIO_WRITE(7, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(0xffffec));
 
-  *(gpio + 7) = LE32(((0x0100 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0));
-  *(gpio + 7) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(7, LE32(((0x0100 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0)));
+  GPIO_WRITE(7, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(0xffffec));
 
-  *(gpio + 0) = LE32(GPFSEL0_INPUT);
-  *(gpio + 1) = LE32(GPFSEL1_INPUT);
-  *(gpio + 2) = LE32(GPFSEL2_INPUT);
+  GPIO_WRITE(0, LE32(GPFSEL0_INPUT));
+  GPIO_WRITE(1, LE32(GPFSEL1_INPUT));
+  GPIO_WRITE(2, LE32(GPFSEL2_INPUT));
 
-  while (*(gpio + 13) & LE32((1 << PIN_TXN_IN_PROGRESS))) {}
+  while (GPIO_READ(13) & LE32((1 << PIN_TXN_IN_PROGRESS))) {}
 
   if (address >= 0xbf0000 && address <= 0xbfffff) {
     ticksleep(CIA_DELAY);
@@ -335,9 +380,9 @@ static void ps_write_32_int(unsigned int address, unsigned int value) {
   }
 }
 
-unsigned int ps_read_16(unsigned int address) {
-  //wb_waitfree();
+static unsigned int ps_read_8_int(unsigned int address);
 
+static unsigned int ps_read_16_int(unsigned int address) {
   if (address > 0xffffff)
     return 0xffff;
 
@@ -345,38 +390,38 @@ unsigned int ps_read_16(unsigned int address) {
   {
     unsigned int value;
 
-    value = ps_read_8(address) << 8;
-    value |= ps_read_8(address + 1);
+    value = ps_read_8_int(address) << 8;
+    value |= ps_read_8_int(address + 1);
 
     return value;
   }
   else
   {
-    *(gpio + 0) = LE32(GPFSEL0_OUTPUT);
-    *(gpio + 1) = LE32(GPFSEL1_OUTPUT);
-    *(gpio + 2) = LE32(GPFSEL2_OUTPUT);
+    GPIO_WRITE(0, LE32(GPFSEL0_OUTPUT));
+    GPIO_WRITE(1, LE32(GPFSEL1_OUTPUT));
+    GPIO_WRITE(2, LE32(GPFSEL2_OUTPUT));
 
-    *(gpio + 7) = LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0));
-    *(gpio + 7) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(0xffffec);
+    GPIO_WRITE(7, LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0)));
+    GPIO_WRITE(7, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(0xffffec));
 
-    *(gpio + 7) = LE32(((0x0200 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0));
-    *(gpio + 7) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(1 << PIN_WR);
-    *(gpio + 10) = LE32(0xffffec);
+    GPIO_WRITE(7, LE32(((0x0200 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0)));
+    GPIO_WRITE(7, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(0xffffec));
 
-    *(gpio + 0) = LE32(GPFSEL0_INPUT);
-    *(gpio + 1) = LE32(GPFSEL1_INPUT);
-    *(gpio + 2) = LE32(GPFSEL2_INPUT);
+    GPIO_WRITE(0, LE32(GPFSEL0_INPUT));
+    GPIO_WRITE(1, LE32(GPFSEL1_INPUT));
+    GPIO_WRITE(2, LE32(GPFSEL2_INPUT));
 
-    *(gpio + 7) = LE32(REG_DATA << PIN_A0);
-    *(gpio + 7) = LE32(1 << PIN_RD);
+    GPIO_WRITE(7, LE32(REG_DATA << PIN_A0));
+    GPIO_WRITE(7, LE32(1 << PIN_RD));
 
-    while (*(gpio + 13) & LE32(1 << PIN_TXN_IN_PROGRESS)) {}
-    unsigned int value = LE32(*(gpio + 13));
+    while (GPIO_READ(13) & LE32(1 << PIN_TXN_IN_PROGRESS)) {}
+    unsigned int value = LE32(GPIO_READ(13));
 
-    *(gpio + 10) = LE32(0xffffec);
+    GPIO_WRITE(10, LE32(0xffffec));
 
     if (address >= 0xbf0000 && address <= 0xbfffff) {
       ticksleep(CIA_DELAY);
@@ -389,37 +434,35 @@ unsigned int ps_read_16(unsigned int address) {
   }
 }
 
-unsigned int ps_read_8(unsigned int address) {
-  //wb_waitfree();
-
+static unsigned int ps_read_8_int(unsigned int address) {
   if (address > 0xffffff)
     return 0xff;
 
-  *(gpio + 0) = LE32(GPFSEL0_OUTPUT);
-  *(gpio + 1) = LE32(GPFSEL1_OUTPUT);
-  *(gpio + 2) = LE32(GPFSEL2_OUTPUT);
+  GPIO_WRITE(0, LE32(GPFSEL0_OUTPUT));
+  GPIO_WRITE(1, LE32(GPFSEL1_OUTPUT));
+  GPIO_WRITE(2, LE32(GPFSEL2_OUTPUT));
 
-  *(gpio + 7) = LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0));
-  *(gpio + 7) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(7, LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0)));
+  GPIO_WRITE(7, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(0xffffec));
 
-  *(gpio + 7) = LE32(((0x0300 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0));
-  *(gpio + 7) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(7, LE32(((0x0300 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0)));
+  GPIO_WRITE(7, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(0xffffec));
 
-  *(gpio + 0) = LE32(GPFSEL0_INPUT);
-  *(gpio + 1) = LE32(GPFSEL1_INPUT);
-  *(gpio + 2) = LE32(GPFSEL2_INPUT);
+  GPIO_WRITE(0, LE32(GPFSEL0_INPUT));
+  GPIO_WRITE(1, LE32(GPFSEL1_INPUT));
+  GPIO_WRITE(2, LE32(GPFSEL2_INPUT));
 
-  *(gpio + 7) = LE32(REG_DATA << PIN_A0);
-  *(gpio + 7) = LE32(1 << PIN_RD);
+  GPIO_WRITE(7, LE32(REG_DATA << PIN_A0));
+  GPIO_WRITE(7, LE32(1 << PIN_RD));
 
-  while (*(gpio + 13) & LE32(1 << PIN_TXN_IN_PROGRESS)) {}
-  unsigned int value = LE32(*(gpio + 13));
+  while (GPIO_READ(13) & LE32(1 << PIN_TXN_IN_PROGRESS)) {}
+  unsigned int value = LE32(GPIO_READ(13));
 
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(10, LE32(0xffffec));
 
   value = (value >> 8) & 0xffff;
 
@@ -436,51 +479,59 @@ unsigned int ps_read_8(unsigned int address) {
     return value & 0xff;  // ODD , A0=1,LDS
 }
 
-unsigned int ps_read_32(unsigned int address) {
-  //wb_waitfree();
+static unsigned int ps_read_32_int(unsigned int address) {
   if (address & 1)
   {
     unsigned int value;
-    value = ps_read_8(address) << 24;
-    value |= ps_read_16(address + 1) << 8;
-    value |= ps_read_8(address + 3);
+    value = ps_read_8_int(address) << 24;
+    value |= ps_read_16_int(address + 1) << 8;
+    value |= ps_read_8_int(address + 3);
     return value;
   }
   else
   {
-    unsigned int a = ps_read_16(address);
-    unsigned int b = ps_read_16(address + 2);
+    unsigned int a = ps_read_16_int(address);
+    unsigned int b = ps_read_16_int(address + 2);
     return (a << 16) | b;
   }
 }
 
 void ps_write_status_reg(unsigned int value) {
-  *(gpio + 0) = LE32(GPFSEL0_OUTPUT);
-  *(gpio + 1) = LE32(GPFSEL1_OUTPUT);
-  *(gpio + 2) = LE32(GPFSEL2_OUTPUT);
+  wb_waitfree();
+  bus_acquire();
+
+  GPIO_WRITE(0, LE32(GPFSEL0_OUTPUT));
+  GPIO_WRITE(1, LE32(GPFSEL1_OUTPUT));
+  GPIO_WRITE(2, LE32(GPFSEL2_OUTPUT));
 
-  *(gpio + 7) = LE32(((value & 0xffff) << 8) | (REG_STATUS << PIN_A0));
+  GPIO_WRITE(7, LE32(((value & 0xffff) << 8) | (REG_STATUS << PIN_A0)));
 
-  *(gpio + 7) = LE32(1 << PIN_WR);
-  *(gpio + 7) = LE32(1 << PIN_WR);  // delay
-  *(gpio + 10) = LE32(1 << PIN_WR);
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(7, LE32(1 << PIN_WR));
+  GPIO_WRITE(7, LE32(1 << PIN_WR));  // delay
+  GPIO_WRITE(10, LE32(1 << PIN_WR));
+  GPIO_WRITE(10, LE32(0xffffec));
 
-  *(gpio + 0) = LE32(GPFSEL0_INPUT);
-  *(gpio + 1) = LE32(GPFSEL1_INPUT);
-  *(gpio + 2) = LE32(GPFSEL2_INPUT);
+  GPIO_WRITE(0, LE32(GPFSEL0_INPUT));
+  GPIO_WRITE(1, LE32(GPFSEL1_INPUT));
+  GPIO_WRITE(2, LE32(GPFSEL2_INPUT));
+
+  bus_release();
 }
 
 unsigned int ps_read_status_reg() {
-  *(gpio + 7) = LE32(REG_STATUS << PIN_A0);
-  *(gpio + 7) = LE32(1 << PIN_RD);
-  *(gpio + 7) = LE32(1 << PIN_RD);
-  *(gpio + 7) = LE32(1 << PIN_RD);
-  *(gpio + 7) = LE32(1 << PIN_RD);
+  bus_acquire();
+
+  GPIO_WRITE(7, LE32(REG_STATUS << PIN_A0));
+  GPIO_WRITE(7, LE32(1 << PIN_RD));
+  GPIO_WRITE(7, LE32(1 << PIN_RD));
+  GPIO_WRITE(7, LE32(1 << PIN_RD));
+  GPIO_WRITE(7, LE32(1 << PIN_RD));
 
-  unsigned int value = LE32(*(gpio + 13));
+  unsigned int value = LE32(GPIO_READ(13));
 
-  *(gpio + 10) = LE32(0xffffec);
+  GPIO_WRITE(10, LE32(0xffffec));
+
+  bus_release();
 
   return (value >> 8) & 0xffff;
 }
@@ -509,7 +560,7 @@ void ps_pulse_reset() {
 }
 
 unsigned int ps_get_ipl_zero() {
-  unsigned int value = (*(gpio + 13));
+  unsigned int value = (GPIO_PEEK(13));
   return value & LE32(1 << PIN_IPL_ZERO);
 }
 
@@ -540,6 +591,147 @@ void ps_update_irq() {
 volatile int housekeeper_enabled = 0;
 extern struct M68KState *__m68k_state;
 
+/* Re-read the status register at most that often while IPL lines stay asserted */
+#define IPL_RESAMPLE_US 2
+
+static uint64_t ipl_resample;
+static uint64_t ipl_last_sample;
+static uint32_t ipl_last_pin = 1 << PIN_IPL_ZERO;
+
+#if EMU68_IPL_LATENCY
+/*
+  Histogram of CNTPCT ticks from IPL assertion to vector fetch, updated by the dispatcher. Bucket
+  n counts latencies in [2^n, 2^(n+1)) ticks, the last one everything above.
+*/
+uint32_t ipl_latency[32];
+#endif
+
+/*
+  Publish IRQ level in the context, see M68KState.IPL. The sequence number changes with every
+  sample, this allows the dispatcher to tell a level still asserted from an already handled one.
+*/
+static void ps_publish_ipl(unsigned int level)
+{
+  static uint32_t seq = 0;
+
+  if (level == 7)
+    level = 15;
+
+  seq++;
+  __atomic_store_n(&__m68k_state->IPL, (seq << 8) | level, __ATOMIC_RELEASE);
+}
+
+/*
+  Decode the level here instead of on the emulation core. Read the status register when IPL lines
+  get asserted and then periodically, since the level may change (or the same interrupt be raised
+  again) without IPL0 going high in between. Returns nonzero while IPL lines are asserted.
+*/
+static int ps_update_ipl(uint32_t pin, uint64_t t)
+{
+  uint32_t ipl0 = pin & (1 << PIN_IPL_ZERO);
+
+  if (ipl0 == 0)
+  {
+    if (ipl_last_pin != 0)
+      __m68k_state->IPL_STAMP = t;
+
+    if (ipl_last_pin != 0 || t - ipl_last_sample >= ipl_resample)
+    {
+      ps_publish_ipl((ps_read_status_reg() & STATUS_MASK_IPL) >> STATUS_SHIFT_IPL);
+      ipl_last_sample = t;
+    }
+  }
+  else if (ipl_last_pin == 0)
+  {
+    ps_publish_ipl(0);
+  }
+
+  ipl_last_pin = ipl0;
+  __m68k_state->IPL0 = ipl0;
+
+  asm volatile("":::"memory");
+
+  if (ipl0 == 0)
+    asm volatile("sev":::"memory");
+
+  return ipl0 == 0;
+}
+
+static void ps_reset_raspi()
+{
+  kprintf("[HKEEP] Houskeeper will reset RasPi now...\n");
+
+  unsigned int r;
+  // trigger a restart by instructing the GPU to boot from partition 0
+  r = LE32(*PM_RSTS); r &= ~0xfffffaaa;
+  *PM_RSTS = LE32(PM_WDOG_MAGIC | r);   // boot from partition 0
+  *PM_WDOG = LE32(PM_WDOG_MAGIC | 10);
+  *PM_RSTC = LE32(PM_WDOG_MAGIC | PM_RSTC_FULLRST);
+
+  while(1);
+}
+
+#if EMU68_HOUSEKEEPER_IRQ
+
+/*
+  The IRQ housekeeper programs the legacy interrupt controller and the ARM local block at their
+  BCM2836/7 addresses. Anything else (e.g. BCM2711 with its GIC) keeps the polling loop.
+*/
+static int ps_irq_layout_supported()
+{
+  of_node_t *e = dt_find_node("/");
+  of_property_t *p = e ? dt_find_property(e, "compatible") : NULL;
+
+  if (p == NULL)
+    return 0;
+
+  const char *c = p->op_value;
+  int len = p->op_length;
+
+  while (len > 0)
+  {
+    if (!strcmp(c, "brcm,bcm2836") || !strcmp(c, "brcm,bcm2837"))
+      return 1;
+
+    len -= strlen(c) + 1;
+    c += strlen(c) + 1;
+  }
+
+  return 0;
+}
+
+/*
+  IRQ handler of the housekeeper core, entered from the IRQ vector. Sources are the GPIO edge
+  detect on IPL0 and RESET (routed from the legacy interrupt controller) and the core's physical
+  timer, armed for periodic status register reads while IPL lines stay asserted.
+*/
+void ps_housekeeper_irq()
+{
+  uint64_t t;
+
+  asm volatile("mrs %0, CNTPCT_EL0":"=r"(t));
+
+  /* Acknowledge edges before sampling the pins, so that no later edge is lost */
+  GPIO_WRITE(GPEDS0, LE32((1 << PIN_IPL_ZERO) | (1 << PIN_RESET)));
+
+  uint32_t pin = LE32(GPIO_PEEK(13));
+
+  if ((pin & (1 << PIN_RESET)) == 0)
+    ps_reset_raspi();
+
+  if (ps_update_ipl(pin, t))
+  {
+    asm volatile("msr CNTP_TVAL_EL0, %0"::"r"(ipl_resample));
+    asm volatile("msr CNTP_CTL_EL0, %0"::"r"(1ULL));
+  }
+  else
+  {
+    asm volatile("msr CNTP_CTL_EL0, %0"::"r"(0ULL));
+  }
+}
+
+#endif
+
 void ps_housekeeper() 
 {
   if (!gpio)
@@ -554,39 +746,59 @@ void ps_housekeeper()
   asm volatile("mrs %0, CNTPCT_EL0":"=r"(t0));
   asm volatile("mrs %0, PMCCNTR_EL0":"=r"(last_arm_cnt));
 
+  uint64_t frq;
+
+  asm volatile("mrs %0, CNTFRQ_EL0":"=r"(frq));
+  ipl_resample = (frq & 0xffffffff) * IPL_RESAMPLE_US / 1000000;
+
   kprintf("[HKEEP] Housekeeper activated\n");
-  kprintf("[HKEEP] Please note we are burning the cpu with busyloops now\n");
 
   /* Configure timer-based event stream */
   /* Enable timer regs from EL0, enable event stream on posedge, monitor 3th bit */
   /* This gives a frequency of 1.2MHz for a 19.2MHz timer */
   asm volatile("msr CNTKCTL_EL1, %0"::"r"(3 | (1 << 2) | (3 << 8) | (3 << 4)));
 
-  for(;;) {
-    if (housekeeper_enabled)
-    {
-      uint32_t pin = LE32(*(gpio + 13));
-      __m68k_state->IPL0 = pin & (1 << PIN_IPL_ZERO);
+#if EMU68_HOUSEKEEPER_IRQ
+  if (ps_irq_layout_supported())
+  {
+    while (!housekeeper_enabled)
+      asm volatile("wfe");
 
-      asm volatile("":::"memory");
+    kprintf("[HKEEP] Watching IPL and RESET lines with GPIO edge detect IRQs\n");
 
-      if (__m68k_state->IPL0 == 0)
-        asm volatile("sev":::"memory");
+    /* Both edges of IPL0, falling edge of RESET, asynchronous detect for lowest latency */
+    GPIO_WRITE(GPEDS0, LE32((1 << PIN_IPL_ZERO) | (1 << PIN_RESET)));
+    GPIO_WRITE(GPAFEN0, LE32((1 << PIN_IPL_ZERO) | (1 << PIN_RESET)));
+    GPIO_WRITE(GPAREN0, LE32(1 << PIN_IPL_ZERO));
 
-      if ((pin & (1 << PIN_RESET)) == 0) {
+    /* gpio_int[0] to the GPU interrupt routing, GPU interrupts and physical timer to this core */
+    *IC_ENABLE_IRQS_2 = LE32(1 << (IRQ_GPIO0 - 32));
+    *LOCAL_GPU_ROUTING = LE32(2);
+    *LOCAL_TIMER_CNTRL(2) = LE32(LOCAL_TIMER_CNTPNSIRQ);
 
-        kprintf("[HKEEP] Houskeeper will reset RasPi now...\n");
+    /* Pick up lines asserted already, then leave the core idle until an IRQ arrives */
+    ps_housekeeper_irq();
+    asm volatile("msr DAIFClr, #2");
 
-        unsigned int r;
-        // trigger a restart by instructing the GPU to boot from partition 0
-        r = LE32(*PM_RSTS); r &= ~0xfffffaaa;
-        *PM_RSTS = LE32(PM_WDOG_MAGIC | r);   // boot from partition 0
-        *PM_WDOG = LE32(PM_WDOG_MAGIC | 10);
-        *PM_RSTC = LE32(PM_WDOG_MAGIC | PM_RSTC_FULLRST);
+    return;
+  }
 
-        while(1);
+  kprintf("[HKEEP] No BCM2836/7 interrupt controller, falling back to polling\n");
+#endif
+  kprintf("[HKEEP] Please note we are burning the cpu with busyloops now\n");
 
-      }
+  for(;;) {
+    if (housekeeper_enabled)
+    {
+      uint32_t pin = LE32(GPIO_PEEK(13));
+      uint64_t t;
+
+      asm volatile("mrs %0, CNTPCT_EL0":"=r"(t));
+
+      ps_update_ipl(pin, t);
+
+      if ((pin & (1 << PIN_RESET)) == 0)
+        ps_reset_raspi();
 
       /*
         Wait for event. It can happen that the CPU is flooded with them for some reason, but
@@ -647,119 +859,424 @@ void ps_housekeeper()
   }
 }
 
-#if 0
+#if EMU68_IPL_LATENCY
+
+void ps_dump_ipl_latency()
+{
+  uint64_t frq;
+
+  asm volatile("mrs %0, CNTFRQ_EL0":"=r"(frq));
+  frq = frq & 0xffffffff;
+
+  kprintf("[HKEEP] Latency from IPL assertion to vector fetch\n");
+
+  for (int i=0; i < 32; i++)
+  {
+    if (ipl_latency[i])
+      kprintf("[HKEEP]   %8lld - %8lld ns: %d\n", (1000000000ULL << i) / frq,
+        (1000000000ULL << (i + 1)) / frq, ipl_latency[i]);
+  }
+}
+
+#endif
+
+#if EMU68_POSTED_WRITES
+
+/*
+  Posted write buffer. CPU0 is the only producer and the write buffer task on CPU3 the only
+  consumer, so the ring needs no lock: wr_head is advanced by CPU0 only, wr_tail by CPU3 only.
+  An entry stays in the ring until the bus cycle has completed, hence an empty ring means all
+  posted writes have reached the Amiga.
+
+  An entry is a single 64-bit word (size, 24-bit address, value) so that both sides can access
+  it atomically: the task takes an entry by swapping WR_TAKEN in, CPU0 may merge a new write into
+  the newest entry with compare-and-swap as long as the entry was not taken yet.
+*/
 
 #define WRITEBUFFER_SIZE  64
 
-struct WriteRequest {
-  uint32_t  wr_addr;
-  uint32_t  wr_value;
-  uint8_t   wr_size;
-};
+#define WR_ENTRY(a, v, s) (((uint64_t)(s) << 56) | ((uint64_t)((a) & 0xffffff) << 32) | (uint32_t)(v))
+#define WR_ADDR(e)        ((uint32_t)((e) >> 32) & 0xffffff)
+#define WR_VALUE(e)       ((uint32_t)(e))
+#define WR_SIZE(e)        ((uint8_t)((e) >> 56))
+#define WR_TAKEN          0ULL
 
-struct WriteRequest *wr_buffer;
-volatile uint32_t wr_head;
-volatile uint32_t wr_tail;
-volatile unsigned char bus_lock = 0;
+static uint64_t wr_buffer[WRITEBUFFER_SIZE];
+static uint32_t wr_head;
+static uint32_t wr_tail;
+static volatile int wb_active = 0;
 
-void wb_push(uint32_t address, uint32_t value, uint8_t size)
+/*
+  Only writes to chip RAM and slow RAM are posted. CIA, custom chips and everything else in the
+  I/O space need strict ordering and act as a barrier: the ring is drained first.
+*/
+static inline int wb_postable(uint32_t address)
 {
-    while(wr_tail + WRITEBUFFER_SIZE <= wr_head)
-        asm volatile("yield");
-    
-    wr_buffer[wr_head & (WRITEBUFFER_SIZE - 1)].wr_addr = address;
-    wr_buffer[wr_head & (WRITEBUFFER_SIZE - 1)].wr_value = value;
-    wr_buffer[wr_head & (WRITEBUFFER_SIZE - 1)].wr_size = size;
+  return address < 0x200000 || (address >= 0xc00000 && address < 0xd80000);
+}
+
+void wb_waitfree()
+{
+  while (__atomic_load_n(&wr_tail, __ATOMIC_ACQUIRE) != wr_head)
+    asm volatile("yield");
+}
+
+#if EMU68_WRITE_COALESCE
+/*
+  Merge a write into a pending one. A write to the same location replaces the pending value, two
+  byte writes to the same aligned word, or a byte write into a pending word, become a single word
+  cycle. Returns WR_TAKEN if the writes cannot be merged.
+*/
+static inline uint64_t wb_merge(uint64_t old, uint32_t address, uint32_t value, uint8_t size)
+{
+  uint32_t old_addr = WR_ADDR(old);
+  uint32_t old_value = WR_VALUE(old);
 
-    asm volatile("dmb sy":::"memory");
+  if (WR_SIZE(old) == size && old_addr == address)
+    return WR_ENTRY(address, value, size);
 
-    __sync_add_and_fetch(&wr_head, 1);
-    
-    asm volatile("sev");
+  if (size == 1 && WR_SIZE(old) == 1 && (old_addr ^ address) == 1) {
+    if (address & 1)
+      return WR_ENTRY(old_addr, ((old_value & 0xff) << 8) | (value & 0xff), 2);
+    else
+      return WR_ENTRY(address, ((value & 0xff) << 8) | (old_value & 0xff), 2);
+  }
+
+  if (size == 1 && WR_SIZE(old) == 2 && !(old_addr & 1) && (address & ~1) == old_addr) {
+    if (address & 1)
+      return WR_ENTRY(old_addr, (old_value & 0xff00) | (value & 0xff), 2);
+    else
+      return WR_ENTRY(old_addr, ((value & 0xff) << 8) | (old_value & 0xff), 2);
+  }
+
+  return WR_TAKEN;
 }
+#endif
 
-struct WriteRequest wb_pop()
+void wb_push(uint32_t address, uint32_t value, uint8_t size)
 {
-    while (wr_tail == wr_head) {
-        asm volatile("wfe");
+  uint32_t head = wr_head;
+
+#if EMU68_WRITE_COALESCE
+  if (__atomic_load_n(&wr_tail, __ATOMIC_ACQUIRE) != head) {
+    uint64_t *last = &wr_buffer[(head - 1) & (WRITEBUFFER_SIZE - 1)];
+    uint64_t old = __atomic_load_n(last, __ATOMIC_RELAXED);
+
+    if (old != WR_TAKEN) {
+      uint64_t merged = wb_merge(old, address, value, size);
+
+      /* Fails if the task has taken the entry meanwhile, the write gets an entry of its own then */
+      if (merged != WR_TAKEN &&
+          __atomic_compare_exchange_n(last, &old, merged, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        return;
     }
+  }
+#endif
 
-    struct WriteRequest data = wr_buffer[wr_tail & (WRITEBUFFER_SIZE - 1)];
+  while (__atomic_load_n(&wr_tail, __ATOMIC_ACQUIRE) + WRITEBUFFER_SIZE <= head)
+    asm volatile("yield");
+
+  __atomic_store_n(&wr_buffer[head & (WRITEBUFFER_SIZE - 1)], WR_ENTRY(address, value, size), __ATOMIC_RELAXED);
 
-    __sync_add_and_fetch(&wr_tail, 1);
-    return data;
+  __atomic_store_n(&wr_head, head + 1, __ATOMIC_RELEASE);
+
+  asm volatile("dsb ish; sev":::"memory");
 }
 
-struct WriteRequest wb_peek()
+/*
+  Keep the m68k ordering for reads: I/O reads wait until all posted writes are done, RAM reads
+  only if a pending write overlaps the location being read.
+*/
+static inline void wb_order_read(uint32_t address, uint32_t size)
 {
-    while (wr_tail == wr_head) {
-        asm volatile("wfe");
+  uint32_t tail = __atomic_load_n(&wr_tail, __ATOMIC_ACQUIRE);
+
+  if (tail == wr_head)
+    return;
+
+  if (!wb_postable(address)) {
+    wb_waitfree();
+    return;
+  }
+
+  for (uint32_t i = tail; i != wr_head; i++) {
+    uint64_t req = __atomic_load_n(&wr_buffer[i & (WRITEBUFFER_SIZE - 1)], __ATOMIC_RELAXED);
+
+    /*
+      Only the entry wb_task works on is taken. Its write may not be on the bus yet and the
+      address is gone, so wait until the task has finished it.
+    */
+    if (req == WR_TAKEN) {
+      while (__atomic_load_n(&wr_tail, __ATOMIC_ACQUIRE) == i)
+        asm volatile("yield");
+      continue;
+    }
+
+    if (WR_ADDR(req) < address + size && address < WR_ADDR(req) + WR_SIZE(req)) {
+      wb_waitfree();
+      return;
     }
+  }
+}
+
+#else
 
-    struct WriteRequest data = wr_buffer[wr_tail & (WRITEBUFFER_SIZE - 1)];
+void wb_waitfree() {}
 
-    return data;
+static inline void wb_order_read(uint32_t address, uint32_t size)
+{
+  (void)address; (void)size;
 }
 
-void wb_waitfree()
+#endif
+
+static void ps_write_int(uint32_t address, uint32_t value, uint8_t size)
 {
-  while (wr_tail != wr_head)
-    asm volatile("yield");
+  switch (size) {
+    case 1:
+      ps_write_8_int(address, value);
+      break;
+    case 2:
+      ps_write_16_int(address, value);
+      break;
+    case 4:
+      ps_write_32_int(address, value);
+      break;
+  }
+}
+
+#if !EMU68_POSTED_WRITES
+void wb_push(uint32_t address, uint32_t value, uint8_t size)
+{
+  ps_write_int(address, value, size);
 }
 #endif
 
 void wb_init()
 {
-#if 0
-  wr_buffer = tlsf_malloc(tlsf, sizeof(struct WriteRequest) * WRITEBUFFER_SIZE);
+#if EMU68_POSTED_WRITES
   wr_head = wr_tail = 0;
-  bus_lock = 0;
+  for (int i=0; i < WRITEBUFFER_SIZE; i++)
+    wr_buffer[i] = WR_TAKEN;
 #endif
 }
 
 void wb_task()
 {
-#if 0
+#if EMU68_POSTED_WRITES
   kprintf("[WBACK] Write buffer activated\n");
 
+  __atomic_store_n(&wb_active, 1, __ATOMIC_RELEASE);
+
   while(1) {
-    struct WriteRequest req = wb_peek();
-
-    while(__atomic_test_and_set(&bus_lock, __ATOMIC_ACQUIRE)) { asm volatile("yield"); }
-
-    switch (req.wr_size) {
-      case 1:
-        ps_write_8_int(req.wr_addr, req.wr_value);
-        break;
-      case 2:
-        ps_write_16_int(req.wr_addr, req.wr_value);
-        break;
-      case 4:
-        ps_write_32_int(req.wr_addr, req.wr_value);
-        break;
+    uint32_t tail = wr_tail;
+
+    while (__atomic_load_n(&wr_head, __ATOMIC_ACQUIRE) == tail) {
+      asm volatile("wfe");
     }
 
-    __atomic_clear(&bus_lock, __ATOMIC_RELEASE);
+    uint64_t req = __atomic_exchange_n(&wr_buffer[tail & (WRITEBUFFER_SIZE - 1)], WR_TAKEN, __ATOMIC_ACQ_REL);
+
+    bus_acquire();
+    ps_write_int(WR_ADDR(req), WR_VALUE(req), WR_SIZE(req));
+    bus_release();
 
-    wb_pop();
+    __atomic_store_n(&wr_tail, tail + 1, __ATOMIC_RELEASE);
   }
 #endif
 }
 
+static inline void ps_write(uint32_t address, uint32_t value, uint8_t size)
+{
+  struct BusProfileStamp t0 = bp_start();
+
+#if EMU68_POSTED_WRITES
+  if (wb_active && wb_postable(address)) {
+    wb_push(address, value, size);
+    bp_account(BPL_BUS, address, size, 1, t0);
+    return;
+  }
+#endif
+
+  wb_waitfree();
+  bus_acquire();
+  ps_write_int(address, value, size);
+  bus_release();
+
+  bp_account(BPL_BUS, address, size, 1, t0);
+}
+
+static inline unsigned int ps_read(uint32_t address, uint8_t size)
+{
+  struct BusProfileStamp t0 = bp_start();
+  unsigned int value = 0;
+
+  wb_order_read(address, size);
+  bus_acquire();
+  switch (size) {
+    case 1:
+      value = ps_read_8_int(address);
+      break;
+    case 2:
+      value = ps_read_16_int(address);
+      break;
+    case 4:
+      value = ps_read_32_int(address);
+      break;
+  }
+  bus_release();
+
+  bp_account(BPL_BUS, address, size, 0, t0);
+
+  return value;
+}
+
+unsigned int ps_read_8(unsigned int address)
+{
+  return ps_read(address, 1);
+}
+
+unsigned int ps_read_16(unsigned int address)
+{
+  return ps_read(address, 2);
+}
+
+unsigned int ps_read_32(unsigned int address)
+{
+  return ps_read(address, 4);
+}
+
+/*
+  Burst transfers of sequential words, meant for RAM (no chipset delays). The GPIO setup and the
+  bus lock are done once per block instead of once per word, writes additionally keep the data
+  pins driven between the words. The buffer holds the data in m68k byte order.
+*/
+void ps_read_block(unsigned int address, void *buffer, unsigned int length)
+{
+  struct BusProfileStamp t0 = bp_start();
+  uint8_t *buf = buffer;
+  unsigned int start = address;
+  unsigned int total = length;
+
+  wb_order_read(address, length);
+  bus_acquire();
+
+  if ((address & 1) && length) {
+    *buf++ = ps_read_8_int(address++);
+    length--;
+  }
+
+  while (length >= 2) {
+    GPIO_WRITE(0, LE32(GPFSEL0_OUTPUT));
+    GPIO_WRITE(1, LE32(GPFSEL1_OUTPUT));
+    GPIO_WRITE(2, LE32(GPFSEL2_OUTPUT));
+
+    GPIO_WRITE(7, LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0)));
+    GPIO_WRITE(7, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(0xffffec));
+
+    GPIO_WRITE(7, LE32(((0x0200 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0)));
+    GPIO_WRITE(7, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(1 << PIN_WR));
+    GPIO_WRITE(10, LE32(0xffffec));
+
+    GPIO_WRITE(0, LE32(GPFSEL0_INPUT));
+    GPIO_WRITE(1, LE32(GPFSEL1_INPUT));
+    GPIO_WRITE(2, LE32(GPFSEL2_INPUT));
+
+    GPIO_WRITE(7, LE32(REG_DATA << PIN_A0));
+    GPIO_WRITE(7, LE32(1 << PIN_RD));
+
+    while (GPIO_READ(13) & LE32(1 << PIN_TXN_IN_PROGRESS)) {}
+    unsigned int value = LE32(GPIO_READ(13));
+
+    GPIO_WRITE(10, LE32(0xffffec));
+
+    *buf++ = value >> 16;
+    *buf++ = value >> 8;
+    address += 2;
+    length -= 2;
+  }
+
+  if (length)
+    *buf = ps_read_8_int(address);
+
+  bus_release();
+
+  bp_account(BPL_BUS, start, total, 0, t0);
+}
+
+void ps_write_block(unsigned int address, const void *buffer, unsigned int length)
+{
+  struct BusProfileStamp t0 = bp_start();
+  const uint8_t *buf = buffer;
+  unsigned int start = address;
+  unsigned int total = length;
+
+  wb_waitfree();
+  bus_acquire();
+
+  if ((address & 1) && length) {
+    ps_write_8_int(address++, *buf++);
+    length--;
+  }
+
+  if (length >= 2) {
+    GPIO_WRITE(0, LE32(GPFSEL0_OUTPUT));
+    GPIO_WRITE(1, LE32(GPFSEL1_OUTPUT));
+    GPIO_WRITE(2, LE32(GPFSEL2_OUTPUT));
+
+    while (length >= 2) {
+      unsigned int data = (buf[0] << 8) | buf[1];
+
+      GPIO_WRITE(7, LE32((data << 8) | (REG_DATA << PIN_A0)));
+      GPIO_WRITE(7, LE32(1 << PIN_WR));
+      GPIO_WRITE(10, LE32(1 << PIN_WR));
+      GPIO_WRITE(10, LE32(0xffffec));
+
+      GPIO_WRITE(7, LE32(((address & 0xffff) << 8) | (REG_ADDR_LO << PIN_A0)));
+      GPIO_WRITE(7, LE32(1 << PIN_WR));
+      GPIO_WRITE(10, LE32(1 << PIN_WR));
+      GPIO_WRITE(10, LE32(0xffffec));
+
+      GPIO_WRITE(7, LE32(((0x0000 | (address >> 16)) << 8) | (REG_ADDR_HI << PIN_A0)));
+      GPIO_WRITE(7, LE32(1 << PIN_WR));
+      GPIO_WRITE(10, LE32(1 << PIN_WR));
+      GPIO_WRITE(10, LE32(0xffffec));
+
+      /* TXN_IN_PROGRESS is an input in both GPIO setups, the data pins may stay driven */
+      while (GPIO_READ(13) & LE32((1 << PIN_TXN_IN_PROGRESS))) {}
+
+      buf += 2;
+      address += 2;
+      length -= 2;
+    }
+
+    GPIO_WRITE(0, LE32(GPFSEL0_INPUT));
+    GPIO_WRITE(1, LE32(GPFSEL1_INPUT));
+    GPIO_WRITE(2, LE32(GPFSEL2_INPUT));
+  }
+
+  if (length)
+    ps_write_8_int(address, *buf);
+
+  bus_release();
+
+  bp_account(BPL_BUS, start, total, 1, t0);
+}
+
 void ps_write_8(unsigned int address, unsigned int data)
 {
-  ps_write_8_int(address, data);
-  //wb_push(address, data, 1);
+  ps_write(address, data, 1);
 }
 
 void ps_write_16(unsigned int address, unsigned int data)
 {
-  ps_write_16_int(address, data);
-  //wb_push(address, data, 2);
+  ps_write(address, data, 2);
 }
 
 void ps_write_32(unsigned int address, unsigned int data)
 {
-  ps_write_32_int(address, data);
-  //wb_push(address, data, 4);
+  ps_write(address, data, 4);
 }
@@ -43,6 +43,21 @@
 #define GPIO_BASE (BCM2708_PERI_BASE + 0x200000) /* GPIO controller */
 #define GPCLK_BASE (BCM2708_PERI_BASE + 0x101000)
 
+// GPIO event detect registers, word offsets from gpio
+#define GPEDS0 16
+#define GPAREN0 31
+#define GPAFEN0 34
+
+// Legacy interrupt controller, gpio_int[0] is IRQ 49
+#define IC_ENABLE_IRQS_2 ((volatile uint32_t *)(BCM2708_PERI_BASE + 0xb214))
+#define IRQ_GPIO0 49
+
+// ARM local peripherals (BCM2836/7), mapped by Emu68 directly after PERIIOBASE
+#define ARM_LOCAL_BASE 0xF3000000
+#define LOCAL_GPU_ROUTING ((volatile uint32_t *)(ARM_LOCAL_BASE + 0x0c))
+#define LOCAL_TIMER_CNTRL(c) ((volatile uint32_t *)(ARM_LOCAL_BASE + 0x40 + 4 * (c)))
+#define LOCAL_TIMER_CNTPNSIRQ 2
+
 #define CLK_PASSWD 0x5a000000
 #define CLK_GP0_CTL 0x070
 #define CLK_GP0_DIV 0x074
@@ -76,6 +91,9 @@ void ps_write_8(unsigned int address, unsigned int data);
 void ps_write_16(unsigned int address, unsigned int data);
 void ps_write_32(unsigned int address, unsigned int data);
 
+void ps_read_block(unsigned int address, void *buffer, unsigned int length);
+void ps_write_block(unsigned int address, const void *buffer, unsigned int length);
+
 unsigned int ps_read_status_reg();
 void ps_write_status_reg(unsigned int value);
 
@@ -87,6 +105,8 @@ void bitbang_putByte(uint8_t byte);
 void fastSerial_putByte(uint8_t byte);
 void fastSerial_init();
 void ps_housekeeper();
+void ps_housekeeper_irq();
+void ps_dump_ipl_latency();
 unsigned int ps_get_ipl_zero();
 
 void wb_task();
@@ -25,6 +25,10 @@
 extern uint64_t mmu_user_L1[512];
 extern uint64_t mmu_user_L2[4*512];
 
+#ifdef PISTORM
+#include "ps_protocol.h"
+#endif
+
 void platform_init()
 {
     /*
@@ -40,6 +44,12 @@ void platform_init()
 
     mmu_map(0x40000000, 0x00000000, 0x10000000,
                         MMU_ACCESS | MMU_ISHARE | MMU_ATTR(0), 0);
+
+#ifdef PISTORM
+    ps_setup_protocol();
+    ps_reset_state_machine();
+    ps_pulse_reset();
+#endif
 }
 
 void platform_post_init()
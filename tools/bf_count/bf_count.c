@@ -0,0 +1,109 @@
+/*
+    Copyright © 2019 Michal Schulz <michal.schulz@gmx.de>
+    https://github.com/michalsc
+
+    This Source Code Form is subject to the terms of the
+    Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+    with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+/*
+    Count the A64 instructions src/M68k_LINEE.c emits for every bitfield instruction, on Dn and
+    on (An), with constant and dynamic offset and width. Constant fields are given inside one
+    byte, inside one longword, wrapping around bit 0 of Dn or spanning five bytes in memory.
+
+    Every form is translated twice: followed by MOVE from SR, so that the condition codes are
+    needed, and followed by MOVEQ, which overwrites them. See Makefile for building.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+int CountINSN(const uint16_t *m68k, int words);
+
+int host_vprintf(const char *format, va_list args)
+{
+    return vprintf(format, args);
+}
+
+static const struct {
+    const char *    bf_Name;
+    uint16_t        bf_Opcode;
+    int             bf_HasReg;      /* Ext word holds a data register, BFINS reads it, others write */
+} insns[] = {
+    { "BFTST",  0xe8c0, 0 },
+    { "BFEXTU", 0xe9c0, 1 },
+    { "BFCHG",  0xeac0, 0 },
+    { "BFEXTS", 0xebc0, 1 },
+    { "BFCLR",  0xecc0, 0 },
+    { "BFFFO",  0xedc0, 1 },
+    { "BFSET",  0xeec0, 0 },
+    { "BFINS",  0xefc0, 1 },
+};
+
+/* Offset and width as in the ext word, dynamic ones come from d1 and d2 */
+static const struct {
+    uint8_t         f_DynOffset;
+    uint8_t         f_Offset;
+    uint8_t         f_DynWidth;
+    uint8_t         f_Width;
+} fields[] = {
+    { 0, 4,  0, 4 },
+    { 0, 8,  0, 16 },
+    { 0, 28, 0, 8 },
+    { 0, 0,  0, 32 },
+    { 1, 1,  0, 8 },
+    { 1, 1,  1, 2 },
+};
+
+static int Count(uint16_t opcode, uint16_t ext, int flags_needed)
+{
+    uint16_t stream[4] = { opcode, ext };
+
+    /* move.w sr,d7 reads the condition codes, moveq #0,d7 sets all but X */
+    stream[2] = flags_needed ? 0x40c7 : 0x7e00;
+    stream[3] = 0x4e71;
+
+    return CountINSN(stream, 4);
+}
+
+int main()
+{
+    printf("%-8s %-8s %-14s %6s %6s\n", "insn", "ea", "field", "flags", "none");
+
+    for (unsigned i=0; i < sizeof(insns) / sizeof(insns[0]); i++)
+    {
+        for (int mem=0; mem < 2; mem++)
+        {
+            for (unsigned f=0; f < sizeof(fields) / sizeof(fields[0]); f++)
+            {
+                uint16_t opcode = insns[i].bf_Opcode | (mem ? 0x10 : 0x00);
+                uint16_t ext = insns[i].bf_HasReg ? 0x3000 : 0;
+                char field[16];
+
+                if (fields[f].f_DynOffset) {
+                    ext |= 0x0800 | (fields[f].f_Offset << 6);
+                    snprintf(field, sizeof(field), "{d%d:", fields[f].f_Offset);
+                } else {
+                    ext |= fields[f].f_Offset << 6;
+                    snprintf(field, sizeof(field), "{%d:", fields[f].f_Offset);
+                }
+
+                if (fields[f].f_DynWidth) {
+                    ext |= 0x0020 | fields[f].f_Width;
+                    snprintf(field + strlen(field), sizeof(field) - strlen(field), "d%d}", fields[f].f_Width);
+                } else {
+                    ext |= fields[f].f_Width & 31;
+                    snprintf(field + strlen(field), sizeof(field) - strlen(field), "%d}", fields[f].f_Width);
+                }
+
+                printf("%-8s %-8s %-14s %6d %6d\n", insns[i].bf_Name, mem ? "(a0)" : "d0", field,
+                    Count(opcode, ext, 1), Count(opcode, ext, 0));
+            }
+        }
+    }
+
+    return 0;
+}
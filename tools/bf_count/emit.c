@@ -0,0 +1,189 @@
+/*
+    Copyright © 2019 Michal Schulz <michal.schulz@gmx.de>
+    https://github.com/michalsc
+
+    This Source Code Form is subject to the terms of the
+    Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+    with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+/*
+    Emitter side of bf_count, built with the same headers and configuration as the translator.
+    Provides the few translator functions the line emitters call and translates one instruction
+    at a time, see CountINSN.
+*/
+
+#include <stdarg.h>
+#include "support.h"
+#include "M68k.h"
+#include "RegisterAllocator.h"
+#include "config.h"
+
+int8_t translation_s = 1;
+uint32_t insn_count;
+uint32_t bulk_ram_low;
+uint32_t bulk_ram_high;
+void *jit_tlsf;
+
+static int _pc_rel;
+
+int host_vprintf(const char *format, va_list args);
+
+void kprintf(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    host_vprintf(format, args);
+    va_end(args);
+}
+
+void arm_flush_cache(uintptr_t addr, uint32_t length)
+{
+    (void)addr;
+    (void)length;
+}
+
+void arm_icache_invalidate(uintptr_t addr, uint32_t length)
+{
+    (void)addr;
+    (void)length;
+}
+
+void *tlsf_malloc_aligned(void *handle, uintptr_t size, uintptr_t align)
+{
+    (void)handle;
+    (void)size;
+    (void)align;
+    return NULL;
+}
+
+/* Same PC bookkeeping as in M68k_Translator.c, so that PC updates are counted where they occur */
+uint32_t *EMIT_GetOffsetPC(uint32_t *ptr, int8_t *offset)
+{
+    int new_offset = _pc_rel + *offset;
+
+    if (new_offset > 127 || new_offset < -127)
+    {
+        if (_pc_rel > 0)
+            *ptr++ = add_immed(REG_PC, REG_PC, _pc_rel);
+        else
+            *ptr++ = sub_immed(REG_PC, REG_PC, -_pc_rel);
+
+        _pc_rel = 0;
+        new_offset = *offset;
+    }
+
+    *offset = new_offset;
+
+    return ptr;
+}
+
+uint32_t *EMIT_AdvancePC(uint32_t *ptr, uint8_t offset)
+{
+    _pc_rel += (int)offset;
+
+    if (_pc_rel > 120 || _pc_rel < -120)
+    {
+        if (_pc_rel > 0)
+            *ptr++ = add_immed(REG_PC, REG_PC, _pc_rel);
+        else
+            *ptr++ = sub_immed(REG_PC, REG_PC, -_pc_rel);
+
+        _pc_rel = 0;
+    }
+
+    return ptr;
+}
+
+uint32_t *EMIT_FlushPC(uint32_t *ptr)
+{
+    if (_pc_rel > 0)
+        *ptr++ = add_immed(REG_PC, REG_PC, _pc_rel);
+    else if (_pc_rel < 0)
+        *ptr++ = sub_immed(REG_PC, REG_PC, -_pc_rel);
+
+    _pc_rel = 0;
+
+    return ptr;
+}
+
+uint32_t *EMIT_ResetOffsetPC(uint32_t *ptr)
+{
+    _pc_rel = 0;
+
+    return ptr;
+}
+
+uint32_t *EMIT_UpdateInsnCount(uint32_t *ptr, uint32_t count)
+{
+    (void)count;
+    return ptr;
+}
+
+uint32_t *EMIT_InjectDebugString(uint32_t *ptr, const char * restrict format, ...)
+{
+    (void)format;
+    return ptr;
+}
+
+uint32_t *FPU_FlushFlags(uint32_t *ptr)
+{
+    return ptr;
+}
+
+int M68K_GetKnownBase(uint32_t address, uint8_t size, uint8_t *m68k_reg, int32_t *offset)
+{
+    (void)address;
+    (void)size;
+    (void)m68k_reg;
+    (void)offset;
+    return 0;
+}
+
+void M68K_PushReturnAddress(uint16_t *ret_addr)
+{
+    (void)ret_addr;
+}
+
+uint16_t *M68K_PopReturnAddress(uint8_t *success)
+{
+    *success = 0;
+    return NULL;
+}
+
+/*
+    Translate the line E instruction at m68k, which is in host byte order, and return the number
+    of A64 instructions emitted for it. CC and the context are loaded up front, as they are in the
+    middle of a unit, and written back afterwards without being counted.
+*/
+int CountINSN(const uint16_t *m68k, int words)
+{
+    static uint32_t code[1024];
+    static uint32_t scratch[64];
+    uint16_t stream[16];
+    uint16_t *m68k_ptr = stream;
+    uint16_t insn_consumed;
+    uint32_t *ptr = code;
+    uint32_t *start;
+    uint32_t *end;
+
+    for (int i=0; i < words && i < 16; i++)
+        stream[i] = BE16(m68k[i]);
+
+    _pc_rel = 0;
+    RA_GetCTX(&ptr);
+    RA_GetCC(&ptr);
+    start = ptr;
+
+    end = EMIT_lineE(ptr, &m68k_ptr, &insn_consumed);
+
+    ptr = scratch;
+    RA_FlushCC(&ptr);
+    RA_FlushCTX(&ptr);
+
+    while (end > start && (INSN_TO_LE(end[-1]) & 0xfffffff0) == 0xfffffff0)
+        end--;
+
+    return end - start;
+}
@@ -0,0 +1,258 @@
+/*
+    Copyright © 2019 Michal Schulz <michal.schulz@gmx.de>
+    https://github.com/michalsc
+
+    This Source Code Form is subject to the terms of the
+    Mozilla Public License, v. 2.0. If a copy of the MPL was not distributed
+    with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+*/
+
+/*
+    Host accuracy check of the FLOGN, FLOG2, FETOX and FTWOTOX kernels in src/M68k_PolyKernels.h.
+    The kernels are A64 assembly and do not depend on byte order, so this runs on any AArch64 Linux,
+    natively or with qemu-aarch64, see Makefile.
+
+    Random arguments over the whole useful range of every function are compared with the host libm
+    and the largest difference in ulp is reported. The reference is the 68881 result rounded to
+    double, which a correctly rounded libm gives. Special values (zeros, negative arguments, Inf,
+    NaN, denormals, powers of two) have to match exactly. Exit status is 1 if any check fails.
+
+    With -b the kernels and the host libm are timed instead, in ns per call.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "M68k_PolyKernels.h"
+
+/* Kernels take the argument in d0 and return in d0, which is how AAPCS64 passes doubles */
+typedef double (*kernel_t)(double);
+
+struct Check {
+    const char *    c_Name;
+    kernel_t        c_Kernel;
+    double          (*c_Reference)(double);
+    double          c_Low;
+    double          c_High;
+    int             c_LogRange;     /* Draw arguments uniformly in exponent instead of value */
+    uint64_t        c_MaxUlp;
+};
+
+static uint64_t seed = 0x2545f4914f6cdd1dULL;
+
+static uint64_t xorshift64()
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static uint64_t bits(double d)
+{
+    uint64_t u;
+    memcpy(&u, &d, 8);
+    return u;
+}
+
+static double from_bits(uint64_t u)
+{
+    double d;
+    memcpy(&d, &u, 8);
+    return d;
+}
+
+static int is_nan(double d)
+{
+    return (bits(d) & ~(1ULL << 63)) > 0x7ff0000000000000ULL;
+}
+
+/* Distance in ulp, doubles mapped onto a monotonic integer scale */
+static uint64_t ulp_distance(double a, double b)
+{
+    int64_t ia = bits(a);
+    int64_t ib = bits(b);
+
+    if (ia < 0)
+        ia = INT64_MIN - ia;
+    if (ib < 0)
+        ib = INT64_MIN - ib;
+
+    return ia > ib ? (uint64_t)ia - ib : (uint64_t)ib - ia;
+}
+
+static double random_arg(const struct Check *c)
+{
+    if (c->c_LogRange)
+    {
+        /* Positive doubles between c_Low and c_High with uniformly distributed bit patterns */
+        uint64_t lo = bits(c->c_Low);
+        uint64_t hi = bits(c->c_High);
+
+        return from_bits(lo + xorshift64() % (hi - lo));
+    }
+
+    return c->c_Low + (c->c_High - c->c_Low) * ((xorshift64() >> 11) * 0x1p-53);
+}
+
+static int same(double a, double b)
+{
+    if (is_nan(a) || is_nan(b))
+        return is_nan(a) && is_nan(b);
+
+    return bits(a) == bits(b);
+}
+
+static int check_exact(const char *name, kernel_t kernel, double arg, double expected)
+{
+    double result = kernel(arg);
+
+    if (same(result, expected))
+        return 0;
+
+    printf("  %s(%a) = %a, expected %a\n", name, arg, result, expected);
+    return 1;
+}
+
+static int run_random(const struct Check *c, int count)
+{
+    uint64_t max_ulp = 0;
+    double worst = 0.0;
+    int failed = 0;
+
+    for (int i=0; i < count; i++)
+    {
+        double x = random_arg(c);
+        double r = c->c_Kernel(x);
+        double ref = c->c_Reference(x);
+        uint64_t ulp;
+
+        if (is_nan(r) || is_nan(ref))
+            ulp = same(r, ref) ? 0 : UINT64_MAX;
+        else
+            ulp = ulp_distance(r, ref);
+
+        if (ulp > max_ulp)
+        {
+            max_ulp = ulp;
+            worst = x;
+        }
+        if (ulp > c->c_MaxUlp)
+            failed++;
+    }
+
+    printf("%-8s %d arguments in [%a, %a]: max %llu ulp (at %a), %d above %llu ulp\n",
+        c->c_Name, count, c->c_Low, c->c_High, (unsigned long long)max_ulp, worst, failed,
+        (unsigned long long)c->c_MaxUlp);
+
+    return failed != 0;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Time kernel and reference on the same arguments, the sum keeps the calls from being dropped */
+static void run_bench(const struct Check *c)
+{
+    enum { COUNT = 1 << 16, ROUNDS = 32 };
+    static double args[COUNT];
+    double sum = 0.0;
+    double t0, t1, t2;
+
+    for (int i=0; i < COUNT; i++)
+        args[i] = random_arg(c);
+
+    t0 = now();
+    for (int r=0; r < ROUNDS; r++)
+        for (int i=0; i < COUNT; i++)
+            sum += c->c_Kernel(args[i]);
+    t1 = now();
+    for (int r=0; r < ROUNDS; r++)
+        for (int i=0; i < COUNT; i++)
+            sum += c->c_Reference(args[i]);
+    t2 = now();
+
+    printf("%-8s [%a, %a]: kernel %.1f ns, libm %.1f ns per call (%g)\n", c->c_Name, c->c_Low, c->c_High,
+        (t1 - t0) / (COUNT * ROUNDS), (t2 - t1) / (COUNT * ROUNDS), sum);
+}
+
+int main(int argc, char **argv)
+{
+    const kernel_t log_k = (kernel_t)PolyLog;
+    const kernel_t log2_k = (kernel_t)PolyLog2;
+    const kernel_t exp_k = (kernel_t)PolyExp;
+    const kernel_t exp2_k = (kernel_t)PolyTwoToX;
+    const double inf = from_bits(0x7ff0000000000000ULL);
+    const double nan = from_bits(0x7ff8000000000000ULL);
+    const double denorm_min = from_bits(1);
+
+    const struct Check checks[] = {
+        { "FLOGN",   log_k,  log,  denorm_min, 0x1p1023, 1, 1 },
+        { "FLOGN",   log_k,  log,  0.5,        2.0,      0, 1 },
+        { "FLOG2",   log2_k, log2, denorm_min, 0x1p1023, 1, 2 },
+        { "FLOG2",   log2_k, log2, 0.5,        2.0,      0, 2 },
+        { "FETOX",   exp_k,  exp,  -745.0,     709.0,    0, 1 },
+        { "FETOX",   exp_k,  exp,  -1.0,       1.0,      0, 1 },
+        { "FTWOTOX", exp2_k, exp2, -1074.0,    1023.0,   0, 1 },
+        { "FTWOTOX", exp2_k, exp2, -1.0,       1.0,      0, 1 },
+    };
+    int failed = 0;
+
+    if (argc > 1 && strcmp(argv[1], "-b") == 0)
+    {
+        for (unsigned i=0; i < sizeof(checks) / sizeof(checks[0]); i++)
+            run_bench(&checks[i]);
+
+        return 0;
+    }
+
+    for (unsigned i=0; i < sizeof(checks) / sizeof(checks[0]); i++)
+        failed += run_random(&checks[i], 1000000);
+
+    printf("Special values\n");
+
+    failed += check_exact("FLOGN", log_k, 1.0, 0.0);
+    failed += check_exact("FLOGN", log_k, 0.0, -inf);
+    failed += check_exact("FLOGN", log_k, -0.0, -inf);
+    failed += check_exact("FLOGN", log_k, -1.0, nan);
+    failed += check_exact("FLOGN", log_k, inf, inf);
+    failed += check_exact("FLOGN", log_k, -inf, nan);
+    failed += check_exact("FLOGN", log_k, nan, nan);
+    failed += check_exact("FLOGN", log_k, denorm_min, log(denorm_min));
+
+    failed += check_exact("FLOG2", log2_k, 0.0, -inf);
+    failed += check_exact("FLOG2", log2_k, -1.0, nan);
+    failed += check_exact("FLOG2", log2_k, inf, inf);
+    failed += check_exact("FLOG2", log2_k, nan, nan);
+    for (int k=-1074; k < 1024; k++)
+        failed += check_exact("FLOG2", log2_k, exp2(k), k);
+
+    failed += check_exact("FETOX", exp_k, 0.0, 1.0);
+    failed += check_exact("FETOX", exp_k, -0.0, 1.0);
+    failed += check_exact("FETOX", exp_k, inf, inf);
+    failed += check_exact("FETOX", exp_k, -inf, 0.0);
+    failed += check_exact("FETOX", exp_k, nan, nan);
+    failed += check_exact("FETOX", exp_k, 710.0, inf);
+    failed += check_exact("FETOX", exp_k, -746.0, 0.0);
+
+    failed += check_exact("FTWOTOX", exp2_k, inf, inf);
+    failed += check_exact("FTWOTOX", exp2_k, -inf, 0.0);
+    failed += check_exact("FTWOTOX", exp2_k, nan, nan);
+    failed += check_exact("FTWOTOX", exp2_k, 1024.0, inf);
+    failed += check_exact("FTWOTOX", exp2_k, -1100.0, 0.0);
+    for (int k=-1074; k < 1024; k++)
+        failed += check_exact("FTWOTOX", exp2_k, k, exp2(k));
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+
+    return failed != 0;
+}